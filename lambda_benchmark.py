@@ -65,6 +65,12 @@ def parse_ini(section, conf_file):
     return dict(config.items(section))
 
 
+def parse_ini_optional(section, conf_file):
+    config = configparser.ConfigParser()
+    config.read(conf_file)
+    return dict(config.items(section)) if config.has_section(section) else dict()
+
+
 def invoke_lambda(e):
     lambda_client.invoke(FunctionName=function_name, InvocationType='Event', Payload=json.dumps(e))
 
@@ -81,6 +87,8 @@ def invoke(args, mode, warm_up, lambda_id=str(0)):
         system=args.system,
         conf=parse_ini(args.system, args.conf),
         bench_conf=parse_ini("benchmark", args.conf),
+        workload_conf=parse_ini_optional("workload", args.conf),
+        payload_conf=parse_ini_optional("payload", args.conf),
         host=args.host,
         port=args.port,
         bin_path=args.bin_path,
@@ -89,6 +97,7 @@ def invoke(args, mode, warm_up, lambda_id=str(0)):
         dist=args.dist,
         warm_up=warm_up,
         num_listeners=args.num_listeners,
+        per_op=not args.no_per_op,
         mode=mode,
         id=lambda_id
     )
@@ -250,7 +259,11 @@ def main():
               '\tread     - execute read benchmark\n'
               '\twrite    - execute write benchmark\n'
               '\tdestroy  - destroy the table/bucket/file\n'
-              '\tasync{n} - send asynchronous read/write requests at rate n\n\n'
+              '\tworkload - execute the mixed workload in the [workload] section,\n'
+              '\t           after loading its keys if write is also given\n'
+              '\tasync{n} - send asynchronous read/write requests in batches of n\n'
+              '\trate{n}  - send asynchronous read/write requests at rate n op/s,\n'
+              '\t           measuring latency from each request\'s intended send time\n\n'
               'Examples:\n'
               '\tcreate_write_destroy_async{10} - Create table/bucket/file,\n'
               '\texecute read benchmark sending async requests at 10 op/s,\n'
@@ -268,9 +281,12 @@ def main():
     parser.add_argument('--port', type=int, default=8888, help='port that server listens on')
     parser.add_argument('--num-ops', type=int, default=-1, help='number of operations')
     parser.add_argument('--num-listeners', type=int, default=1, help='number of listeners (notification_bench)')
+    parser.add_argument('--no-per-op', action='store_true',
+                        help='upload only per-interval summaries, not per-op records (storage_bench)')
     parser.add_argument('--bin-path', type=str, default='build', help='location of executable (local mode only)')
     parser.add_argument('--obj-size', type=int, default=8, help='object size to benchmark for')
-    parser.add_argument('--dist', type=str, default='sequential', help='key distribution (storage_bench)')
+    parser.add_argument('--dist', type=str, default='sequential',
+                        help='key distribution (storage_bench): sequential, zipf, scrambled_zipf, hotspot, uniform')
     parser.add_argument('--mode', type=str, default='create_read_write_destroy', help='benchmark mode' + m_help)
     parser.add_argument('--bench-type', type=str, default='storage_bench',
                         help='benchmark (storage_bench/notification_bench)')
@@ -38,5 +38,7 @@ python $bench --bench-type notification_bench --conf $conf --invoke-local --bin-
   --mode $mode --obj-size $size --num-ops $nops --num-listeners $num_listeners 1>${log}.stdout 2>${log}.stderr
 
 for i in `seq 0 $((num_listeners - 1))`; do
-  stats /tmp/${sys}_0_${size}_$((i + 1))Of${num_listeners}.txt >> ${sys}_${num_listeners}.txt
+  result=/tmp/${sys}_0_${size}_$((i + 1))Of${num_listeners}
+  $bin/result_convert ${result}.bin > ${result}.txt
+  stats ${result}.txt >> ${sys}_${num_listeners}.txt
 done
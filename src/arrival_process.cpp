@@ -0,0 +1,208 @@
+#include "arrival_process.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include "benchmark_utils.h"
+
+load_profile::load_profile(const std::string &spec) : m_period(0), m_min(0), m_max(0) {
+  std::vector<std::string> args;
+  benchmark_utils::split(spec, args, ':');
+  auto param = [&](size_t i) {
+    if (i >= args.size())
+      throw std::invalid_argument("Missing parameter in load profile " + spec);
+    return std::stod(args[i]);
+  };
+  if (args.empty()) {
+    throw std::invalid_argument("Empty load profile");
+  } else if (args[0] == "ramp") {
+    add(0, param(1));
+    add(param(3), param(2));
+  } else if (args[0] == "step") {
+    if (args.size() < 3 || args.size() % 2 != 1)
+      throw std::invalid_argument("step needs multiplier:seconds pairs: " + spec);
+    double t = 0;
+    for (size_t i = 1; i < args.size(); i += 2) {
+      add(t, param(i));
+      t += param(i + 1);
+      add(t, param(i));
+    }
+  } else if (args[0] == "diurnal") {
+    m_min = param(1);
+    m_max = param(2);
+    m_period = param(3);
+    if (m_period <= 0 || m_min <= 0 || m_max < m_min)
+      throw std::invalid_argument("diurnal needs 0 < min <= max and a positive period: " + spec);
+  } else if (args[0] == "spike") {
+    auto base = param(1), at = param(3);
+    add(0, base);
+    add(at, base);
+    add(at, param(2));
+    add(at + param(4), param(2));
+    add(at + param(4), base);
+  } else {
+    std::ifstream in(spec);
+    if (!in)
+      throw std::invalid_argument("Could not open load profile " + spec);
+    std::string line;
+    while (std::getline(in, line)) {
+      std::vector<std::string> fields;
+      benchmark_utils::split(line, fields, '\t');
+      if (fields.empty() || fields[0].empty() || fields[0][0] == '#')
+        continue;
+      if (fields.size() != 2)
+        throw std::invalid_argument("Expected <seconds>\t<multiplier> in " + spec + ": " + line);
+      add(std::stod(fields[0]), std::stod(fields[1]));
+    }
+    if (m_times.empty())
+      throw std::invalid_argument("Load profile " + spec + " is empty");
+  }
+  // A rate of zero from some point on would never send the remaining ops
+  if (m_period == 0 && m_multipliers.back() <= 0)
+    throw std::invalid_argument("Load profile " + spec + " must end with a positive multiplier");
+}
+
+void load_profile::add(double seconds, double multiplier) {
+  if (multiplier < 0 || (!m_times.empty() && seconds < m_times.back()))
+    throw std::invalid_argument("Load profile points need non-negative multipliers in time order");
+  m_times.push_back(seconds);
+  m_multipliers.push_back(multiplier);
+}
+
+double load_profile::multiplier(double seconds) const {
+  if (m_period > 0)
+    return m_min + (m_max - m_min) * (1 - std::cos(2 * M_PI * seconds / m_period)) / 2;
+  auto it = std::upper_bound(m_times.begin(), m_times.end(), seconds);
+  if (it == m_times.begin())
+    return m_multipliers.front();
+  if (it == m_times.end())
+    return m_multipliers.back();
+  auto i = static_cast<size_t>(it - m_times.begin());
+  auto f = (seconds - m_times[i - 1]) / (m_times[i] - m_times[i - 1]);
+  return m_multipliers[i - 1] + f * (m_multipliers[i] - m_multipliers[i - 1]);
+}
+
+arrival_process::arrival_process(const storage_interface::property_map &conf)
+    : m_process(UNIFORM), m_on(true), m_level(0), m_state_end(0) {
+  auto process = conf.get<std::string>("process", "uniform");
+  if (process == "uniform") {
+    m_process = UNIFORM;
+  } else if (process == "poisson") {
+    m_process = POISSON;
+  } else if (process == "onoff") {
+    m_process = ON_OFF;
+  } else if (process == "mmpp") {
+    m_process = MMPP;
+  } else {
+    throw std::invalid_argument("Unknown arrival process: " + process);
+  }
+
+  m_on_ns = conf.get<double>("on_ms", 100) * 1e6;
+  m_off_ns = conf.get<double>("off_ms", 900) * 1e6;
+  if (m_on_ns <= 0 || m_off_ns < 0)
+    throw std::invalid_argument("onoff needs on_ms > 0 and off_ms >= 0");
+
+  m_dwell_ns = conf.get<double>("dwell_ms", 1000) * 1e6;
+  std::vector<std::string> levels;
+  benchmark_utils::split(conf.get<std::string>("levels", "0.25,1,4"), levels, ',');
+  double sum = 0;
+  for (const auto &level: levels) {
+    m_levels.push_back(std::stod(level));
+    if (m_levels.back() < 0)
+      throw std::invalid_argument("mmpp levels must not be negative");
+    sum += m_levels.back();
+  }
+  if (m_levels.empty() || sum <= 0 || m_dwell_ns <= 0)
+    throw std::invalid_argument("mmpp needs a positive level and dwell_ms");
+  for (auto &level: m_levels)
+    level *= m_levels.size() / sum;
+
+  m_profile_spec = conf.get<std::string>("profile", "");
+  if (!m_profile_spec.empty())
+    m_profile.reset(new load_profile(m_profile_spec));
+  m_rng.seed(conf.get<uint64_t>("seed", std::random_device()()));
+}
+
+double arrival_process::next(double offset_ns, double rate) {
+  auto t = offset_ns;
+  // Rates are re-read from the profile at each arrival, so the profile should change slowly next to the gaps
+  auto rate_at = [&](double at) {
+    return m_profile != nullptr ? rate * m_profile->multiplier(at / 1e9) : rate;
+  };
+  switch (m_process) {
+    case UNIFORM:
+    case POISSON:
+    {
+      // Idle through stretches where the profile is at zero
+      double r;
+      while ((r = rate_at(t)) <= 0)
+        t += 1e6;
+      return t + (m_process == UNIFORM ? 1e9 / r : exponential(1e9 / r));
+    }
+    case ON_OFF:
+      // Arrivals are memoryless, so one that would fall after the end of a burst is redrawn in the next burst
+      while (true) {
+        if (m_state_end == 0)
+          m_state_end = t + exponential(m_on_ns);
+        if (!m_on) {
+          t = std::max(t, m_state_end);
+          m_on = true;
+          m_state_end = t + exponential(m_on_ns);
+        }
+        auto r = rate_at(t) * (m_on_ns + m_off_ns) / m_on_ns;
+        auto candidate = r > 0 ? t + exponential(1e9 / r) : m_state_end;
+        if (candidate < m_state_end)
+          return candidate;
+        t = m_state_end;
+        m_on = false;
+        m_state_end = t + exponential(m_off_ns);
+      }
+    case MMPP:
+      while (true) {
+        if (m_state_end == 0)
+          m_state_end = t + exponential(m_dwell_ns);
+        auto r = rate_at(t) * m_levels[m_level];
+        auto candidate = r > 0 ? t + exponential(1e9 / r) : m_state_end;
+        if (candidate < m_state_end)
+          return candidate;
+        t = m_state_end;
+        if (m_levels.size() > 1) {
+          auto next = std::uniform_int_distribution<size_t>(0, m_levels.size() - 2)(m_rng);
+          m_level = next >= m_level ? next + 1 : next;
+        }
+        m_state_end = t + exponential(m_dwell_ns);
+      }
+  }
+  return t;
+}
+
+void arrival_process::restart() {
+  m_on = true;
+  m_level = 0;
+  m_state_end = 0;
+}
+
+double arrival_process::exponential(double mean) {
+  if (mean <= 0)
+    return 0;
+  return std::exponential_distribution<double>(1.0 / mean)(m_rng);
+}
+
+bool arrival_process::evenly_spaced() const {
+  return m_process == UNIFORM && m_profile == nullptr;
+}
+
+void arrival_process::print(std::ostream &out) const {
+  static const char *PROCESS_NAMES[] = {"uniform", "poisson", "onoff", "mmpp"};
+  out << "Arrivals: process=" << PROCESS_NAMES[m_process];
+  if (m_process == ON_OFF)
+    out << " on_ms=" << m_on_ns / 1e6 << " off_ms=" << m_off_ns / 1e6;
+  if (m_process == MMPP) {
+    out << " levels=";
+    for (size_t i = 0; i < m_levels.size(); ++i)
+      out << (i ? "," : "") << m_levels[i];
+    out << " dwell_ms=" << m_dwell_ns / 1e6;
+  }
+  if (m_profile != nullptr)
+    out << " profile=" << m_profile_spec;
+}
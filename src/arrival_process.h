@@ -0,0 +1,90 @@
+#ifndef STORAGE_BENCH_ARRIVAL_PROCESS_H
+#define STORAGE_BENCH_ARRIVAL_PROCESS_H
+
+#include <memory>
+#include <string>
+#include <random>
+#include <vector>
+#include <ostream>
+#include "storage_interface.h"
+
+/*
+ * Multiplier of the nominal rate over the course of a run, given as a shape or as a file of
+ * "<seconds>\t<multiplier>" points that are interpolated linearly (two points at the same time make a step).
+ * The last multiplier holds until the end of the run. Shapes:
+ *
+ *   ramp:<from>:<to>:<seconds>                   linear from one multiplier to another
+ *   step:<m1>:<seconds1>:<m2>:<seconds2>:...     each multiplier held for its seconds
+ *   diurnal:<min>:<max>:<period_seconds>         sinusoid starting at the trough
+ *   spike:<base>:<peak>:<at_seconds>:<seconds>   peak for a while, base otherwise
+ */
+class load_profile {
+ public:
+  explicit load_profile(const std::string &spec);
+
+  double multiplier(double seconds) const;
+
+ private:
+  void add(double seconds, double multiplier);
+
+  double m_period;
+  double m_min;
+  double m_max;
+  std::vector<double> m_times;
+  std::vector<double> m_multipliers;
+};
+
+/*
+ * When the ops of a rate-limited run are sent, configured by the [arrival] section. Without it, or with
+ * process=uniform and no profile, ops are spaced evenly at the nominal rate by the rate limiter alone.
+ *
+ *   process=uniform     uniform (evenly spaced), poisson, onoff or mmpp
+ *   on_ms=100           onoff: mean length of a burst; arrivals within a burst are Poisson
+ *   off_ms=900          onoff: mean silence between bursts; bursts run at (on_ms + off_ms) / on_ms times the rate
+ *   levels=0.25,1,4     mmpp: rate multipliers of the states of a Markov-modulated Poisson process, scaled so
+ *                       that their mean is 1
+ *   dwell_ms=1000       mmpp: mean time spent in a state before moving to another one at random
+ *   profile             load_profile spec that the nominal rate follows over time (constant if empty)
+ *   seed                for reproducible arrivals (random if unset)
+ */
+class arrival_process {
+ public:
+  explicit arrival_process(const storage_interface::property_map &conf);
+
+  // Time of the arrival after one at offset_ns from the start of the run, for a nominal rate in ops/s
+  double next(double offset_ns, double rate);
+
+  // Starts over from offset 0 in a fresh burst or state
+  void restart();
+
+  void print(std::ostream &out) const;
+
+  // Uniform with a constant rate, which the rate limiter's own schedule already gives without a lock
+  bool evenly_spaced() const;
+
+ private:
+  enum process {
+    UNIFORM,
+    POISSON,
+    ON_OFF,
+    MMPP
+  };
+
+  double exponential(double mean);
+
+  process m_process;
+  std::string m_profile_spec;
+  std::unique_ptr<load_profile> m_profile;
+  std::mt19937_64 m_rng;
+
+  double m_on_ns;
+  double m_off_ns;
+  double m_dwell_ns;
+  std::vector<double> m_levels;
+  // Current burst or state of the modulating chain, and when it ends
+  bool m_on;
+  size_t m_level;
+  double m_state_end;
+};
+
+#endif //STORAGE_BENCH_ARRIVAL_PROCESS_H
@@ -0,0 +1,34 @@
+#ifndef STORAGE_BENCH_BARRIER_H
+#define STORAGE_BENCH_BARRIER_H
+
+#include <mutex>
+#include <condition_variable>
+
+class barrier {
+ public:
+  explicit barrier(size_t count) : m_count(count), m_waiting(0), m_generation(0) {}
+
+  void wait() {
+    std::unique_lock<std::mutex> mlock(m_mtx);
+    auto generation = m_generation;
+    if (++m_waiting == m_count) {
+      ++m_generation;
+      m_waiting = 0;
+      mlock.unlock();
+      m_cond.notify_all();
+      return;
+    }
+    while (generation == m_generation) {
+      m_cond.wait(mlock);
+    }
+  }
+
+ private:
+  size_t m_count;
+  size_t m_waiting;
+  size_t m_generation;
+  std::mutex m_mtx;
+  std::condition_variable m_cond;
+};
+
+#endif //STORAGE_BENCH_BARRIER_H
@@ -1,15 +1,30 @@
 #ifndef STORAGE_BENCH_BENCHMARK_H
 #define STORAGE_BENCH_BENCHMARK_H
 
+#include <atomic>
+#include <cstdio>
 #include <cstdlib>
 #include <chrono>
 #include <fstream>
 #include <memory>
+#include <mutex>
 #include <thread>
+#include <vector>
+#include <unordered_set>
+#include <algorithm>
 #include "storage_interface.h"
+#include "barrier.h"
+#include "queue.h"
+#include "latency_histogram.h"
+#include "result_file.h"
 #include "rate_limiter.h"
 #include "benchmark_utils.h"
+#include "hr_clock.h"
 #include "key_generator.h"
+#include "workload.h"
+#include "payload.h"
+#include "slo_search.h"
+#include "trace.h"
 #include "notification_interface.h"
 
 #ifndef ERROR_MAX
@@ -20,51 +35,265 @@
 #define MEASURE_INTERVAL 1000000
 #endif
 
+// MEASURE_INTERVAL is in microseconds; benchmarks time themselves with hr_clock, in nanoseconds
+#define MEASURE_INTERVAL_NS (MEASURE_INTERVAL * 1000ULL)
+
 #define BENCHMARK_READ    1
 #define BENCHMARK_WRITE   2
 #define BENCHMARK_CREATE  4
 #define BENCHMARK_DESTROY 8
+#define BENCHMARK_PRELOAD 16
 
 class benchmark {
  public:
+  // Rate-limited requests record the time the pacer intended them to be sent and the time they actually were,
+  // so completions can report both response time and service time.
+  struct send_record {
+    uint64_t intended_ns;
+    uint64_t sent_ns;
+    size_t value_size;
+  };
+
+  // What the receiving side of a rate-limited phase saw, excluding warm-up
+  struct rate_limited_result {
+    latency_histogram response_time;
+    size_t errors;
+    // Successful completions per second
+    double throughput;
+  };
+
+  // One of several workloads that run_tenants() runs side by side against the same store
+  struct tenant {
+    std::string name;
+    std::shared_ptr<workload> wl;
+    std::shared_ptr<payload> values;
+    size_t num_workers;
+    size_t num_ops;
+    // Shared by the tenant's workers, and a child of the global limiter if there is one; null to run them
+    // closed-loop
+    std::shared_ptr<rate_limiter> limiter;
+    // Limit of each of the tenant's workers, under limiter; 0 for none
+    double thread_rate;
+  };
+
+  // Per-worker scratch space that every closed-loop op reuses, so formatting keys and assembling batches do not
+  // allocate
+  struct op_buffers {
+    // Keys the op is to cover: the batch size, except for a worker's last batch, which may be shorter
+    size_t batch = 1;
+    std::string key;
+    std::vector<std::string> keys;
+    std::vector<storage_interface::value_slice> values;
+    std::vector<std::string> results;
+  };
+
+  // How preload() fills the key space, from the [preload] section
+  struct preload_options {
+    // Keys per multi_write
+    size_t batch_size;
+    // Keys a worker claims at a time; the checkpoint advances a chunk at a time
+    size_t chunk_size;
+    // How often the checkpoint is saved to the store
+    uint64_t checkpoint_interval_ns;
+  };
+
+  // What preload() records in the store under MANIFEST_KEY once every key is written, and under CHECKPOINT_KEY
+  // while it is still loading (num_keys then being the keys written so far)
+  struct dataset_manifest {
+    size_t num_keys;
+    size_t value_size;
+  };
+
+  static constexpr const char *MANIFEST_KEY = "storage_bench_manifest";
+  static constexpr const char *CHECKPOINT_KEY = "storage_bench_checkpoint";
+
+  // With batch_size > 1, each op reads or writes batch_size keys through multi_read/multi_write, and num_ops
+  // counts keys rather than ops. A limiter, if given, paces the reads and writes at its rate in keys per second,
+  // taking one permit per key of each op. With BENCHMARK_PRELOAD, keys [0, num_ops) are loaded by preload() first;
+  // a run that only reads checks the manifest preload() left instead.
   template<typename K>
-  static void run(const std::shared_ptr<storage_interface> &s_if,
+  static void run(const std::vector<std::shared_ptr<storage_interface>> &s_ifs,
                   const storage_interface::property_map &conf,
-                  const std::shared_ptr<K> key_gen,
+                  const std::vector<std::shared_ptr<K>> &key_gens,
                   const std::string &output_path,
-                  size_t value_size,
+                  const payload &values,
                   size_t num_ops,
+                  size_t batch_size,
+                  const preload_options &preload_opts,
                   bool warm_up,
                   int32_t mode,
-                  uint64_t max_us,
+                  uint64_t max_ns,
+                  const std::shared_ptr<rate_limiter> &limiter,
                   const std::string &control_host,
                   int control_port,
                   const std::string &id) {
-    int err_count = 0;
-    size_t warm_up_ops = num_ops / 10;
-    std::string value(value_size, 'x');
+    std::vector<std::shared_ptr<payload>> payloads;
+    for (size_t t = 0; t < s_ifs.size(); ++t)
+      payloads.push_back(std::make_shared<payload>(values));
 
-    auto start_us = benchmark_utils::now_us();
+    auto start_ns = hr_clock::now_ns();
 
     std::cerr << "Initializing storage interface..." << std::endl;
-    s_if->init(conf, (mode & BENCHMARK_CREATE) == BENCHMARK_CREATE);
+    for (size_t t = 0; t < s_ifs.size(); ++t) {
+      // Only the first worker creates the table/bucket; the rest attach to it
+      s_ifs[t]->init(conf, t == 0 && (mode & BENCHMARK_CREATE) == BENCHMARK_CREATE);
+    }
 
     if (!benchmark_utils::signal(control_host, control_port, id)) {
       std::cerr << "Aborting benchmark..." << std::endl;
       return;
     }
 
-    if ((mode & BENCHMARK_WRITE) == BENCHMARK_WRITE) {
-      std::ofstream lw(output_path + "_write_latency.txt");
-      std::ofstream tw(output_path + "_write_throughput.txt");
+    if ((mode & BENCHMARK_PRELOAD) == BENCHMARK_PRELOAD) {
+      preload(s_ifs, payloads, output_path + "_preload", num_ops, preload_opts, start_ns, max_ns);
+    } else if ((mode & BENCHMARK_READ) == BENCHMARK_READ && (mode & BENCHMARK_WRITE) == 0) {
+      check_dataset(*s_ifs.front(), num_ops, values.max_value_size());
+    }
 
-      if (warm_up) {
-        std::cerr << "Warm-up writes..." << std::endl;
-        for (size_t i = 0; i < warm_up_ops && benchmark_utils::time_bound(start_us, max_us); i++) {
+    if ((mode & BENCHMARK_WRITE) == BENCHMARK_WRITE && batch_size > 1) {
+      sync_ops(s_ifs, key_gens, payloads, output_path + "_write", "batched writes", num_ops, batch_size,
+               record_buffer::OP_WRITE, warm_up, start_ns, max_ns, limiter,
+               [](const std::shared_ptr<storage_interface> &s_if, const std::shared_ptr<K> &key_gen,
+                  payload &values, op_buffers &buf) -> size_t {
+                 buf.keys.resize(buf.batch);
+                 buf.values.resize(buf.batch);
+                 size_t size = 0;
+                 for (size_t i = 0; i < buf.batch; ++i) {
+                   buf.values[i] = values.next();
+                   key_gen->next(buf.keys[i]);
+                   size += buf.values[i].size;
+                 }
+                 s_if->multi_write(buf.keys, buf.values);
+                 return size;
+               });
+    } else if ((mode & BENCHMARK_WRITE) == BENCHMARK_WRITE) {
+      sync_ops(s_ifs, key_gens, payloads, output_path + "_write", "writes", num_ops, 1, record_buffer::OP_WRITE,
+               warm_up, start_ns, max_ns, limiter,
+               [](const std::shared_ptr<storage_interface> &s_if, const std::shared_ptr<K> &key_gen, payload &values,
+                  op_buffers &buf) -> size_t {
+                 auto value = values.next();
+                 key_gen->next(buf.key);
+                 s_if->write_slice(buf.key, value.data, value.size);
+                 return value.size;
+               });
+    }
+
+    for (auto &key_gen: key_gens)
+      key_gen->reset();
+
+    if ((mode & BENCHMARK_READ) == BENCHMARK_READ && batch_size > 1) {
+      sync_ops(s_ifs, key_gens, payloads, output_path + "_read", "batched reads", num_ops, batch_size,
+               record_buffer::OP_READ, warm_up, start_ns, max_ns, limiter,
+               [](const std::shared_ptr<storage_interface> &s_if, const std::shared_ptr<K> &key_gen,
+                  payload &, op_buffers &buf) -> size_t {
+                 buf.keys.resize(buf.batch);
+                 for (auto &key: buf.keys)
+                   key_gen->next(key);
+                 s_if->multi_read(buf.keys, buf.results);
+                 size_t size = 0;
+                 for (const auto &value: buf.results)
+                   size += value.size();
+                 return size;
+               });
+    } else if ((mode & BENCHMARK_READ) == BENCHMARK_READ) {
+      sync_ops(s_ifs, key_gens, payloads, output_path + "_read", "reads", num_ops, 1, record_buffer::OP_READ,
+               warm_up, start_ns, max_ns, limiter,
+               [](const std::shared_ptr<storage_interface> &s_if, const std::shared_ptr<K> &key_gen, payload &,
+                  op_buffers &buf) -> size_t {
+                 key_gen->next(buf.key);
+                 return s_if->read(buf.key).size();
+               });
+    }
+
+    if ((mode & BENCHMARK_DESTROY) == BENCHMARK_DESTROY) {
+      s_ifs.front()->destroy();
+      std::cerr << "Destroyed storage interface." << std::endl;
+    }
+  }
+
+  // Writes keys [0, num_keys) as fast as the store takes them: every worker claims chunk_size keys at a time and
+  // writes them batch_size keys per multi_write, so backends with native batching use it. The keys below the first
+  // unfinished chunk are saved as a checkpoint every checkpoint interval, and when the timeout stops the load, so a
+  // later run with the same value size resumes from there. A store whose manifest already covers num_keys keys of
+  // this value size is not loaded again.
+  static void preload(const std::vector<std::shared_ptr<storage_interface>> &s_ifs,
+                      const std::vector<std::shared_ptr<payload>> &payloads,
+                      const std::string &output_path,
+                      size_t num_keys,
+                      const preload_options &options,
+                      uint64_t start_ns,
+                      uint64_t max_ns) {
+    auto &store = *s_ifs.front();
+    auto value_size = payloads.front()->max_value_size();
+    dataset_manifest manifest{};
+    if (read_manifest(store, MANIFEST_KEY, manifest) && manifest.num_keys >= num_keys
+        && manifest.value_size == value_size) {
+      std::cerr << "Dataset of " << manifest.num_keys << " keys is already loaded, skipping preload." << std::endl;
+      return;
+    }
+    size_t chunk_size = options.chunk_size;
+    size_t n_chunks = (num_keys + chunk_size - 1) / chunk_size;
+    dataset_manifest checkpoint{};
+    size_t first_chunk = 0;
+    if (read_manifest(store, CHECKPOINT_KEY, checkpoint) && checkpoint.value_size == value_size)
+      first_chunk = std::min(checkpoint.num_keys / chunk_size, n_chunks);
+    if (first_chunk > 0)
+      std::cerr << "Resuming preload from key " << first_chunk * chunk_size << "..." << std::endl;
+
+    size_t n_workers = s_ifs.size();
+    latency_log log(MEASURE_INTERVAL_NS);
+    std::vector<record_buffer> records(n_workers);
+    std::vector<size_t> written(n_workers, 0);
+    std::vector<size_t> bytes(n_workers, 0);
+    std::atomic<size_t> next_chunk(first_chunk);
+    // Chunks finish out of order; the checkpoint only covers the finished prefix
+    std::mutex progress_mutex;
+    std::vector<bool> chunk_done(n_chunks, false);
+    size_t done_prefix = first_chunk;
+    uint64_t last_checkpoint_ns = hr_clock::now_ns();
+    auto save_checkpoint = [&](storage_interface &s_if) {
+      try {
+        write_manifest(s_if, CHECKPOINT_KEY, {std::min(done_prefix * chunk_size, num_keys), value_size});
+      } catch (std::runtime_error &e) {
+        std::cerr << "WARN Could not save preload checkpoint: " << e.what() << std::endl;
+      }
+    };
+
+    auto worker = [&](size_t t) {
+      const auto &s_if = s_ifs[t];
+      auto &values = *payloads[t];
+      int err_count = 0;
+      char buf[key_generator::MAX_KEY_LENGTH];
+      std::vector<std::string> keys;
+      std::vector<storage_interface::value_slice> slices;
+      latency_log::recorder recorder(log);
+      records[t] = record_buffer((n_chunks - first_chunk) * chunk_size / options.batch_size / n_workers + 1);
+
+      auto t_e = hr_clock::now_ns();
+      size_t chunk;
+      while (benchmark_utils::time_bound(start_ns, max_ns, t_e) && (chunk = next_chunk++) < n_chunks) {
+        auto chunk_end = std::min((chunk + 1) * chunk_size, num_keys);
+        auto key = chunk * chunk_size;
+        while (key < chunk_end && benchmark_utils::time_bound(start_ns, max_ns, t_e)) {
+          auto n = std::min(options.batch_size, chunk_end - key);
+          keys.resize(n);
+          slices.resize(n);
+          size_t size = 0;
+          for (size_t i = 0; i < n; ++i) {
+            keys[i].assign(buf, key_generator::format(key + i, buf));
+            slices[i] = values.next();
+            size += slices[i].size;
+          }
+          auto t_b = hr_clock::now_ns();
+          auto status = record_buffer::STATUS_OK;
           try {
-            s_if->write(key_gen->next(), value);
+            if (n == 1)
+              s_if->write_slice(keys[0], slices[0].data, slices[0].size);
+            else
+              s_if->multi_write(keys, slices);
           } catch (std::runtime_error &e) {
-            --i;
+            // The batch is written again
+            status = record_buffer::STATUS_ERROR;
             ++err_count;
             if (err_count > ERROR_MAX) {
               std::cerr << "Too many errors" << std::endl;
@@ -74,51 +303,154 @@ class benchmark {
               exit(1);
             }
           }
+          t_e = hr_clock::now_ns();
+          auto latency = hr_clock::elapsed_ns(t_b, t_e);
+          recorder.record(t_e, latency);
+          records[t].record(t_e, latency, record_buffer::OP_WRITE, status, size);
+          if (status == record_buffer::STATUS_OK) {
+            key += n;
+            written[t] += n;
+            bytes[t] += size;
+          }
         }
-      }
+        // A chunk cut short by the timeout is loaded again in full when the load resumes
+        if (key < chunk_end)
+          break;
 
-      std::cerr << "Starting writes..." << std::endl;
-      auto w_begin = benchmark_utils::now_us();
-      size_t i;
-      for (i = 0; i < num_ops && benchmark_utils::time_bound(start_us, max_us); ++i) {
-        auto t_b = benchmark_utils::now_us();
-        try {
-          s_if->write(key_gen->next(), value);
-        } catch (std::runtime_error &e) {
-          --i;
-          ++err_count;
-          if (err_count > ERROR_MAX) {
-            std::cerr << "Too many errors" << std::endl;
-            std::cerr << "Last error: " << e.what() << std::endl;
-            s_if->destroy();
-            std::cerr << "Destroyed storage interface." << std::endl;
-            exit(1);
-          }
+        std::lock_guard<std::mutex> lock(progress_mutex);
+        chunk_done[chunk] = true;
+        while (done_prefix < n_chunks && chunk_done[done_prefix])
+          ++done_prefix;
+        if (t_e - last_checkpoint_ns >= options.checkpoint_interval_ns) {
+          save_checkpoint(*s_if);
+          last_checkpoint_ns = t_e;
         }
-        auto t_e = benchmark_utils::now_us();
-        lw << t_e << "\t" << (t_e - t_b) << std::endl;
       }
-      auto w_end = benchmark_utils::now_us();
-      auto w_elapsed_s = static_cast<double>(w_end - w_begin) / 1000000.0;
-      std::cerr << "Finished writes." << std::endl;
+      recorder.flush();
+    };
 
-      tw << (static_cast<double>(i) / w_elapsed_s) << std::endl;
-      lw.close();
-      tw.close();
+    std::cerr << "Starting preload of " << num_keys << " keys..." << std::endl;
+    auto begin_ns = hr_clock::now_ns();
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < n_workers; ++t) {
+      workers.emplace_back(worker, t);
+    }
+    worker(0);
+    for (auto &w: workers) {
+      w.join();
     }
+    auto elapsed_s = static_cast<double>(hr_clock::now_ns() - begin_ns) / 1e9;
 
-    key_gen->reset();
+    save_checkpoint(store);
+    if (done_prefix == n_chunks) {
+      write_manifest(store, MANIFEST_KEY, {num_keys, value_size});
+      std::cerr << "Finished preload." << std::endl;
+    } else {
+      std::cerr << "WARN Preload stopped after key " << done_prefix * chunk_size << " of " << num_keys
+                << "; run it again to resume" << std::endl;
+    }
 
-    if ((mode & BENCHMARK_READ) == BENCHMARK_READ) {
-      std::ofstream lr(output_path + "_read_latency.txt");
-      std::ofstream tr(output_path + "_read_throughput.txt");
+    size_t total_keys = 0;
+    size_t total_bytes = 0;
+    for (size_t t = 0; t < n_workers; ++t) {
+      total_keys += written[t];
+      total_bytes += bytes[t];
+    }
+    log.write(output_path);
+    record_buffer::write(output_path + "_ops.bin", records);
+    print_latency_summary("preload", log);
+    std::cerr << "Preload throughput: " << static_cast<double>(total_keys) / elapsed_s << " keys/s, "
+              << static_cast<double>(total_bytes) / elapsed_s / (1024 * 1024) << " MiB/s" << std::endl;
+
+    // Keys loaded by this run, then keys/s and MiB/s
+    std::ofstream tp(output_path + "_throughput.txt");
+    tp << total_keys << "\t" << (static_cast<double>(total_keys) / elapsed_s) << "\t"
+       << (static_cast<double>(total_bytes) / elapsed_s / (1024 * 1024)) << std::endl;
+    tp.close();
+  }
+
+  // Warns when the manifest shows that reads of keys [0, num_keys) will miss
+  static void check_dataset(storage_interface &s_if, size_t num_keys, size_t value_size) {
+    dataset_manifest manifest{};
+    if (!read_manifest(s_if, MANIFEST_KEY, manifest)) {
+      std::cerr << "WARN No dataset manifest in the store; run with preload first to load the keys" << std::endl;
+    } else if (manifest.num_keys < num_keys) {
+      std::cerr << "WARN The store holds only " << manifest.num_keys << " of the " << num_keys << " keys read"
+                << std::endl;
+    } else if (manifest.value_size != value_size) {
+      std::cerr << "WARN The store holds values of up to " << manifest.value_size << " bytes rather than "
+                << value_size << std::endl;
+    }
+  }
+
+  // Manifests are stored as "num_keys=<n> value_size=<bytes>"; returns false if key is missing or unreadable
+  static bool read_manifest(storage_interface &s_if, const std::string &key, dataset_manifest &manifest) {
+    std::string value;
+    try {
+      value = s_if.read(key);
+    } catch (std::runtime_error &) {
+      return false;
+    }
+    unsigned long long num_keys, value_size;
+    if (sscanf(value.c_str(), "num_keys=%llu value_size=%llu", &num_keys, &value_size) != 2)
+      return false;
+    manifest.num_keys = num_keys;
+    manifest.value_size = value_size;
+    return true;
+  }
+
+  static void write_manifest(storage_interface &s_if, const std::string &key, const dataset_manifest &manifest) {
+    s_if.write(key, "num_keys=" + std::to_string(manifest.num_keys) + " value_size="
+        + std::to_string(manifest.value_size));
+  }
+
+  // Runs closed-loop operations over num_keys keys, batch_size keys per op, split across one worker per storage
+  // interface; each worker's last op covers whatever is left of its share of the keys. Workers finish their
+  // warm-up, start the measured phase together behind a barrier, and record into a shared latency log. Each op
+  // is passed its worker's op_buffers and returns the number of value bytes it wrote or read. With a limiter,
+  // each measured op waits for one permit per key and its latency is measured from its intended start.
+  template<typename K, typename F>
+  static void sync_ops(const std::vector<std::shared_ptr<storage_interface>> &s_ifs,
+                       const std::vector<std::shared_ptr<K>> &key_gens,
+                       const std::vector<std::shared_ptr<payload>> &payloads,
+                       const std::string &output_path,
+                       const std::string &op_name,
+                       size_t num_keys,
+                       size_t batch_size,
+                       record_buffer::op_type op_type,
+                       bool warm_up,
+                       uint64_t start_ns,
+                       uint64_t max_ns,
+                       const std::shared_ptr<rate_limiter> &limiter,
+                       F op) {
+    size_t n_workers = s_ifs.size();
+    latency_log log(MEASURE_INTERVAL_NS);
+    std::vector<record_buffer> records(n_workers);
+    std::vector<size_t> completed(n_workers, 0);
+    std::vector<uint64_t> begin_ns(n_workers, 0);
+    std::vector<uint64_t> end_ns(n_workers, 0);
+    barrier start_barrier(n_workers);
+
+    auto worker = [&](size_t t) {
+      const auto &s_if = s_ifs[t];
+      const auto &key_gen = key_gens[t];
+      auto &values = *payloads[t];
+      size_t worker_keys = benchmark_utils::partition_begin(num_keys, n_workers, t + 1)
+          - benchmark_utils::partition_begin(num_keys, n_workers, t);
+      size_t worker_ops = (worker_keys + batch_size - 1) / batch_size;
+      size_t warm_up_ops = worker_ops / 10;
+      int err_count = 0;
+      op_buffers buf;
+      buf.batch = batch_size;
+      latency_log::recorder recorder(log);
+      records[t] = record_buffer(worker_ops);
 
       if (warm_up) {
-        std::cerr << "Warm-up reads..." << std::endl;
-        err_count = 0;
-        for (size_t i = 0; i < warm_up_ops && benchmark_utils::time_bound(start_us, max_us); i++) {
+        if (t == 0)
+          std::cerr << "Warm-up " << op_name << "..." << std::endl;
+        for (size_t i = 0; i < warm_up_ops && benchmark_utils::time_bound(start_ns, max_ns, hr_clock::now_ns()); i++) {
           try {
-            s_if->read(key_gen->next());
+            op(s_if, key_gen, values, buf);
           } catch (std::runtime_error &e) {
             --i;
             ++err_count;
@@ -133,14 +465,21 @@ class benchmark {
         }
       }
 
-      std::cerr << "Starting reads..." << std::endl;
-      auto r_begin = benchmark_utils::now_us();
+      start_barrier.wait();
+      if (t == 0)
+        std::cerr << "Starting " << op_name << "..." << std::endl;
+      // The timeout is checked against the end of the previous op, so it costs no extra clock reads
+      auto t_e = begin_ns[t] = hr_clock::now_ns();
       size_t i;
-      for (i = 0; i < num_ops && benchmark_utils::time_bound(start_us, max_us); ++i) {
-        auto t_b = benchmark_utils::now_us();
+      for (i = 0; i < worker_ops && benchmark_utils::time_bound(start_ns, max_ns, t_e); ++i) {
+        buf.batch = std::min(batch_size, worker_keys - i * batch_size);
+        auto t_b = limiter != nullptr ? limiter->acquire_slot(buf.batch) : hr_clock::now_ns();
+        auto status = record_buffer::STATUS_OK;
+        size_t value_size = 0;
         try {
-          s_if->read(key_gen->next());
+          value_size = op(s_if, key_gen, values, buf);
         } catch (std::runtime_error &e) {
+          status = record_buffer::STATUS_ERROR;
           --i;
           ++err_count;
           if (err_count > ERROR_MAX) {
@@ -151,24 +490,589 @@ class benchmark {
             exit(1);
           }
         }
-        auto t_e = benchmark_utils::now_us();
-        lr << t_e << "\t" << (t_e - t_b) << std::endl;
+        t_e = hr_clock::now_ns();
+        auto latency = hr_clock::elapsed_ns(t_b, t_e);
+        recorder.record(t_e, latency);
+        records[t].record(t_e, latency, op_type, status, value_size);
       }
-      auto r_end = benchmark_utils::now_us();
-      auto r_elapsed_s = static_cast<double>(r_end - r_begin) / 1000000.0;
-      std::cerr << "Finished reads." << std::endl;
+      end_ns[t] = t_e;
+      completed[t] = i;
+      recorder.flush();
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < n_workers; ++t) {
+      workers.emplace_back(worker, t);
+    }
+    worker(0);
+    for (auto &w: workers) {
+      w.join();
+    }
+    std::cerr << "Finished " << op_name << "." << std::endl;
+
+    size_t total_ops = 0;
+    for (size_t t = 0; t < n_workers; ++t) {
+      total_ops += completed[t];
+    }
+    auto elapsed_s = static_cast<double>(*std::max_element(end_ns.begin(), end_ns.end())
+                                             - *std::min_element(begin_ns.begin(), begin_ns.end())) / 1e9;
+
+    log.write(output_path);
+    record_buffer::write(output_path + "_ops.bin", records);
+    print_latency_summary(op_name, log);
 
-      tr << (static_cast<double>(i) / r_elapsed_s) << std::endl;
-      lr.close();
-      tr.close();
+    std::ofstream tp(output_path + "_throughput.txt");
+    tp << (static_cast<double>(total_ops) / elapsed_s) << std::endl;
+    tp.close();
+  }
+
+  static void print_latency_summary(const std::string &op_name, const latency_log &log) {
+    std::cerr << "Latency summary for " << op_name << " (count, p50, p90, p99, p99.9, max in ns): ";
+    log.total().write_summary(std::cerr);
+    std::cerr << std::endl;
+  }
+
+  static void run_workload(const std::vector<std::shared_ptr<storage_interface>> &s_ifs,
+                           const storage_interface::property_map &conf,
+                           workload &wl,
+                           const std::string &output_path,
+                           const payload &values,
+                           size_t num_ops,
+                           bool warm_up,
+                           bool precompute_keys,
+                           int32_t mode,
+                           uint64_t max_ns,
+                           const std::string &control_host,
+                           int control_port,
+                           const std::string &id) {
+    std::vector<std::shared_ptr<payload>> payloads;
+    for (size_t t = 0; t < s_ifs.size(); ++t)
+      payloads.push_back(std::make_shared<payload>(values));
+
+    auto start_ns = hr_clock::now_ns();
+
+    std::cerr << "Initializing storage interface..." << std::endl;
+    for (size_t t = 0; t < s_ifs.size(); ++t) {
+      s_ifs[t]->init(conf, t == 0 && (mode & BENCHMARK_CREATE) == BENCHMARK_CREATE);
+    }
+
+    if (!benchmark_utils::signal(control_host, control_port, id)) {
+      std::cerr << "Aborting benchmark..." << std::endl;
+      return;
+    }
+
+    if ((mode & BENCHMARK_WRITE) == BENCHMARK_WRITE) {
+      // Load the initial record_count keys, each worker writing its own slice
+      std::vector<std::shared_ptr<sequential_key_generator>> key_gens;
+      for (size_t t = 0; t < s_ifs.size(); ++t) {
+        auto first_key = benchmark_utils::partition_begin(wl.record_count(), s_ifs.size(), t);
+        key_gens.push_back(std::make_shared<sequential_key_generator>(first_key));
+      }
+      sync_ops(s_ifs, key_gens, payloads, output_path + "_load", "loads", wl.record_count(), 1,
+               record_buffer::OP_WRITE, false, start_ns, max_ns, nullptr,
+               [](const std::shared_ptr<storage_interface> &s_if,
+                  const std::shared_ptr<sequential_key_generator> &key_gen, payload &values,
+                  op_buffers &buf) -> size_t {
+                 auto value = values.next();
+                 key_gen->next(buf.key);
+                 s_if->write_slice(buf.key, value.data, value.size);
+                 return value.size;
+               });
     }
 
+    wl.print(std::cerr);
+    std::cerr << std::endl;
+    barrier start_barrier(s_ifs.size());
+    workload_ops(s_ifs, wl, output_path + "_workload", payloads, num_ops, warm_up, precompute_keys, start_ns, max_ns,
+                 start_barrier, nullptr, 0, "");
+
     if ((mode & BENCHMARK_DESTROY) == BENCHMARK_DESTROY) {
-      s_if->destroy();
+      s_ifs.front()->destroy();
+      std::cerr << "Destroyed storage interface." << std::endl;
+    }
+  }
+
+  // Runs every tenant's workload at the same time, each on its own workers (s_ifs holds all tenants' workers in
+  // order), so that their latencies show how much they interfere. Results of tenant x go to output_path_x.
+  static void run_tenants(const std::vector<std::shared_ptr<storage_interface>> &s_ifs,
+                          const storage_interface::property_map &conf,
+                          const std::vector<tenant> &tenants,
+                          const std::string &output_path,
+                          bool warm_up,
+                          bool precompute_keys,
+                          int32_t mode,
+                          uint64_t max_ns,
+                          const std::string &control_host,
+                          int control_port,
+                          const std::string &id) {
+    std::vector<std::shared_ptr<payload>> payloads;
+    size_t record_count = 0;
+    for (const auto &t: tenants) {
+      for (size_t w = 0; w < t.num_workers; ++w)
+        payloads.push_back(std::make_shared<payload>(*t.values));
+      record_count = std::max(record_count, t.wl->record_count());
+    }
+
+    auto start_ns = hr_clock::now_ns();
+
+    std::cerr << "Initializing storage interface..." << std::endl;
+    for (size_t t = 0; t < s_ifs.size(); ++t) {
+      s_ifs[t]->init(conf, t == 0 && (mode & BENCHMARK_CREATE) == BENCHMARK_CREATE);
+    }
+
+    if (!benchmark_utils::signal(control_host, control_port, id)) {
+      std::cerr << "Aborting benchmark..." << std::endl;
+      return;
+    }
+
+    if ((mode & BENCHMARK_WRITE) == BENCHMARK_WRITE) {
+      // Tenants share one key space, so the keys of the largest tenant are loaded once, by all workers
+      std::vector<std::shared_ptr<sequential_key_generator>> key_gens;
+      for (size_t t = 0; t < s_ifs.size(); ++t) {
+        auto first_key = benchmark_utils::partition_begin(record_count, s_ifs.size(), t);
+        key_gens.push_back(std::make_shared<sequential_key_generator>(first_key));
+      }
+      sync_ops(s_ifs, key_gens, payloads, output_path + "_load", "loads", record_count, 1, record_buffer::OP_WRITE,
+               false, start_ns, max_ns, nullptr,
+               [](const std::shared_ptr<storage_interface> &s_if,
+                  const std::shared_ptr<sequential_key_generator> &key_gen, payload &values,
+                  op_buffers &buf) -> size_t {
+                 auto value = values.next();
+                 key_gen->next(buf.key);
+                 s_if->write_slice(buf.key, value.data, value.size);
+                 return value.size;
+               });
+    }
+
+    barrier start_barrier(s_ifs.size());
+    std::vector<std::thread> runners;
+    auto first_worker = s_ifs.begin();
+    auto first_payload = payloads.begin();
+    for (const auto &t: tenants) {
+      std::vector<std::shared_ptr<storage_interface>> t_ifs(first_worker, first_worker + t.num_workers);
+      std::vector<std::shared_ptr<payload>> t_payloads(first_payload, first_payload + t.num_workers);
+      first_worker += t.num_workers;
+      first_payload += t.num_workers;
+      runners.emplace_back([=, &t, &start_barrier] {
+        workload_ops(t_ifs, *t.wl, output_path + "_" + t.name, t_payloads, t.num_ops, warm_up, precompute_keys,
+                     start_ns, max_ns, start_barrier, t.limiter, t.thread_rate, t.name);
+      });
+    }
+    for (auto &r: runners) {
+      r.join();
+    }
+
+    if ((mode & BENCHMARK_DESTROY) == BENCHMARK_DESTROY) {
+      s_ifs.front()->destroy();
       std::cerr << "Destroyed storage interface." << std::endl;
     }
   }
 
+  // Replays the first num_ops records of a trace, each on the worker that owns its key (key modulo the number of
+  // workers), so that every key sees its ops in trace order. With timed, records are issued at their offsets in
+  // the trace divided by speedup and latency is measured from then; otherwise workers issue their records back
+  // to back. With BENCHMARK_WRITE, keys that the trace reads before it writes them are loaded first.
+  static void run_replay(const std::vector<std::shared_ptr<storage_interface>> &s_ifs,
+                         const storage_interface::property_map &conf,
+                         const trace_file &trace,
+                         const std::string &output_path,
+                         const payload &values,
+                         size_t num_ops,
+                         bool timed,
+                         double speedup,
+                         int32_t mode,
+                         uint64_t max_ns,
+                         const std::string &control_host,
+                         int control_port,
+                         const std::string &id) {
+    static const record_buffer::op_type RECORD_OPS[] = {record_buffer::OP_READ, record_buffer::OP_WRITE};
+    static const char *OP_NAMES[] = {"read", "write"};
+    size_t n_workers = s_ifs.size();
+    size_t n_records = std::min(num_ops, trace.size());
+    std::vector<std::shared_ptr<payload>> payloads;
+    for (size_t t = 0; t < n_workers; ++t)
+      payloads.push_back(std::make_shared<payload>(values));
+
+    auto start_ns = hr_clock::now_ns();
+
+    std::cerr << "Initializing storage interface..." << std::endl;
+    for (size_t t = 0; t < n_workers; ++t) {
+      s_ifs[t]->init(conf, t == 0 && (mode & BENCHMARK_CREATE) == BENCHMARK_CREATE);
+    }
+
+    if (!benchmark_utils::signal(control_host, control_port, id)) {
+      std::cerr << "Aborting benchmark..." << std::endl;
+      return;
+    }
+
+    // One pass splits the trace by owning worker and resolves each record's offset from the start, so that no
+    // worker walks the records of the others
+    struct replay_op {
+      const trace_record *record;
+      uint64_t offset_us;
+    };
+    std::vector<std::vector<replay_op>> worker_ops(n_workers);
+    for (auto &ops: worker_ops)
+      ops.reserve(n_records / n_workers + 1);
+    uint64_t trace_offset_us = 0;
+    for (auto r = trace.begin(); r != trace.begin() + n_records; ++r) {
+      trace_offset_us += r->delta_us;
+      worker_ops[r->key % n_workers].push_back(replay_op{r, trace_offset_us});
+    }
+
+    std::vector<std::unique_ptr<latency_log>> logs;
+    logs.emplace_back(new latency_log(MEASURE_INTERVAL_NS));
+    logs.emplace_back(new latency_log(MEASURE_INTERVAL_NS));
+    std::vector<record_buffer> records(n_workers);
+    std::vector<std::vector<size_t>> completed(n_workers, std::vector<size_t>(2, 0));
+    std::vector<uint64_t> max_lag_ns(n_workers, 0);
+    std::vector<uint64_t> begin_ns(n_workers, 0);
+    std::vector<uint64_t> end_ns(n_workers, 0);
+    barrier start_barrier(n_workers);
+    uint64_t replay_ns = 0;
+
+    auto worker = [&](size_t t) {
+      const auto &s_if = s_ifs[t];
+      auto &values = *payloads[t];
+      const auto &ops = worker_ops[t];
+      int err_count = 0;
+      char buf[key_generator::MAX_KEY_LENGTH];
+      std::string key;
+      std::vector<std::unique_ptr<latency_log::recorder>> recorders;
+      for (const auto &log: logs) {
+        recorders.emplace_back(new latency_log::recorder(*log));
+      }
+      records[t] = record_buffer(ops.size());
+
+      auto on_error = [&](const std::string &error) {
+        ++err_count;
+        if (err_count > ERROR_MAX) {
+          std::cerr << "Too many errors" << std::endl;
+          std::cerr << "Last error: " << error << std::endl;
+          s_if->destroy();
+          std::cerr << "Destroyed storage interface." << std::endl;
+          exit(1);
+        }
+      };
+
+      if ((mode & BENCHMARK_WRITE) == BENCHMARK_WRITE) {
+        if (t == 0)
+          std::cerr << "Loading keys read before they are written..." << std::endl;
+        // Only the first op on each key decides whether it needs loading
+        std::unordered_set<uint64_t> seen;
+        for (const auto &o: ops) {
+          auto r = o.record;
+          if (!seen.insert(r->key).second || r->op() != trace_record::READ)
+            continue;
+          key.assign(buf, key_generator::format(r->key, buf));
+          auto value = values.next(std::max<size_t>(r->value_size(), 1));
+          try {
+            s_if->write_slice(key, value.data, value.size);
+          } catch (std::runtime_error &e) {
+            on_error(e.what());
+          }
+        }
+      }
+
+      start_barrier.wait();
+      if (t == 0) {
+        std::cerr << "Starting replay..." << std::endl;
+        replay_ns = hr_clock::now_ns();
+      }
+      start_barrier.wait();
+      begin_ns[t] = hr_clock::now_ns();
+      auto t_e = begin_ns[t];
+      for (const auto &o: ops) {
+        auto r = o.record;
+        if (!benchmark_utils::time_bound(start_ns, max_ns, t_e))
+          break;
+        key.assign(buf, key_generator::format(r->key, buf));
+        auto op = r->op();
+        uint64_t t_b;
+        if (timed) {
+          t_b = replay_ns + static_cast<uint64_t>(o.offset_us * 1000.0 / speedup);
+          rate_limiter::wait_until(t_b);
+          max_lag_ns[t] = std::max(max_lag_ns[t], hr_clock::now_ns() - t_b);
+        } else {
+          t_b = hr_clock::now_ns();
+        }
+        auto status = record_buffer::STATUS_OK;
+        size_t value_size = 0;
+        try {
+          if (op == trace_record::READ) {
+            value_size = s_if->read(key).size();
+          } else {
+            auto value = values.next(std::max<size_t>(r->value_size(), 1));
+            s_if->write_slice(key, value.data, value.size);
+            value_size = value.size;
+          }
+          ++completed[t][op];
+        } catch (std::runtime_error &e) {
+          status = record_buffer::STATUS_ERROR;
+          on_error(e.what());
+        }
+        t_e = hr_clock::now_ns();
+        auto latency = hr_clock::elapsed_ns(t_b, t_e);
+        recorders[op]->record(t_e, latency);
+        records[t].record(t_e, latency, RECORD_OPS[op], status, value_size);
+      }
+      end_ns[t] = t_e;
+      for (auto &recorder: recorders)
+        recorder->flush();
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < n_workers; ++t) {
+      workers.emplace_back(worker, t);
+    }
+    worker(0);
+    for (auto &w: workers) {
+      w.join();
+    }
+    std::cerr << "Finished replay." << std::endl;
+    if (timed)
+      std::cerr << "Maximum lag behind the trace: " << *std::max_element(max_lag_ns.begin(), max_lag_ns.end())
+                << " ns" << std::endl;
+
+    auto elapsed_s = static_cast<double>(*std::max_element(end_ns.begin(), end_ns.end())
+                                             - *std::min_element(begin_ns.begin(), begin_ns.end())) / 1e9;
+
+    // One line per op type, followed by the total: op, completed ops, throughput (ops/s)
+    std::ofstream tp(output_path + "_replay_throughput.txt");
+    size_t total_ops = 0;
+    for (int op = 0; op < 2; ++op) {
+      size_t op_count = 0;
+      for (size_t t = 0; t < n_workers; ++t) {
+        op_count += completed[t][op];
+      }
+      total_ops += op_count;
+      std::string name = OP_NAMES[op];
+      logs[op]->write(output_path + "_replay_" + name);
+      print_latency_summary(name + "s", *logs[op]);
+      tp << name << "\t" << op_count << "\t" << (static_cast<double>(op_count) / elapsed_s) << "\n";
+    }
+    tp << "total\t" << total_ops << "\t" << (static_cast<double>(total_ops) / elapsed_s) << std::endl;
+    tp.close();
+
+    record_buffer::write(output_path + "_replay_ops.bin", records);
+
+    if ((mode & BENCHMARK_DESTROY) == BENCHMARK_DESTROY) {
+      s_ifs.front()->destroy();
+      std::cerr << "Destroyed storage interface." << std::endl;
+    }
+  }
+
+  // Runs num_ops closed-loop operations drawn from the workload's op mix, split across one worker per storage
+  // interface, and reports latency per op type. Workers wait on start_barrier after their warm-up, so other
+  // workers sharing it start together with them. With a limiter, the workers share its rate and latency is
+  // measured from each op's slot; with a thread_rate, each worker is also held to that rate on its own. A
+  // non-empty tenant names the workers in messages and summaries.
+  static void workload_ops(const std::vector<std::shared_ptr<storage_interface>> &s_ifs,
+                           workload &wl,
+                           const std::string &output_path,
+                           const std::vector<std::shared_ptr<payload>> &payloads,
+                           size_t num_ops,
+                           bool warm_up,
+                           bool precompute_keys,
+                           uint64_t start_ns,
+                           uint64_t max_ns,
+                           barrier &start_barrier,
+                           const std::shared_ptr<rate_limiter> &limiter,
+                           double thread_rate,
+                           const std::string &tenant) {
+    static const record_buffer::op_type RECORD_OPS[] = {record_buffer::OP_READ, record_buffer::OP_UPDATE,
+                                                         record_buffer::OP_INSERT,
+                                                         record_buffer::OP_READ_MODIFY_WRITE,
+                                                         record_buffer::OP_SCAN};
+    size_t n_workers = s_ifs.size();
+    std::vector<std::unique_ptr<latency_log>> logs;
+    for (int op = 0; op < workload::NUM_OP_TYPES; ++op) {
+      logs.emplace_back(new latency_log(MEASURE_INTERVAL_NS));
+    }
+    std::vector<record_buffer> records(n_workers);
+    std::vector<std::vector<size_t>> completed(n_workers, std::vector<size_t>(workload::NUM_OP_TYPES, 0));
+    std::vector<uint64_t> begin_ns(n_workers, 0);
+    std::vector<uint64_t> end_ns(n_workers, 0);
+    std::vector<workload::generator> gens;
+    for (size_t t = 0; t < n_workers; ++t) {
+      size_t precompute_ops = 0;
+      if (precompute_keys) {
+        precompute_ops = benchmark_utils::partition_begin(num_ops, n_workers, t + 1)
+            - benchmark_utils::partition_begin(num_ops, n_workers, t);
+        if (warm_up)
+          precompute_ops += precompute_ops / 10;
+      }
+      gens.push_back(wl.new_generator(t, n_workers, precompute_ops));
+    }
+    std::string label = tenant.empty() ? "workload" : "workload of tenant " + tenant;
+    std::vector<std::shared_ptr<rate_limiter>> limiters(n_workers, limiter);
+    if (thread_rate > 0) {
+      for (auto &l: limiters)
+        l = std::make_shared<rate_limiter>(thread_rate, limiter);
+    }
+
+    auto worker = [&](size_t t) {
+      const auto &s_if = s_ifs[t];
+      auto &gen = gens[t];
+      auto &values = *payloads[t];
+      size_t worker_ops = benchmark_utils::partition_begin(num_ops, n_workers, t + 1)
+          - benchmark_utils::partition_begin(num_ops, n_workers, t);
+      size_t warm_up_ops = worker_ops / 10;
+      int err_count = 0;
+      std::string key;
+      std::vector<std::unique_ptr<latency_log::recorder>> recorders;
+      for (const auto &log: logs) {
+        recorders.emplace_back(new latency_log::recorder(*log));
+      }
+      records[t] = record_buffer(worker_ops);
+
+      auto on_error = [&](std::runtime_error &e) {
+        ++err_count;
+        if (err_count > ERROR_MAX) {
+          std::cerr << "Too many errors" << std::endl;
+          std::cerr << "Last error: " << e.what() << std::endl;
+          s_if->destroy();
+          std::cerr << "Destroyed storage interface." << std::endl;
+          exit(1);
+        }
+      };
+
+      if (warm_up) {
+        if (t == 0)
+          std::cerr << "Warm-up " << label << "..." << std::endl;
+        for (size_t i = 0; i < warm_up_ops && benchmark_utils::time_bound(start_ns, max_ns, hr_clock::now_ns()); i++) {
+          try {
+            if (limiters[t] != nullptr)
+              limiters[t]->acquire_slot();
+            workload_op(s_if, gen, gen.next_op(), values, key);
+          } catch (std::runtime_error &e) {
+            on_error(e);
+          }
+        }
+      }
+
+      start_barrier.wait();
+      if (t == 0)
+        std::cerr << "Starting " << label << "..." << std::endl;
+      auto t_e = begin_ns[t] = hr_clock::now_ns();
+      for (size_t i = 0; i < worker_ops && benchmark_utils::time_bound(start_ns, max_ns, t_e); ++i) {
+        auto op = gen.next_op();
+        auto t_b = limiters[t] != nullptr ? limiters[t]->acquire_slot() : hr_clock::now_ns();
+        auto status = record_buffer::STATUS_OK;
+        size_t value_size = 0;
+        try {
+          value_size = workload_op(s_if, gen, op, values, key);
+          ++completed[t][op];
+        } catch (std::runtime_error &e) {
+          status = record_buffer::STATUS_ERROR;
+          on_error(e);
+        }
+        t_e = hr_clock::now_ns();
+        auto latency = hr_clock::elapsed_ns(t_b, t_e);
+        recorders[op]->record(t_e, latency);
+        records[t].record(t_e, latency, RECORD_OPS[op], status, value_size);
+      }
+      end_ns[t] = t_e;
+      for (auto &recorder: recorders)
+        recorder->flush();
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < n_workers; ++t) {
+      workers.emplace_back(worker, t);
+    }
+    worker(0);
+    for (auto &w: workers) {
+      w.join();
+    }
+    std::cerr << "Finished " << label << "." << std::endl;
+    if (limiter != nullptr) {
+      // Counts the slots of the workers' own limiters too
+      std::cerr << "[" << tenant << "] ";
+      limiter->print_pacing(std::cerr);
+      std::cerr << std::endl;
+    } else if (thread_rate > 0) {
+      for (size_t t = 0; t < n_workers; ++t) {
+        std::cerr << "[" << tenant << " worker " << t << "] ";
+        limiters[t]->print_pacing(std::cerr);
+        std::cerr << std::endl;
+      }
+    }
+
+    auto elapsed_s = static_cast<double>(*std::max_element(end_ns.begin(), end_ns.end())
+                                             - *std::min_element(begin_ns.begin(), begin_ns.end())) / 1e9;
+
+    // One line per op type in the mix, followed by the total: op, completed ops, throughput (ops/s)
+    std::ofstream tp(output_path + "_throughput.txt");
+    size_t total_ops = 0;
+    for (int op = 0; op < workload::NUM_OP_TYPES; ++op) {
+      auto op_type = static_cast<workload::op_type>(op);
+      if (wl.proportion(op_type) == 0)
+        continue;
+      size_t op_count = 0;
+      for (size_t t = 0; t < n_workers; ++t) {
+        op_count += completed[t][op];
+      }
+      total_ops += op_count;
+      std::string name = workload::op_name(op_type);
+      logs[op]->write(output_path + "_" + name);
+      print_latency_summary(tenant.empty() ? name + "s" : name + "s of tenant " + tenant, *logs[op]);
+      tp << name << "\t" << op_count << "\t" << (static_cast<double>(op_count) / elapsed_s) << "\n";
+    }
+    tp << "total\t" << total_ops << "\t" << (static_cast<double>(total_ops) / elapsed_s) << std::endl;
+    tp.close();
+
+    record_buffer::write(output_path + "_ops.bin", records);
+  }
+
+  // Returns the number of value bytes written or read
+  static size_t workload_op(const std::shared_ptr<storage_interface> &s_if,
+                            workload::generator &gen,
+                            workload::op_type op,
+                            payload &values,
+                            std::string &key) {
+    switch (op) {
+      case workload::READ: {
+        gen.next_key(op, key);
+        return s_if->read(key).size();
+      }
+      case workload::UPDATE: {
+        auto value = values.next();
+        gen.next_key(op, key);
+        s_if->write_slice(key, value.data, value.size);
+        return value.size;
+      }
+      case workload::INSERT: {
+        auto value = values.next();
+        gen.next_key(op, key);
+        s_if->write_slice(key, value.data, value.size);
+        gen.inserted();
+        return value.size;
+      }
+      case workload::READ_MODIFY_WRITE: {
+        auto value = values.next();
+        gen.next_key(op, key);
+        auto size = s_if->read(key).size();
+        s_if->write_slice(key, value.data, value.size);
+        return size + value.size;
+      }
+      case workload::SCAN: {
+        // Backends have no range reads, so a scan reads consecutive keys one at a time
+        auto first = gen.next_key_id(op);
+        auto last = std::min<uint64_t>(first + gen.next_scan_length(), gen.num_keys());
+        char buf[key_generator::MAX_KEY_LENGTH];
+        size_t size = 0;
+        for (auto k = first; k < last; ++k) {
+          key.assign(buf, key_generator::format(k, buf));
+          size += s_if->read(key).size();
+        }
+        return size;
+      }
+      default:
+        throw std::invalid_argument("Unknown workload op");
+    }
+  }
+
   static void benchmark_notifications(const std::shared_ptr<notification_interface> &s_if,
                                       const storage_interface::property_map &conf,
                                       const std::string &output_path,
@@ -223,10 +1127,13 @@ class benchmark {
     auto notification_ts = s_if->get_notification_ts();
     auto time_taken = s_if->get_latencies();
     for (size_t i = 0; i < num_listeners; ++i) {
-      std::ofstream out(output_path + "_" + std::to_string(i + 1) + "Of" + std::to_string(num_listeners) + ".txt");
-      for (size_t j = 0; j < time_taken[i].size(); ++j) {
-        out << publish_ts[j] << "\t" << notification_ts[i][j] << "\t" << time_taken[i][j] << "\n";
-      }
+      result_file out;
+      std::vector<uint64_t> published(publish_ts.begin(),
+                                      publish_ts.begin() + static_cast<long>(time_taken[i].size()));
+      out.add_column("publish_us", published);
+      out.add_column("notification_us", notification_ts[i]);
+      out.add_column("latency_us", time_taken[i]);
+      out.write(output_path + "_" + std::to_string(i + 1) + "Of" + std::to_string(num_listeners) + ".bin");
     }
 
     if ((mode & BENCHMARK_DESTROY) == BENCHMARK_DESTROY) {
@@ -235,77 +1142,135 @@ class benchmark {
     }
   }
 
+  // A request in flight in a sliding-window pipeline
+  struct inflight_record {
+    uint64_t issue_ns;
+    size_t value_size;
+  };
+
+  // Keeps up to window requests in flight until num_ops of them have completed, issuing a new request as soon as
+  // any one completes, so the pipeline never drains between rounds. If max_outstanding_bytes is non-zero, no more
+  // requests are issued while that many value bytes are in flight. issue(tag) submits a request tagged tag and
+  // returns the number of value bytes it sends; on_complete(request, completion, end_ns) is called for every
+  // completion, in the order the backend finishes them. Failed requests are replaced, not retried; any still in
+  // flight at the timeout are drained without being reported.
+  template<typename I, typename R>
+  static void pipeline(const std::shared_ptr<storage_interface> &s_if,
+                       size_t num_ops,
+                       size_t window,
+                       size_t max_outstanding_bytes,
+                       uint64_t start_ns,
+                       uint64_t max_ns,
+                       I issue,
+                       R on_complete) {
+    int err_count = 0;
+    auto on_error = [&](const std::string &what) {
+      ++err_count;
+      if (err_count > ERROR_MAX) {
+        std::cerr << "Too many errors" << std::endl;
+        std::cerr << "Last error: " << what << std::endl;
+        s_if->destroy();
+        std::cerr << "Destroyed storage interface." << std::endl;
+        exit(1);
+      }
+    };
+
+    // Requests are tagged with their slot in in_flight
+    std::vector<inflight_record> in_flight(window);
+    std::vector<uint64_t> free_slots;
+    for (size_t slot = window; slot > 0; --slot)
+      free_slots.push_back(slot - 1);
+    size_t outstanding_bytes = 0;
+    size_t completed = 0;
+    auto now = hr_clock::now_ns();
+    while (completed < num_ops && benchmark_utils::time_bound(start_ns, max_ns, now)) {
+      while (!free_slots.empty() && completed + (window - free_slots.size()) < num_ops
+          && (max_outstanding_bytes == 0 || outstanding_bytes < max_outstanding_bytes)) {
+        auto tag = free_slots.back();
+        auto &req = in_flight[tag];
+        try {
+          req.issue_ns = hr_clock::now_ns();
+          req.value_size = issue(tag);
+        } catch (std::runtime_error &e) {
+          on_error(e.what());
+          continue;
+        }
+        free_slots.pop_back();
+        outstanding_bytes += req.value_size;
+      }
+
+      auto c = s_if->wait_completion();
+      now = hr_clock::now_ns();
+      const auto &req = in_flight[c.tag];
+      free_slots.push_back(c.tag);
+      outstanding_bytes -= req.value_size;
+      if (c.ok) {
+        ++completed;
+      } else {
+        on_error(c.error);
+      }
+      on_complete(req, c, now);
+    }
+
+    for (auto outstanding = window - free_slots.size(); outstanding > 0; --outstanding)
+      s_if->wait_completion();
+  }
+
   template<typename K>
   static void async_writes(const std::shared_ptr<storage_interface> &s_if,
                            const std::shared_ptr<K> key_gen,
                            const std::string &output_path,
-                           size_t value_size,
+                           payload &values,
                            size_t num_ops,
                            size_t n_async,
+                           size_t max_outstanding_bytes,
                            bool warm_up,
-                           uint64_t start_us,
-                           uint64_t max_us) {
-    int err_count = 0;
-    size_t warm_up_ops = num_ops / 10;
-    std::string value(value_size, 'x');
-    std::ofstream tw(output_path + "_write.txt");
+                           uint64_t start_ns,
+                           uint64_t max_ns) {
+    std::string key;
+    auto issue = [&](uint64_t tag) -> size_t {
+      auto value = values.next();
+      key_gen->next(key);
+      s_if->submit_write(tag, key, value.data, value.size);
+      return value.size;
+    };
+
     if (warm_up) {
       std::cerr << "Warm-up writes..." << std::endl;
-      for (size_t i = 0; i < warm_up_ops && benchmark_utils::time_bound(start_us, max_us); i += n_async) {
-        try {
-          for (size_t j = 0; j < n_async; ++j)
-            s_if->write_async(key_gen->next(), value);
-          for (size_t j = 0; j < n_async; ++j)
-            s_if->wait_write();
-        } catch (std::runtime_error &e) {
-          --i;
-          ++err_count;
-          if (err_count > ERROR_MAX) {
-            std::cerr << "Too many errors" << std::endl;
-            std::cerr << "Last error: " << e.what() << std::endl;
-            s_if->destroy();
-            std::cerr << "Destroyed storage interface." << std::endl;
-            exit(1);
-          }
-        }
-      }
+      pipeline(s_if, num_ops / 10, n_async, max_outstanding_bytes, start_ns, max_ns, issue,
+               [](const inflight_record &, const storage_interface::completion &, uint64_t) {});
     }
 
     std::cerr << "Starting writes..." << std::endl;
-    auto w_begin = benchmark_utils::now_us();
-    size_t i;
-    auto last_measure_time = w_begin;
+    series_buffer<uint64_t> tw(max_ns / MEASURE_INTERVAL_NS + 2);
+    record_buffer records(num_ops);
+    latency_log log(MEASURE_INTERVAL_NS);
+    latency_log::recorder recorder(log);
+    auto last_measure_time = hr_clock::now_ns();
     size_t writes = 0;
-    tw << w_begin << "\t" << writes << std::endl;
-    for (i = 0; i < num_ops && benchmark_utils::time_bound(start_us, max_us); i += n_async) {
-      try {
-        for (size_t j = 0; j < n_async; ++j)
-          s_if->write_async(key_gen->next(), value);
-        for (size_t j = 0; j < n_async; ++j)
-          s_if->wait_write();
-        writes += n_async;
-      } catch (std::runtime_error &e) {
-        --i;
-        ++err_count;
-        if (err_count > ERROR_MAX) {
-          std::cerr << "Too many errors" << std::endl;
-          std::cerr << "Last error: " << e.what() << std::endl;
-          s_if->destroy();
-          std::cerr << "Destroyed storage interface." << std::endl;
-          exit(1);
-        }
-      }
-      uint64_t cur_time;
-      if ((cur_time = benchmark_utils::now_us()) - last_measure_time >= MEASURE_INTERVAL) {
-        tw << cur_time << "\t" << writes << std::endl;
-        writes = 0;
-        last_measure_time = cur_time;
-      }
-    }
-    uint64_t w_end = benchmark_utils::now_us();
-    tw << w_end << "\t" << writes << std::endl;
-    tw.close();
+    tw.record(last_measure_time, writes);
+    pipeline(s_if, num_ops, n_async, max_outstanding_bytes, start_ns, max_ns, issue,
+             [&](const inflight_record &req, const storage_interface::completion &c, uint64_t t_e) {
+               auto latency = hr_clock::elapsed_ns(req.issue_ns, t_e);
+               records.record(t_e, latency, record_buffer::OP_WRITE,
+                              c.ok ? record_buffer::STATUS_OK : record_buffer::STATUS_ERROR, req.value_size);
+               if (c.ok) {
+                 recorder.record(t_e, latency);
+                 ++writes;
+               }
+               if (t_e - last_measure_time >= MEASURE_INTERVAL_NS) {
+                 tw.record(t_e, writes);
+                 writes = 0;
+                 last_measure_time = t_e;
+               }
+             });
+    tw.record(hr_clock::now_ns(), writes);
+    tw.write(output_path + "_write.bin", "ops");
+    recorder.flush();
+    log.write(output_path + "_write");
+    record_buffer::write(output_path + "_write_ops.bin", {records});
     std::cerr << "Finished writes." << std::endl;
+    print_latency_summary("writes", log);
   }
 
   template<typename K>
@@ -315,89 +1280,81 @@ class benchmark {
                           size_t num_ops,
                           size_t n_async,
                           bool warm_up,
-                          uint64_t start_us,
-                          uint64_t max_us) {
-    int err_count = 0;
-    size_t warm_up_ops = num_ops / 10;
-    std::ofstream tr(output_path + "_read.txt");
+                          uint64_t start_ns,
+                          uint64_t max_ns) {
+    std::string key;
+    auto issue = [&](uint64_t tag) -> size_t {
+      key_gen->next(key);
+      s_if->submit_read(tag, key);
+      return 0;
+    };
+
     if (warm_up) {
       std::cerr << "Warm-up reads..." << std::endl;
-      for (size_t i = 0; i < warm_up_ops && benchmark_utils::time_bound(start_us, max_us); i += n_async) {
-        try {
-          for (size_t j = 0; j < n_async; ++j)
-            s_if->read_async(key_gen->next());
-          for (size_t j = 0; j < n_async; ++j)
-            s_if->wait_read();
-        } catch (std::runtime_error &e) {
-          --i;
-          ++err_count;
-          if (err_count > ERROR_MAX) {
-            std::cerr << "Too many errors" << std::endl;
-            std::cerr << "Last error: " << e.what() << std::endl;
-            s_if->destroy();
-            std::cerr << "Destroyed storage interface." << std::endl;
-            exit(1);
-          }
-        }
-      }
+      pipeline(s_if, num_ops / 10, n_async, 0, start_ns, max_ns, issue,
+               [](const inflight_record &, const storage_interface::completion &, uint64_t) {});
     }
 
     std::cerr << "Starting reads..." << std::endl;
-    auto r_begin = benchmark_utils::now_us();
-    size_t i;
-    auto last_measure_time = r_begin;
+    series_buffer<uint64_t> tr(max_ns / MEASURE_INTERVAL_NS + 2);
+    record_buffer records(num_ops);
+    latency_log log(MEASURE_INTERVAL_NS);
+    latency_log::recorder recorder(log);
+    auto last_measure_time = hr_clock::now_ns();
     size_t reads = 0;
-    tr << r_begin << "\t" << reads << std::endl;
-    for (i = 0; i < num_ops && benchmark_utils::time_bound(start_us, max_us); i += n_async) {
-      try {
-        for (size_t j = 0; j < n_async; ++j)
-          s_if->read_async(key_gen->next());
-        for (size_t j = 0; j < n_async; ++j)
-          s_if->wait_read();
-        reads += n_async;
-      } catch (std::runtime_error &e) {
-        --i;
-        ++err_count;
-        if (err_count > ERROR_MAX) {
-          std::cerr << "Too many errors" << std::endl;
-          std::cerr << "Last error: " << e.what() << std::endl;
-          s_if->destroy();
-          std::cerr << "Destroyed storage interface." << std::endl;
-          exit(1);
-        }
-      }
-      uint64_t cur_time;
-      if ((cur_time = benchmark_utils::now_us()) - last_measure_time >= MEASURE_INTERVAL) {
-        tr << cur_time << "\t" << reads << std::endl;
-        last_measure_time = cur_time;
-      }
-    }
-    uint64_t r_end = benchmark_utils::now_us();
-    tr << r_end << "\t" << reads << std::endl;
-    tr.close();
+    tr.record(last_measure_time, reads);
+    pipeline(s_if, num_ops, n_async, 0, start_ns, max_ns, issue,
+             [&](const inflight_record &req, const storage_interface::completion &c, uint64_t t_e) {
+               auto latency = hr_clock::elapsed_ns(req.issue_ns, t_e);
+               records.record(t_e, latency, record_buffer::OP_READ,
+                              c.ok ? record_buffer::STATUS_OK : record_buffer::STATUS_ERROR, c.value.size());
+               if (c.ok) {
+                 recorder.record(t_e, latency);
+                 ++reads;
+               }
+               if (t_e - last_measure_time >= MEASURE_INTERVAL_NS) {
+                 tr.record(t_e, reads);
+                 reads = 0;
+                 last_measure_time = t_e;
+               }
+             });
+    tr.record(hr_clock::now_ns(), reads);
+    tr.write(output_path + "_read.bin", "ops");
+    recorder.flush();
+    log.write(output_path + "_read");
+    record_buffer::write(output_path + "_read_ops.bin", {records});
     std::cerr << "Finished reads." << std::endl;
+    print_latency_summary("reads", log);
   }
 
   template<typename K>
   static void send_writes(const std::shared_ptr<storage_interface> &s_if,
                           const std::shared_ptr<K> key_gen,
                           const std::shared_ptr<rate_limiter> &limiter,
+                          const std::shared_ptr<std::vector<send_record>> &sent,
                           const std::string &output_path,
-                          size_t value_size,
+                          payload &values,
                           size_t num_ops,
                           bool warm_up,
-                          uint64_t start_us,
-                          uint64_t max_us) {
+                          uint64_t start_ns,
+                          uint64_t max_ns) {
     int err_count = 0;
+    std::string key;
+    // Tags index sent, which the receiver reads once the request completes
+    uint64_t tag = 0;
     size_t warm_up_ops = num_ops / 10;
-    std::string value(value_size, 'x');
-    std::ofstream tw(output_path + "_write_send.txt");
+    series_buffer<double> tw(max_ns / MEASURE_INTERVAL_NS + 2);
     if (warm_up) {
       std::cerr << "[SEND] Warm-up writes..." << std::endl;
-      for (size_t i = 0; i < warm_up_ops && benchmark_utils::time_bound(start_us, max_us); i++) {
+      for (size_t i = 0; i < warm_up_ops && benchmark_utils::time_bound(start_ns, max_ns, hr_clock::now_ns()); i++) {
         try {
-          limiter->acquire();
-          s_if->write_async(key_gen->next(), value);
+          auto value = values.next();
+          auto t_i = limiter->acquire_slot();
+          auto t_s = hr_clock::now_ns();
+          key_gen->next(key);
+          (*sent)[tag] = {t_i, t_s, value.size};
+          s_if->submit_write(tag, key, value.data, value.size);
+          ++tag;
         } catch (std::runtime_error &e) {
           --i;
           ++err_count;
@@ -413,14 +1370,23 @@ class benchmark {
     }
 
     std::cerr << "[SEND] Starting writes..." << std::endl;
-    auto w_begin = benchmark_utils::now_us();
+    auto w_begin = hr_clock::now_ns();
     size_t i;
     auto last_measure_time = w_begin;
+    auto cur_time = w_begin;
     size_t interval_sent = 0;
-    for (i = 0; i < num_ops && benchmark_utils::time_bound(start_us, max_us); ++i) {
+    uint64_t max_lag_ns = 0;
+    for (i = 0; i < num_ops && benchmark_utils::time_bound(start_ns, max_ns, cur_time); ++i) {
       try {
-        limiter->acquire();
-        s_if->write_async(key_gen->next(), value);
+        auto value = values.next();
+        auto t_i = limiter->acquire_slot();
+        auto t_s = hr_clock::now_ns();
+        key_gen->next(key);
+        (*sent)[tag] = {t_i, t_s, value.size};
+        s_if->submit_write(tag, key, value.data, value.size);
+        ++tag;
+        if (t_s - t_i > max_lag_ns)
+          max_lag_ns = t_s - t_i;
         ++interval_sent;
       } catch (std::runtime_error &e) {
         --i;
@@ -433,107 +1399,133 @@ class benchmark {
           exit(1);
         }
       }
-      uint64_t cur_time;
-      if ((cur_time = benchmark_utils::now_us()) - last_measure_time >= MEASURE_INTERVAL) {
+      cur_time = hr_clock::now_ns();
+      if (cur_time - last_measure_time >= MEASURE_INTERVAL_NS) {
         double diff = cur_time - last_measure_time;
-        double send_rate = ((double) interval_sent * 1000.0 * 1000.0) / diff;
-        tw << cur_time << "\t" << send_rate << std::endl;
+        double send_rate = ((double) interval_sent * 1e9) / diff;
+        tw.record(cur_time, send_rate);
         interval_sent = 0;
         last_measure_time = cur_time;
       }
     }
-    uint64_t cur_time = benchmark_utils::now_us();
+    cur_time = hr_clock::now_ns();
     double diff = cur_time - last_measure_time;
-    double send_rate = ((double) interval_sent * 1000.0 * 1000.0) / diff;
-    tw << cur_time << "\t" << send_rate << std::endl;
-    tw.close();
+    double send_rate = ((double) interval_sent * 1e9) / diff;
+    tw.record(cur_time, send_rate);
+    tw.write(output_path + "_write_send.bin", "rate");
     std::cerr << "[SEND] Finished writes." << std::endl;
+    std::cerr << "[SEND] Maximum lag behind schedule: " << max_lag_ns << " ns" << std::endl;
+    std::cerr << "[SEND] ";
+    limiter->print_pacing(std::cerr);
+    std::cerr << std::endl;
   }
 
-  static void recv_writes(const std::shared_ptr<storage_interface> &s_if,
-                          const std::string &output_path,
-                          size_t num_ops,
-                          bool warm_up,
-                          uint64_t start_us,
-                          uint64_t max_us) {
+  static rate_limited_result recv_writes(const std::shared_ptr<storage_interface> &s_if,
+                                         const std::shared_ptr<const std::vector<send_record>> &sent,
+                                         const std::string &output_path,
+                                         size_t num_ops,
+                                         bool warm_up,
+                                         uint64_t start_ns,
+                                         uint64_t max_ns) {
     int err_count = 0;
-    size_t warm_up_ops = num_ops / 10;
-    std::ofstream tw(output_path + "_write_recv.txt");
-    if (warm_up) {
-      std::cerr << "[RECV] Warm-up writes..." << std::endl;
-      for (size_t i = 0; i < warm_up_ops && benchmark_utils::time_bound(start_us, max_us); i++) {
-        try {
-          s_if->wait_write();
-        } catch (std::runtime_error &e) {
-          --i;
-          ++err_count;
-          if (err_count > ERROR_MAX) {
-            std::cerr << "[RECV] Too many errors" << std::endl;
-            std::cerr << "Last error: " << e.what() << std::endl;
-            s_if->destroy();
-            std::cerr << "[RECV] Destroyed storage interface." << std::endl;
-            exit(1);
-          }
-        }
-      }
-    }
+    // Requests are tagged with their position in the send order, so warm-up requests have the lowest tags
+    size_t warm_up_ops = warm_up ? num_ops / 10 : 0;
+    series_buffer<double> tr(max_ns / MEASURE_INTERVAL_NS + 2);
+    record_buffer records(num_ops);
 
     std::cerr << "[RECV] Starting writes..." << std::endl;
-    auto w_begin = benchmark_utils::now_us();
-    size_t i;
-    auto last_measure_time = w_begin;
+    auto r_begin = hr_clock::now_ns();
+    auto last_measure_time = r_begin;
+    auto cur_time = r_begin;
     size_t interval_recv = 0;
-    for (i = 0; i < num_ops && benchmark_utils::time_bound(start_us, max_us); ++i) {
-      try {
-        s_if->wait_write();
-        ++interval_recv;
-      } catch (std::runtime_error &e) {
-        --i;
+    latency_log response_log(MEASURE_INTERVAL_NS);
+    latency_log service_log(MEASURE_INTERVAL_NS);
+    latency_log::recorder response_recorder(response_log);
+    latency_log::recorder service_recorder(service_log);
+    size_t errors = 0, completed = 0;
+    uint64_t first_ns = 0, last_ns = 0;
+    for (size_t i = 0; i < warm_up_ops + num_ops && benchmark_utils::time_bound(start_ns, max_ns, cur_time); ++i) {
+      auto c = s_if->wait_completion();
+      cur_time = hr_clock::now_ns();
+      if (c.tag >= warm_up_ops) {
+        const auto &req = (*sent)[c.tag];
+        if (first_ns == 0)
+          first_ns = req.intended_ns;
+        last_ns = cur_time;
+        auto response_time = hr_clock::elapsed_ns(req.intended_ns, cur_time);
+        records.record(cur_time, response_time, record_buffer::OP_WRITE,
+                       c.ok ? record_buffer::STATUS_OK : record_buffer::STATUS_ERROR, req.value_size);
+        if (c.ok) {
+          response_recorder.record(cur_time, response_time);
+          service_recorder.record(cur_time, hr_clock::elapsed_ns(req.sent_ns, cur_time));
+          ++interval_recv;
+          ++completed;
+        } else {
+          ++errors;
+        }
+      }
+      if (!c.ok) {
+        // The failed request still completed, so it is not retried
         ++err_count;
         if (err_count > ERROR_MAX) {
           std::cerr << "[RECV] Too many errors" << std::endl;
-          std::cerr << "Last error: " << e.what() << std::endl;
+          std::cerr << "Last error: " << c.error << std::endl;
           s_if->destroy();
           std::cerr << "[RECV] Destroyed storage interface." << std::endl;
           exit(1);
         }
       }
-      uint64_t cur_time;
-      if ((cur_time = benchmark_utils::now_us()) - last_measure_time >= MEASURE_INTERVAL) {
+      if (cur_time - last_measure_time >= MEASURE_INTERVAL_NS) {
         double diff = cur_time - last_measure_time;
-        double send_rate = ((double) interval_recv * 1000.0 * 1000.0) / diff;
-        tw << cur_time << "\t" << send_rate << std::endl;
+        double recv_rate = ((double) interval_recv * 1e9) / diff;
+        tr.record(cur_time, recv_rate);
         interval_recv = 0;
         last_measure_time = cur_time;
       }
     }
-    uint64_t cur_time = benchmark_utils::now_us();
+    cur_time = hr_clock::now_ns();
     double diff = cur_time - last_measure_time;
-    double send_rate = ((double) interval_recv * 1000.0 * 1000.0) / diff;
-    tw << cur_time << "\t" << send_rate << std::endl;
-    tw.close();
-
+    double recv_rate = ((double) interval_recv * 1e9) / diff;
+    tr.record(cur_time, recv_rate);
+    tr.write(output_path + "_write_recv.bin", "rate");
+    response_recorder.flush();
+    service_recorder.flush();
+    response_log.write(output_path + "_write");
+    service_log.write(output_path + "_write_service");
+    record_buffer::write(output_path + "_write_ops.bin", {records});
     std::cerr << "[RECV] Finished writes." << std::endl;
+    print_latency_summary("writes (response time)", response_log);
+    print_latency_summary("writes (service time)", service_log);
+    double span = last_ns > first_ns ? static_cast<double>(last_ns - first_ns) : 0;
+    return {response_log.total(), errors, span > 0 ? completed * 1e9 / span : 0};
   }
 
   template<typename K>
   static void send_reads(const std::shared_ptr<storage_interface> &s_if,
                          const std::shared_ptr<K> key_gen,
                          const std::shared_ptr<rate_limiter> &limiter,
+                         const std::shared_ptr<std::vector<send_record>> &sent,
                          const std::string &output_path,
                          size_t num_ops,
                          bool warm_up,
-                         uint64_t start_us,
-                         uint64_t max_us) {
+                         uint64_t start_ns,
+                         uint64_t max_ns) {
     int err_count = 0;
+    std::string key;
+    // Tags index sent, which the receiver reads once the request completes
+    uint64_t tag = 0;
     size_t warm_up_ops = num_ops / 10;
-    std::ofstream tr(output_path + "_read_send.txt");
+    series_buffer<double> tr(max_ns / MEASURE_INTERVAL_NS + 2);
     if (warm_up) {
       std::cerr << "[SEND] Warm-up reads..." << std::endl;
-      for (size_t i = 0; i < warm_up_ops && benchmark_utils::time_bound(start_us, max_us); i++) {
+      for (size_t i = 0; i < warm_up_ops && benchmark_utils::time_bound(start_ns, max_ns, hr_clock::now_ns()); i++) {
         try {
-          limiter->acquire();
-          s_if->read_async(key_gen->next());
+          auto t_i = limiter->acquire_slot();
+          auto t_s = hr_clock::now_ns();
+          key_gen->next(key);
+          (*sent)[tag] = {t_i, t_s, 0};
+          s_if->submit_read(tag, key);
+          ++tag;
         } catch (std::runtime_error &e) {
           --i;
           ++err_count;
@@ -549,14 +1541,22 @@ class benchmark {
     }
 
     std::cerr << "[SEND] Starting reads..." << std::endl;
-    auto r_begin = benchmark_utils::now_us();
+    auto r_begin = hr_clock::now_ns();
     size_t i;
     auto last_measure_time = r_begin;
+    auto cur_time = r_begin;
     size_t interval_sent = 0;
-    for (i = 0; i < num_ops && benchmark_utils::time_bound(start_us, max_us); ++i) {
+    uint64_t max_lag_ns = 0;
+    for (i = 0; i < num_ops && benchmark_utils::time_bound(start_ns, max_ns, cur_time); ++i) {
       try {
-        limiter->acquire();
-        s_if->read_async(key_gen->next());
+        auto t_i = limiter->acquire_slot();
+        auto t_s = hr_clock::now_ns();
+        key_gen->next(key);
+        (*sent)[tag] = {t_i, t_s, 0};
+        s_if->submit_read(tag, key);
+        ++tag;
+        if (t_s - t_i > max_lag_ns)
+          max_lag_ns = t_s - t_i;
         ++interval_sent;
       } catch (std::runtime_error &e) {
         --i;
@@ -569,86 +1569,105 @@ class benchmark {
           exit(1);
         }
       }
-      uint64_t cur_time;
-      if ((cur_time = benchmark_utils::now_us()) - last_measure_time >= MEASURE_INTERVAL) {
+      cur_time = hr_clock::now_ns();
+      if (cur_time - last_measure_time >= MEASURE_INTERVAL_NS) {
         double diff = cur_time - last_measure_time;
-        double send_rate = ((double) interval_sent * 1000.0 * 1000.0) / diff;
-        tr << cur_time << "\t" << send_rate << std::endl;
+        double send_rate = ((double) interval_sent * 1e9) / diff;
+        tr.record(cur_time, send_rate);
         interval_sent = 0;
         last_measure_time = cur_time;
       }
     }
-    uint64_t cur_time = benchmark_utils::now_us();
+    cur_time = hr_clock::now_ns();
     double diff = cur_time - last_measure_time;
-    double send_rate = ((double) interval_sent * 1000.0 * 1000.0) / diff;
-    tr << cur_time << "\t" << send_rate << std::endl;
-    tr.close();
+    double send_rate = ((double) interval_sent * 1e9) / diff;
+    tr.record(cur_time, send_rate);
+    tr.write(output_path + "_read_send.bin", "rate");
     std::cerr << "[SEND] Finished reads." << std::endl;
+    std::cerr << "[SEND] Maximum lag behind schedule: " << max_lag_ns << " ns" << std::endl;
+    std::cerr << "[SEND] ";
+    limiter->print_pacing(std::cerr);
+    std::cerr << std::endl;
   }
 
-  static void recv_reads(const std::shared_ptr<storage_interface> &s_if,
-                         const std::string &output_path,
-                         size_t num_ops,
-                         bool warm_up,
-                         uint64_t start_us,
-                         uint64_t max_us) {
+  static rate_limited_result recv_reads(const std::shared_ptr<storage_interface> &s_if,
+                                        const std::shared_ptr<const std::vector<send_record>> &sent,
+                                        const std::string &output_path,
+                                        size_t num_ops,
+                                        bool warm_up,
+                                        uint64_t start_ns,
+                                        uint64_t max_ns) {
     int err_count = 0;
-    size_t warm_up_ops = num_ops / 10;
-    std::ofstream tr(output_path + "_read_recv.txt");
-    if (warm_up) {
-      std::cerr << "[RECV] Warm-up reads..." << std::endl;
-      for (size_t i = 0; i < warm_up_ops && benchmark_utils::time_bound(start_us, max_us); i++) {
-        try {
-          s_if->wait_read();
-        } catch (std::runtime_error &e) {
-          --i;
-          ++err_count;
-          if (err_count > ERROR_MAX) {
-            std::cerr << "[RECV] Too many errors" << std::endl;
-            std::cerr << "Last error: " << e.what() << std::endl;
-            s_if->destroy();
-            std::cerr << "[RECV] Destroyed storage interface." << std::endl;
-            exit(1);
-          }
-        }
-      }
-    }
+    // Requests are tagged with their position in the send order, so warm-up requests have the lowest tags
+    size_t warm_up_ops = warm_up ? num_ops / 10 : 0;
+    series_buffer<double> tr(max_ns / MEASURE_INTERVAL_NS + 2);
+    record_buffer records(num_ops);
 
     std::cerr << "[RECV] Starting reads..." << std::endl;
-    auto r_begin = benchmark_utils::now_us();
-    size_t i;
+    auto r_begin = hr_clock::now_ns();
     auto last_measure_time = r_begin;
+    auto cur_time = r_begin;
     size_t interval_recv = 0;
-    for (i = 0; i < num_ops && benchmark_utils::time_bound(start_us, max_us); ++i) {
-      try {
-        s_if->wait_read();
-        ++interval_recv;
-      } catch (std::runtime_error &e) {
-        --i;
+    latency_log response_log(MEASURE_INTERVAL_NS);
+    latency_log service_log(MEASURE_INTERVAL_NS);
+    latency_log::recorder response_recorder(response_log);
+    latency_log::recorder service_recorder(service_log);
+    size_t errors = 0, completed = 0;
+    uint64_t first_ns = 0, last_ns = 0;
+    for (size_t i = 0; i < warm_up_ops + num_ops && benchmark_utils::time_bound(start_ns, max_ns, cur_time); ++i) {
+      auto c = s_if->wait_completion();
+      cur_time = hr_clock::now_ns();
+      if (c.tag >= warm_up_ops) {
+        const auto &req = (*sent)[c.tag];
+        if (first_ns == 0)
+          first_ns = req.intended_ns;
+        last_ns = cur_time;
+        auto response_time = hr_clock::elapsed_ns(req.intended_ns, cur_time);
+        records.record(cur_time, response_time, record_buffer::OP_READ,
+                       c.ok ? record_buffer::STATUS_OK : record_buffer::STATUS_ERROR, c.value.size());
+        if (c.ok) {
+          response_recorder.record(cur_time, response_time);
+          service_recorder.record(cur_time, hr_clock::elapsed_ns(req.sent_ns, cur_time));
+          ++interval_recv;
+          ++completed;
+        } else {
+          ++errors;
+        }
+      }
+      if (!c.ok) {
+        // The failed request still completed, so it is not retried
         ++err_count;
         if (err_count > ERROR_MAX) {
           std::cerr << "[RECV] Too many errors" << std::endl;
-          std::cerr << "Last error: " << e.what() << std::endl;
+          std::cerr << "Last error: " << c.error << std::endl;
           s_if->destroy();
           std::cerr << "[RECV] Destroyed storage interface." << std::endl;
           exit(1);
         }
       }
-      uint64_t cur_time;
-      if ((cur_time = benchmark_utils::now_us()) - last_measure_time >= MEASURE_INTERVAL) {
+      if (cur_time - last_measure_time >= MEASURE_INTERVAL_NS) {
         double diff = cur_time - last_measure_time;
-        double recv_rate = ((double) interval_recv * 1000.0 * 1000.0) / diff;
-        tr << cur_time << "\t" << recv_rate << std::endl;
+        double recv_rate = ((double) interval_recv * 1e9) / diff;
+        tr.record(cur_time, recv_rate);
         interval_recv = 0;
         last_measure_time = cur_time;
       }
     }
-    uint64_t cur_time = benchmark_utils::now_us();
+    cur_time = hr_clock::now_ns();
     double diff = cur_time - last_measure_time;
-    double send_rate = ((double) interval_recv * 1000.0 * 1000.0) / diff;
-    tr << cur_time << "\t" << send_rate << std::endl;
-    tr.close();
+    double recv_rate = ((double) interval_recv * 1e9) / diff;
+    tr.record(cur_time, recv_rate);
+    tr.write(output_path + "_read_recv.bin", "rate");
+    response_recorder.flush();
+    service_recorder.flush();
+    response_log.write(output_path + "_read");
+    service_log.write(output_path + "_read_service");
+    record_buffer::write(output_path + "_read_ops.bin", {records});
     std::cerr << "[RECV] Finished reads." << std::endl;
+    print_latency_summary("reads (response time)", response_log);
+    print_latency_summary("reads (service time)", service_log);
+    double span = last_ns > first_ns ? static_cast<double>(last_ns - first_ns) : 0;
+    return {response_log.total(), errors, span > 0 ? completed * 1e9 / span : 0};
   }
 
   template<typename K>
@@ -657,16 +1676,18 @@ class benchmark {
                                const std::shared_ptr<K> key_gen,
                                const std::string &output_path,
                                double rate,
-                               size_t value_size,
+                               const std::shared_ptr<arrival_process> &arrivals,
+                               const payload &values,
                                size_t num_ops,
                                bool warm_up,
                                int32_t mode,
-                               uint64_t max_us,
+                               uint64_t max_ns,
                                const std::string &control_host,
                                int control_port,
                                const std::string &id) {
 
-    auto start_us = benchmark_utils::now_us();
+    auto start_ns = hr_clock::now_ns();
+    size_t num_sends = (warm_up ? num_ops / 10 : 0) + num_ops;
 
     std::cerr << "Initializing storage interface..." << std::endl;
     s_if->init(conf, (mode & BENCHMARK_CREATE) == BENCHMARK_CREATE);
@@ -676,36 +1697,46 @@ class benchmark {
       return;
     }
 
+    auto limiter = std::make_shared<rate_limiter>(rate);
+    if (arrivals != nullptr)
+      limiter->set_arrivals(arrivals);
+
     if ((mode & BENCHMARK_WRITE) == BENCHMARK_WRITE) {
+      auto sent = std::make_shared<std::vector<send_record>>(num_sends);
+      payload write_values(values);
       std::thread recv_thread([=]() {
-        benchmark::recv_writes(s_if, output_path, num_ops, warm_up, start_us, max_us);
+        benchmark::recv_writes(s_if, sent, output_path, num_ops, warm_up, start_ns, max_ns);
       });
       benchmark::send_writes(s_if,
                              key_gen,
-                             std::make_shared<rate_limiter>(rate),
+                             limiter,
+                             sent,
                              output_path,
-                             value_size,
+                             write_values,
                              num_ops,
                              warm_up,
-                             start_us,
-                             max_us);
+                             start_ns,
+                             max_ns);
       recv_thread.join();
     }
 
     key_gen->reset();
 
     if ((mode & BENCHMARK_READ) == BENCHMARK_READ) {
+      auto sent = std::make_shared<std::vector<send_record>>(num_sends);
       std::thread recv_thread([=] {
-        benchmark::recv_reads(s_if, output_path, num_ops, warm_up, start_us, max_us);
+        benchmark::recv_reads(s_if, sent, output_path, num_ops, warm_up, start_ns, max_ns);
       });
+      limiter->restart();
       benchmark::send_reads(s_if,
                             key_gen,
-                            std::make_shared<rate_limiter>(rate),
+                            limiter,
+                            sent,
                             output_path,
                             num_ops,
                             warm_up,
-                            start_us,
-                            max_us);
+                            start_ns,
+                            max_ns);
       recv_thread.join();
     }
 
@@ -714,21 +1745,121 @@ class benchmark {
     }
   }
 
+  template<typename K>
+  static void run_slo_search(const std::shared_ptr<storage_interface> &s_if,
+                             const storage_interface::property_map &conf,
+                             const std::shared_ptr<K> key_gen,
+                             const std::string &output_path,
+                             const slo_search &search,
+                             const payload &values,
+                             size_t num_ops,
+                             bool warm_up,
+                             int32_t mode,
+                             uint64_t max_ns,
+                             const std::string &control_host,
+                             int control_port,
+                             const std::string &id) {
+    auto start_ns = hr_clock::now_ns();
+
+    std::cerr << "Initializing storage interface..." << std::endl;
+    s_if->init(conf, (mode & BENCHMARK_CREATE) == BENCHMARK_CREATE);
+
+    if (!benchmark_utils::signal(control_host, control_port, id)) {
+      std::cerr << "Aborting benchmark..." << std::endl;
+      return;
+    }
+
+    if ((mode & BENCHMARK_WRITE) == BENCHMARK_WRITE) {
+      payload write_values(values);
+      // One schedule for the whole search, restarted at each step's rate
+      auto limiter = std::make_shared<rate_limiter>(search.next_rate());
+      search_rate(search, "write", output_path, start_ns, max_ns, [&](double rate, const std::string &step_path) {
+        auto ops = search.step_ops(rate, num_ops);
+        auto sent = std::make_shared<std::vector<send_record>>((warm_up ? ops / 10 : 0) + ops);
+        rate_limited_result result;
+        std::thread recv_thread([&] {
+          result = benchmark::recv_writes(s_if, sent, step_path, ops, warm_up, start_ns, max_ns);
+        });
+        key_gen->reset();
+        limiter->set_rate(rate);
+        limiter->restart();
+        benchmark::send_writes(s_if, key_gen, limiter, sent, step_path, write_values, ops, warm_up, start_ns,
+                               max_ns);
+        recv_thread.join();
+        return result;
+      });
+    }
+
+    if ((mode & BENCHMARK_READ) == BENCHMARK_READ) {
+      // One schedule for the whole search, restarted at each step's rate
+      auto limiter = std::make_shared<rate_limiter>(search.next_rate());
+      search_rate(search, "read", output_path, start_ns, max_ns, [&](double rate, const std::string &step_path) {
+        auto ops = search.step_ops(rate, num_ops);
+        auto sent = std::make_shared<std::vector<send_record>>((warm_up ? ops / 10 : 0) + ops);
+        rate_limited_result result;
+        std::thread recv_thread([&] {
+          result = benchmark::recv_reads(s_if, sent, step_path, ops, warm_up, start_ns, max_ns);
+        });
+        key_gen->reset();
+        limiter->set_rate(rate);
+        limiter->restart();
+        benchmark::send_reads(s_if, key_gen, limiter, sent, step_path, ops, warm_up, start_ns, max_ns);
+        recv_thread.join();
+        return result;
+      });
+    }
+
+    if ((mode & BENCHMARK_DESTROY) == BENCHMARK_DESTROY) {
+      s_if->destroy();
+    }
+  }
+
+  // Runs the steps of a copy of proto, one rate-limited phase per step, and writes the curve and best rate under
+  // output_path with op ("read" or "write") in their names
+  template<typename F>
+  static void search_rate(const slo_search &proto,
+                          const std::string &op,
+                          const std::string &output_path,
+                          uint64_t start_ns,
+                          uint64_t max_ns,
+                          F run_step) {
+    slo_search search(proto);
+    double rate;
+    while ((rate = search.next_rate()) > 0 && benchmark_utils::time_bound(start_ns, max_ns, hr_clock::now_ns())) {
+      std::cerr << "Searching " << op << "s at " << rate << " ops/s..." << std::endl;
+      auto step_path = output_path + "_step" + std::to_string(search.steps().size() + 1);
+      auto result = run_step(rate, step_path);
+      search.record(rate, result.throughput, result.response_time, result.errors);
+      search.print_last_step(std::cerr);
+      std::cerr << std::endl;
+    }
+    search.write(output_path + "_" + op + "_search.bin");
+    std::ofstream out(output_path + "_" + op + "_max_rate.txt");
+    out << search.best_rate() << "\n";
+    if (search.best_rate() > 0) {
+      std::cerr << "Maximum sustainable " << op << " rate: " << search.best_rate() << " ops/s" << std::endl;
+    } else {
+      std::cerr << "No sustainable " << op << " rate at or above min_rate=" << search.min_rate() << " ops/s"
+                << std::endl;
+    }
+  }
+
   template<typename K>
   static void run_async(const std::shared_ptr<storage_interface> &s_if,
                         const storage_interface::property_map &conf,
                         const std::shared_ptr<K> key_gen,
                         const std::string &output_path,
-                        size_t value_size,
+                        const payload &values,
                         size_t num_ops,
                         size_t n_async,
+                        size_t max_outstanding_bytes,
                         bool warm_up,
                         int32_t mode,
-                        uint64_t max_us,
+                        uint64_t max_ns,
                         const std::string &control_host,
                         int control_port,
                         const std::string &id) {
-    auto start_us = benchmark_utils::now_us();
+    auto start_ns = hr_clock::now_ns();
 
     std::cerr << "Initializing storage interface..." << std::endl;
     s_if->init(conf, (mode & BENCHMARK_CREATE) == BENCHMARK_CREATE);
@@ -738,13 +1869,16 @@ class benchmark {
       return;
     }
 
-    if ((mode & BENCHMARK_WRITE) == BENCHMARK_WRITE)
-      benchmark::async_writes(s_if, key_gen, output_path, value_size, num_ops, n_async, warm_up, start_us, max_us);
+    if ((mode & BENCHMARK_WRITE) == BENCHMARK_WRITE) {
+      payload write_values(values);
+      benchmark::async_writes(s_if, key_gen, output_path, write_values, num_ops, n_async, max_outstanding_bytes,
+                              warm_up, start_ns, max_ns);
+    }
 
     key_gen->reset();
 
     if ((mode & BENCHMARK_READ) == BENCHMARK_READ)
-      benchmark::async_reads(s_if, key_gen, output_path, num_ops, n_async, warm_up, start_us, max_us);
+      benchmark::async_reads(s_if, key_gen, output_path, num_ops, n_async, warm_up, start_ns, max_ns);
 
     if ((mode & BENCHMARK_DESTROY) == BENCHMARK_DESTROY)
       s_if->destroy();
@@ -95,7 +95,7 @@ def _run_benchmark(logger, bench_type, lambda_id, system, conf, out, bench, num_
         logger.warn('Process did not terminate cleanly (Exit code: {})'.format(e.returncode))
 
 
-def _create_ini(logger, system, sys_conf, bench_conf, out):
+def _create_ini(logger, system, sys_conf, bench_conf, optional_conf, out):
     config = configparser.ConfigParser()
     config.add_section(system)
     for key in sys_conf.keys():
@@ -103,6 +103,11 @@ def _create_ini(logger, system, sys_conf, bench_conf, out):
     config.add_section('benchmark')
     for key in bench_conf.keys():
         config.set('benchmark', key, bench_conf[key])
+    for section, section_conf in optional_conf.items():
+        if section_conf:
+            config.add_section(section)
+            for key in section_conf.keys():
+                config.set(section, key, section_conf[key])
     with open(out, 'w') as f:
         config.write(f)
     logger.info('Created configuration file {}'.format(out))
@@ -119,6 +124,7 @@ def benchmark_handler(event, context):
     system = event.get('system')
     sys_conf = event.get('conf')
     bench_conf = event.get('bench_conf')
+    optional_conf = dict(workload=event.get('workload_conf'), payload=event.get('payload_conf'))
     host = event.get('host')
     log_port = int(event.get('port'))
     mode = event.get('mode')
@@ -129,10 +135,22 @@ def benchmark_handler(event, context):
     warm_up = event.get('warm_up')
     dist = event.get('dist')
     num_listeners = event.get('num_listeners')
+    # Per-op records are the bulk of the results; without them only per-interval summaries are uploaded
+    per_op = event.get('per_op', True)
     if bench_type == 'storage_bench':
-        result_suffixes = ['_read_latency.txt', '_read_throughput.txt', '_write_latency.txt', '_write_throughput.txt']
+        result_suffixes = []
+        for phase in ['read', 'write', 'load']:
+            result_suffixes += ['_{}_latency.txt'.format(phase), '_{}_histogram.txt'.format(phase),
+                                '_{}_throughput.txt'.format(phase)]
+            if per_op:
+                result_suffixes.append('_{}_ops.bin'.format(phase))
+        result_suffixes.append('_workload_throughput.txt')
+        if per_op:
+            result_suffixes.append('_workload_ops.bin')
+        for op in ['read', 'update', 'insert', 'rmw', 'scan']:
+            result_suffixes += ['_workload_{}_latency.txt'.format(op), '_workload_{}_histogram.txt'.format(op)]
     elif bench_type == 'notification_bench':
-        result_suffixes = ['_{}Of{}.txt'.format(l + 1, num_listeners) for l in range(int(num_listeners))]
+        result_suffixes = ['_{}Of{}.bin'.format(l + 1, num_listeners) for l in range(int(num_listeners))]
     else:
         raise RuntimeError('Unknown benchmark type {}'.format(bench_type))
 
@@ -147,7 +165,7 @@ def benchmark_handler(event, context):
     prefix = os.path.join('/tmp', system + '_' + i)
     conf_file = prefix + '.conf'
     try:
-        _create_ini(logger, system, sys_conf, bench_conf, conf_file)
+        _create_ini(logger, system, sys_conf, bench_conf, optional_conf, conf_file)
         _run_benchmark(logger, bench_type, i, system, conf_file, prefix, object_size, num_ops, warm_up, num_listeners,
                        mode, dist, bin_path)
     except Exception as e:
@@ -9,10 +9,12 @@
 #include <cstring>
 #include <arpa/inet.h>
 #include <netdb.h>
+#include <unistd.h>
 #include <iostream>
 #include <vector>
 #include <chrono>
 #include <sstream>
+#include <algorithm>
 
 class benchmark_utils {
  public:
@@ -24,6 +26,11 @@ class benchmark_utils {
     }
   }
 
+  // First element of the i-th of `parts` contiguous, near-equal slices of [0, n)
+  static size_t partition_begin(size_t n, size_t parts, size_t i) {
+    return (n / parts) * i + std::min(i, n % parts);
+  }
+
   static bool time_bound(uint64_t start_us, uint64_t max_us) {
     if (now_us() - start_us < max_us)
       return true;
@@ -31,6 +38,14 @@ class benchmark_utils {
     return false;
   }
 
+  // As above, against a clock reading the caller already has, so timed loops can check the timeout for free
+  static bool time_bound(uint64_t start, uint64_t max, uint64_t now) {
+    if (now - start < max)
+      return true;
+    std::cerr << "WARN Benchmark timed out..." << std::endl;
+    return false;
+  }
+
   static uint64_t now_us() {
     using namespace std::chrono;
     time_point<system_clock> now = system_clock::now();
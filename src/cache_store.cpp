@@ -0,0 +1,649 @@
+#include "cache_store.h"
+
+#include <algorithm>
+#include <iterator>
+#include <list>
+#include <vector>
+#include "hr_clock.h"
+
+// One shard's worth of cached values and the bookkeeping of its eviction policy; callers serialize access
+class cache_policy {
+ public:
+  explicit cache_policy(size_t capacity) : m_capacity(capacity), m_used(0), m_evictions(0) {}
+
+  virtual ~cache_policy() = default;
+
+  // False if key is not cached; otherwise counts as a use of key
+  virtual bool get(const std::string &key, std::string &value) = 0;
+  virtual void put(const std::string &key, const char *value, size_t length) = 0;
+  virtual void erase(const std::string &key) = 0;
+  virtual void clear() = 0;
+
+  size_t used() const {
+    return m_used;
+  }
+
+  size_t evictions() const {
+    return m_evictions;
+  }
+
+ protected:
+  struct entry {
+    std::string key;
+    std::string value;
+    bool referenced;
+    int segment;
+
+    size_t size() const {
+      return key.size() + value.size();
+    }
+  };
+
+  typedef std::list<entry> entry_list;
+
+  size_t m_capacity;
+  size_t m_used;
+  size_t m_evictions;
+};
+
+class lru_policy : public cache_policy {
+ public:
+  explicit lru_policy(size_t capacity) : cache_policy(capacity) {}
+
+  bool get(const std::string &key, std::string &value) override {
+    auto it = m_index.find(key);
+    if (it == m_index.end())
+      return false;
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    value = it->second->value;
+    return true;
+  }
+
+  void put(const std::string &key, const char *value, size_t length) override {
+    erase(key);
+    if (key.size() + length > m_capacity)
+      return;
+    m_entries.push_front(entry{key, std::string(value, length), false, 0});
+    m_index[key] = m_entries.begin();
+    m_used += m_entries.front().size();
+    while (m_used > m_capacity) {
+      remove(std::prev(m_entries.end()));
+      ++m_evictions;
+    }
+  }
+
+  void erase(const std::string &key) override {
+    auto it = m_index.find(key);
+    if (it != m_index.end())
+      remove(it->second);
+  }
+
+  void clear() override {
+    m_entries.clear();
+    m_index.clear();
+    m_used = 0;
+  }
+
+ private:
+  void remove(entry_list::iterator it) {
+    m_used -= it->size();
+    m_index.erase(it->key);
+    m_entries.erase(it);
+  }
+
+  // Most recently used first
+  entry_list m_entries;
+  std::unordered_map<std::string, entry_list::iterator> m_index;
+};
+
+// Second-chance eviction: a hand sweeps the entries in a ring, sparing those used since it last passed them
+class clock_policy : public cache_policy {
+ public:
+  explicit clock_policy(size_t capacity) : cache_policy(capacity), m_hand(m_ring.end()) {}
+
+  bool get(const std::string &key, std::string &value) override {
+    auto it = m_index.find(key);
+    if (it == m_index.end())
+      return false;
+    it->second->referenced = true;
+    value = it->second->value;
+    return true;
+  }
+
+  void put(const std::string &key, const char *value, size_t length) override {
+    erase(key);
+    auto size = key.size() + length;
+    if (size > m_capacity)
+      return;
+    while (m_used + size > m_capacity) {
+      if (m_hand == m_ring.end())
+        m_hand = m_ring.begin();
+      while (m_hand->referenced) {
+        m_hand->referenced = false;
+        if (++m_hand == m_ring.end())
+          m_hand = m_ring.begin();
+      }
+      remove(m_hand);
+      ++m_evictions;
+    }
+    // Just behind the hand, so a new entry is the last the hand reaches
+    auto it = m_ring.insert(m_hand, entry{key, std::string(value, length), false, 0});
+    m_index[key] = it;
+    m_used += size;
+  }
+
+  void erase(const std::string &key) override {
+    auto it = m_index.find(key);
+    if (it != m_index.end())
+      remove(it->second);
+  }
+
+  void clear() override {
+    m_ring.clear();
+    m_index.clear();
+    m_hand = m_ring.end();
+    m_used = 0;
+  }
+
+ private:
+  void remove(entry_list::iterator it) {
+    if (it == m_hand)
+      ++m_hand;
+    m_used -= it->size();
+    m_index.erase(it->key);
+    m_ring.erase(it);
+  }
+
+  entry_list m_ring;
+  entry_list::iterator m_hand;
+  std::unordered_map<std::string, entry_list::iterator> m_index;
+};
+
+// Count-min sketch of 4-bit counters that halves every count after a number of increments, so that the
+// frequencies it estimates are recent ones
+class frequency_sketch {
+ public:
+  explicit frequency_sketch(size_t width) : m_mask(width - 1), m_samples(0), m_counters(DEPTH * width, 0) {}
+
+  void increment(size_t hash) {
+    for (size_t i = 0; i < DEPTH; ++i) {
+      auto &c = m_counters[i * (m_mask + 1) + index(hash, i)];
+      if (c < 15)
+        ++c;
+    }
+    if (++m_samples >= 10 * (m_mask + 1)) {
+      for (auto &c: m_counters)
+        c >>= 1;
+      m_samples /= 2;
+    }
+  }
+
+  uint8_t estimate(size_t hash) const {
+    uint8_t f = 15;
+    for (size_t i = 0; i < DEPTH; ++i)
+      f = std::min(f, m_counters[i * (m_mask + 1) + index(hash, i)]);
+    return f;
+  }
+
+ private:
+  static const size_t DEPTH = 4;
+
+  size_t index(size_t hash, size_t row) const {
+    static const uint64_t SEEDS[DEPTH] = {0x9e3779b97f4a7c15ULL, 0xc2b2ae3d27d4eb4fULL, 0x165667b19e3779f9ULL,
+                                          0x27d4eb2f165667c5ULL};
+    return ((static_cast<uint64_t>(hash) * SEEDS[row]) >> 32) & m_mask;
+  }
+
+  size_t m_mask;
+  size_t m_samples;
+  std::vector<uint8_t> m_counters;
+};
+
+// W-TinyLFU: new keys enter an LRU window of 1% of the capacity. A key pushed out of the window only enters the
+// main region, a segmented LRU, if the sketch has seen it more often than the main region's next victim.
+class tinylfu_policy : public cache_policy {
+ public:
+  explicit tinylfu_policy(size_t capacity)
+      : cache_policy(capacity), m_sketch(sketch_width(capacity)), m_bytes{0, 0, 0} {
+    m_window_capacity = std::max<size_t>(capacity / 100, 1);
+    m_main_capacity = capacity - m_window_capacity;
+    m_protected_capacity = m_main_capacity / 10 * 8;
+  }
+
+  bool get(const std::string &key, std::string &value) override {
+    m_sketch.increment(std::hash<std::string>()(key));
+    auto it = m_index.find(key);
+    if (it == m_index.end())
+      return false;
+    auto e = it->second;
+    if (e->segment == PROBATION) {
+      move_to(e, PROTECTED);
+      while (m_bytes[PROTECTED] > m_protected_capacity)
+        move_to(std::prev(m_lists[PROTECTED].end()), PROBATION);
+    } else {
+      m_lists[e->segment].splice(m_lists[e->segment].begin(), m_lists[e->segment], e);
+    }
+    value = e->value;
+    return true;
+  }
+
+  void put(const std::string &key, const char *value, size_t length) override {
+    m_sketch.increment(std::hash<std::string>()(key));
+    erase(key);
+    if (key.size() + length > m_capacity)
+      return;
+    m_lists[WINDOW].push_front(entry{key, std::string(value, length), false, WINDOW});
+    m_index[key] = m_lists[WINDOW].begin();
+    m_bytes[WINDOW] += m_lists[WINDOW].front().size();
+    m_used += m_lists[WINDOW].front().size();
+    while (m_bytes[WINDOW] > m_window_capacity)
+      admit(std::prev(m_lists[WINDOW].end()));
+  }
+
+  void erase(const std::string &key) override {
+    auto it = m_index.find(key);
+    if (it != m_index.end())
+      remove(it->second);
+  }
+
+  void clear() override {
+    for (auto &l: m_lists)
+      l.clear();
+    m_index.clear();
+    m_bytes[WINDOW] = m_bytes[PROBATION] = m_bytes[PROTECTED] = 0;
+    m_used = 0;
+  }
+
+ private:
+  enum segment {
+    WINDOW = 0,
+    PROBATION = 1,
+    PROTECTED = 2
+  };
+
+  // About four counters per cached entry of 1 KiB
+  static size_t sketch_width(size_t capacity) {
+    size_t width = 1024;
+    while (width < capacity / 256 && width < (1 << 24))
+      width <<= 1;
+    return width;
+  }
+
+  // Moves candidate from the window into the main region, evicting main entries that are used less, or evicts it
+  void admit(entry_list::iterator candidate) {
+    auto frequency = m_sketch.estimate(std::hash<std::string>()(candidate->key));
+    while (m_bytes[PROBATION] + m_bytes[PROTECTED] + candidate->size() > m_main_capacity) {
+      if (m_lists[PROBATION].empty() && m_lists[PROTECTED].empty()) {
+        // Larger than the main region
+        ++m_evictions;
+        remove(candidate);
+        return;
+      }
+      auto &victims = m_lists[PROBATION].empty() ? m_lists[PROTECTED] : m_lists[PROBATION];
+      auto victim = std::prev(victims.end());
+      ++m_evictions;
+      if (frequency <= m_sketch.estimate(std::hash<std::string>()(victim->key))) {
+        remove(candidate);
+        return;
+      }
+      remove(victim);
+    }
+    move_to(candidate, PROBATION);
+  }
+
+  void move_to(entry_list::iterator e, segment to) {
+    m_bytes[e->segment] -= e->size();
+    m_bytes[to] += e->size();
+    m_lists[to].splice(m_lists[to].begin(), m_lists[e->segment], e);
+    e->segment = to;
+  }
+
+  void remove(entry_list::iterator e) {
+    m_bytes[e->segment] -= e->size();
+    m_used -= e->size();
+    m_index.erase(e->key);
+    m_lists[e->segment].erase(e);
+  }
+
+  frequency_sketch m_sketch;
+  size_t m_window_capacity;
+  size_t m_main_capacity;
+  size_t m_protected_capacity;
+  // Most recently used first
+  entry_list m_lists[3];
+  size_t m_bytes[3];
+  std::unordered_map<std::string, entry_list::iterator> m_index;
+};
+
+class cache_store::cache {
+ public:
+  cache(const std::string &eviction, size_t capacity, size_t num_shards) : m_shards(num_shards) {
+    for (auto &s: m_shards) {
+      if (eviction == "lru")
+        s.policy.reset(new lru_policy(capacity / num_shards));
+      else if (eviction == "clock")
+        s.policy.reset(new clock_policy(capacity / num_shards));
+      else if (eviction == "tinylfu")
+        s.policy.reset(new tinylfu_policy(capacity / num_shards));
+      else
+        throw std::invalid_argument("Unknown cache eviction policy: " + eviction);
+    }
+  }
+
+  bool get(const std::string &key, std::string &value) {
+    auto &s = shard_of(key);
+    std::lock_guard<std::mutex> lock(s.mtx);
+    return s.policy->get(key, value);
+  }
+
+  void put(const std::string &key, const char *value, size_t length) {
+    auto &s = shard_of(key);
+    std::lock_guard<std::mutex> lock(s.mtx);
+    s.policy->put(key, value, length);
+  }
+
+  void erase(const std::string &key) {
+    auto &s = shard_of(key);
+    std::lock_guard<std::mutex> lock(s.mtx);
+    s.policy->erase(key);
+  }
+
+  void clear() {
+    for (auto &s: m_shards) {
+      std::lock_guard<std::mutex> lock(s.mtx);
+      s.policy->clear();
+    }
+  }
+
+  // Bytes cached and entries evicted over all shards
+  std::pair<size_t, size_t> usage() {
+    std::pair<size_t, size_t> u{0, 0};
+    for (auto &s: m_shards) {
+      std::lock_guard<std::mutex> lock(s.mtx);
+      u.first += s.policy->used();
+      u.second += s.policy->evictions();
+    }
+    return u;
+  }
+
+ private:
+  struct shard {
+    std::mutex mtx;
+    std::unique_ptr<cache_policy> policy;
+  };
+
+  shard &shard_of(const std::string &key) {
+    // The high bits, since tinylfu uses the hash of the key too
+    return m_shards[(std::hash<std::string>()(key) >> 16) % m_shards.size()];
+  }
+
+  std::vector<shard> m_shards;
+};
+
+// The cache all instances in the process share; created by the first init()
+static std::shared_ptr<cache_store::cache> g_cache;
+static std::mutex g_cache_mtx;
+
+// Statistics of the instances that are gone, printed when the last instance goes
+static std::unique_ptr<cache_store::stats> g_stats;
+static size_t g_instances = 0;
+
+void cache_store::stats::merge(const stats &other) {
+  hits += other.hits;
+  misses += other.misses;
+  hit_ns.merge(other.hit_ns);
+  miss_ns.merge(other.miss_ns);
+}
+
+cache_store::cache_store(std::shared_ptr<storage_interface> inner)
+    : m_inner(std::move(inner)), m_write_around(false), m_backend_outstanding(0), m_stop(false) {
+  std::lock_guard<std::mutex> lock(g_cache_mtx);
+  ++g_instances;
+}
+
+cache_store::~cache_store() {
+  {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_stop = true;
+  }
+  m_backend_cv.notify_one();
+  if (m_receiver.joinable())
+    m_receiver.join();
+
+  std::lock_guard<std::mutex> lock(g_cache_mtx);
+  if (g_stats == nullptr)
+    g_stats.reset(new stats());
+  g_stats->merge(m_stats);
+  if (--g_instances > 0)
+    return;
+  auto reads = g_stats->hits + g_stats->misses;
+  if (reads > 0 && m_cache != nullptr) {
+    auto usage = m_cache->usage();
+    std::cerr << "Cache: " << g_stats->hits << " hits, " << g_stats->misses << " misses (hit ratio "
+              << static_cast<double>(g_stats->hits) / reads << "), " << usage.second << " evictions, "
+              << usage.first << " bytes cached" << std::endl;
+    std::cerr << "Latency summary for cache hits (count, p50, p90, p99, p99.9, max in ns): ";
+    g_stats->hit_ns.write_summary(std::cerr);
+    std::cerr << std::endl;
+    std::cerr << "Latency summary for cache misses (count, p50, p90, p99, p99.9, max in ns): ";
+    g_stats->miss_ns.write_summary(std::cerr);
+    std::cerr << std::endl;
+  }
+  g_stats.reset();
+  g_cache.reset();
+}
+
+void cache_store::init(const property_map &conf, bool create) {
+  auto c_conf = conf.get_child_optional("cache");
+  auto options = c_conf ? *c_conf : property_map();
+  auto write_policy = options.get<std::string>("write_policy", "through");
+  if (write_policy != "through" && write_policy != "around")
+    throw std::invalid_argument("Cache write_policy must be through or around: " + write_policy);
+  m_write_around = write_policy == "around";
+  {
+    std::lock_guard<std::mutex> lock(g_cache_mtx);
+    if (g_cache == nullptr) {
+      auto num_shards = options.get<size_t>("shards", 16);
+      if (num_shards == 0)
+        throw std::invalid_argument("Cache shards must be at least 1");
+      g_cache = std::make_shared<cache>(options.get<std::string>("eviction", "lru"),
+                                        options.get<size_t>("capacity", 64 * 1024 * 1024), num_shards);
+    }
+    m_cache = g_cache;
+  }
+  m_inner->init(conf, create);
+  m_receiver = std::thread(&cache_store::receive, this);
+}
+
+void cache_store::update(const std::string &key, const char *value, size_t length) {
+  if (m_write_around)
+    m_cache->erase(key);
+  else
+    m_cache->put(key, value, length);
+}
+
+void cache_store::write(const std::string &key, const std::string &value) {
+  m_inner->write(key, value);
+  update(key, value.data(), value.size());
+}
+
+std::string cache_store::read(const std::string &key) {
+  auto t_b = hr_clock::now_ns();
+  std::string value;
+  if (m_cache->get(key, value)) {
+    ++m_stats.hits;
+    m_stats.hit_ns.record(hr_clock::elapsed_ns(t_b, hr_clock::now_ns()));
+    return value;
+  }
+  ++m_stats.misses;
+  value = m_inner->read(key);
+  m_cache->put(key, value.data(), value.size());
+  m_stats.miss_ns.record(hr_clock::elapsed_ns(t_b, hr_clock::now_ns()));
+  return value;
+}
+
+void cache_store::destroy() {
+  m_cache->clear();
+  m_inner->destroy();
+}
+
+void cache_store::write_async(const std::string &key, const std::string &value) {
+  m_inner->write_async(key, value);
+  update(key, value.data(), value.size());
+}
+
+void cache_store::read_async(const std::string &key) {
+  pending_read r{key, hr_clock::now_ns(), false, ""};
+  r.hit = m_cache->get(key, r.value);
+  if (r.hit) {
+    ++m_stats.hits;
+    m_stats.hit_ns.record(hr_clock::elapsed_ns(r.start_ns, hr_clock::now_ns()));
+  } else {
+    ++m_stats.misses;
+    m_inner->read_async(key);
+  }
+  std::lock_guard<std::mutex> lock(m_mtx);
+  m_async_reads.push(std::move(r));
+}
+
+void cache_store::wait_write() {
+  m_inner->wait_write();
+}
+
+std::string cache_store::wait_read() {
+  pending_read r;
+  {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    r = std::move(m_async_reads.front());
+    m_async_reads.pop();
+  }
+  if (r.hit)
+    return r.value;
+  auto value = m_inner->wait_read();
+  m_cache->put(r.key, value.data(), value.size());
+  m_stats.miss_ns.record(hr_clock::elapsed_ns(r.start_ns, hr_clock::now_ns()));
+  return value;
+}
+
+void cache_store::write_slice(const std::string &key, const char *value, size_t length) {
+  m_inner->write_slice(key, value, length);
+  update(key, value, length);
+}
+
+void cache_store::write_slice_async(const std::string &key, const char *value, size_t length) {
+  m_inner->write_slice_async(key, value, length);
+  update(key, value, length);
+}
+
+void cache_store::submit_write(uint64_t tag, const std::string &key, const char *value, size_t length) {
+  // The cache is only updated once the backend has the value, as for write()
+  {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_submitted_writes[tag] = pending_write{key, value, length};
+    ++m_backend_outstanding;
+  }
+  m_backend_cv.notify_one();
+  m_inner->submit_write(tag, key, value, length);
+}
+
+void cache_store::submit_read(uint64_t tag, const std::string &key) {
+  auto t_b = hr_clock::now_ns();
+  std::string value;
+  if (m_cache->get(key, value)) {
+    ++m_stats.hits;
+    m_stats.hit_ns.record(hr_clock::elapsed_ns(t_b, hr_clock::now_ns()));
+    {
+      std::lock_guard<std::mutex> lock(m_mtx);
+      m_ready.push(completion{tag, true, std::move(value), ""});
+    }
+    m_ready_cv.notify_one();
+    return;
+  }
+  ++m_stats.misses;
+  {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_submitted_reads[tag] = pending_read{key, t_b, false, ""};
+    ++m_backend_outstanding;
+  }
+  m_backend_cv.notify_one();
+  m_inner->submit_read(tag, key);
+}
+
+storage_interface::completion cache_store::wait_completion() {
+  std::unique_lock<std::mutex> lock(m_mtx);
+  m_ready_cv.wait(lock, [this] { return !m_ready.empty(); });
+  auto c = std::move(m_ready.front());
+  m_ready.pop();
+  return c;
+}
+
+void cache_store::receive() {
+  std::unique_lock<std::mutex> lock(m_mtx);
+  while (true) {
+    m_backend_cv.wait(lock, [this] { return m_stop || m_backend_outstanding > 0; });
+    if (m_stop)
+      return;
+    --m_backend_outstanding;
+    lock.unlock();
+
+    auto c = m_inner->wait_completion();
+    lock.lock();
+    auto w = m_submitted_writes.find(c.tag);
+    if (w != m_submitted_writes.end()) {
+      auto write = std::move(w->second);
+      m_submitted_writes.erase(w);
+      lock.unlock();
+      if (c.ok)
+        update(write.key, write.value, write.length);
+      lock.lock();
+    }
+    auto it = m_submitted_reads.find(c.tag);
+    if (it != m_submitted_reads.end()) {
+      auto r = std::move(it->second);
+      m_submitted_reads.erase(it);
+      lock.unlock();
+      if (c.ok) {
+        m_cache->put(r.key, c.value.data(), c.value.size());
+        m_stats.miss_ns.record(hr_clock::elapsed_ns(r.start_ns, hr_clock::now_ns()));
+      }
+      lock.lock();
+    }
+    m_ready.push(std::move(c));
+    m_ready_cv.notify_one();
+  }
+}
+
+void cache_store::multi_read(const std::vector<std::string> &keys, std::vector<std::string> &values) {
+  auto t_b = hr_clock::now_ns();
+  values.resize(keys.size());
+  std::vector<size_t> missed;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (!m_cache->get(keys[i], values[i]))
+      missed.push_back(i);
+  }
+  m_stats.hits += keys.size() - missed.size();
+  m_stats.misses += missed.size();
+  if (missed.empty()) {
+    m_stats.hit_ns.record(hr_clock::elapsed_ns(t_b, hr_clock::now_ns()));
+    return;
+  }
+  // Only the keys that missed go to the backend, still as one batch
+  std::vector<std::string> missed_keys;
+  std::vector<std::string> missed_values;
+  for (auto i: missed)
+    missed_keys.push_back(keys[i]);
+  m_inner->multi_read(missed_keys, missed_values);
+  for (size_t j = 0; j < missed.size(); ++j) {
+    m_cache->put(missed_keys[j], missed_values[j].data(), missed_values[j].size());
+    values[missed[j]] = std::move(missed_values[j]);
+  }
+  m_stats.miss_ns.record(hr_clock::elapsed_ns(t_b, hr_clock::now_ns()));
+}
+
+void cache_store::multi_write(const std::vector<std::string> &keys, const std::vector<value_slice> &values) {
+  m_inner->multi_write(keys, values);
+  for (size_t i = 0; i < keys.size(); ++i)
+    update(keys[i], values[i].data, values[i].size);
+}
+
+REGISTER_STORAGE_DECORATOR("cache", cache_store);
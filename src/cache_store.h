@@ -0,0 +1,106 @@
+#ifndef STORAGE_BENCH_CACHE_STORE_H
+#define STORAGE_BENCH_CACHE_STORE_H
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+#include "storage_interface.h"
+#include "latency_histogram.h"
+
+/*
+ * Decorator that keeps a client-side cache of values in front of the backend it wraps, e.g. system=cache:dynamodb.
+ * Configured by the [cache] section:
+ *
+ *   capacity=67108864   bytes of keys and values to cache
+ *   eviction=lru        lru, clock or tinylfu (W-TinyLFU: a small LRU window in front of a segmented LRU, with a
+ *                       frequency sketch deciding which keys leaving the window displace the main region's victim)
+ *   write_policy=through   through updates the cached value on writes, around drops it so that only reads fill
+ *                          the cache
+ *   shards=16           independently locked parts of the cache, each with its share of the capacity
+ *
+ * All instances in a process share one cache. Reads that miss fill it with the value the backend returns.
+ *
+ * Submitted reads that hit complete without going to the backend. A receiver thread per instance waits for the
+ * backend's completions and queues them behind the hits, so wait_completion() hands back whichever is ready first
+ * and a hit never waits for a backend request submitted before it. Hit ratio, the latency of reads served from the
+ * cache and of those served by the backend are collected across all instances and printed when the last one goes
+ * away.
+ */
+class cache_store : public storage_interface {
+ public:
+  explicit cache_store(std::shared_ptr<storage_interface> inner);
+  ~cache_store();
+
+  void init(const property_map &conf, bool create) override;
+  void write(const std::string &key, const std::string &value) override;
+  std::string read(const std::string &key) override;
+  void destroy() override;
+  void write_async(const std::string &key, const std::string &value) override;
+  void read_async(const std::string &key) override;
+  void wait_write() override;
+  std::string wait_read() override;
+  void write_slice(const std::string &key, const char *value, size_t length) override;
+  void write_slice_async(const std::string &key, const char *value, size_t length) override;
+  void submit_write(uint64_t tag, const std::string &key, const char *value, size_t length) override;
+  void submit_read(uint64_t tag, const std::string &key) override;
+  completion wait_completion() override;
+  void multi_read(const std::vector<std::string> &keys, std::vector<std::string> &values) override;
+  void multi_write(const std::vector<std::string> &keys, const std::vector<value_slice> &values) override;
+
+  class cache;
+
+  struct stats {
+    size_t hits = 0;
+    size_t misses = 0;
+    latency_histogram hit_ns;
+    latency_histogram miss_ns;
+
+    void merge(const stats &other);
+  };
+
+ private:
+  // A read that went to the backend, or one answered from the cache in its place
+  struct pending_read {
+    std::string key;
+    uint64_t start_ns;
+    bool hit;
+    std::string value;
+  };
+
+  // A submitted write, which updates the cache once it completes; the caller keeps value valid until then
+  struct pending_write {
+    std::string key;
+    const char *value;
+    size_t length;
+  };
+
+  void update(const std::string &key, const char *value, size_t length);
+
+  // Body of the receiver thread: moves backend completions into m_ready while requests are outstanding, filling the
+  // cache from reads that missed and writes that succeeded
+  void receive();
+
+  std::shared_ptr<storage_interface> m_inner;
+  std::shared_ptr<cache> m_cache;
+  bool m_write_around;
+
+  // Requests may be submitted on one thread and waited for on another
+  std::mutex m_mtx;
+  std::condition_variable m_ready_cv;
+  std::condition_variable m_backend_cv;
+  std::queue<completion> m_ready;
+  std::unordered_map<uint64_t, pending_read> m_submitted_reads;
+  std::unordered_map<uint64_t, pending_write> m_submitted_writes;
+  size_t m_backend_outstanding;
+  std::queue<pending_read> m_async_reads;
+  bool m_stop;
+  std::thread m_receiver;
+
+  // Hits and misses are counted where reads are issued, backend latency by the receiver
+  stats m_stats;
+};
+
+#endif //STORAGE_BENCH_CACHE_STORE_H
@@ -0,0 +1,260 @@
+#include "compressed_store.h"
+
+#include <cstring>
+#include <limits>
+#include "hr_clock.h"
+
+// Statistics of the instances that are gone, printed when the last instance goes
+static std::mutex g_stats_mtx;
+static std::unique_ptr<compressed_store::stats> g_stats;
+static size_t g_instances = 0;
+
+void compressed_store::stats::merge(const stats &other) {
+  compressed_values += other.compressed_values;
+  raw_values += other.raw_values;
+  original_bytes += other.original_bytes;
+  stored_bytes += other.stored_bytes;
+  compress_ns.merge(other.compress_ns);
+  decompress_ns.merge(other.decompress_ns);
+  backend_write_ns.merge(other.backend_write_ns);
+  write_ns.merge(other.write_ns);
+  backend_read_ns.merge(other.backend_read_ns);
+  read_ns.merge(other.read_ns);
+}
+
+void compressed_store::stats::print(std::ostream &out) const {
+  auto ratio = stored_bytes > 0 ? static_cast<double>(original_bytes) / stored_bytes : 0.0;
+  out << "Compression: " << compressed_values << " values compressed, " << raw_values << " stored raw, "
+      << original_bytes << " bytes stored as " << stored_bytes << " (ratio " << ratio << ")" << std::endl;
+  auto summary = [&](const std::string &name, const latency_histogram &h) {
+    if (h.count() == 0)
+      return;
+    out << "Latency summary for " << name << " (count, p50, p90, p99, p99.9, max in ns): ";
+    h.write_summary(out);
+    out << std::endl;
+  };
+  summary("compression", compress_ns);
+  summary("decompression", decompress_ns);
+  summary("backend writes", backend_write_ns);
+  summary("writes with compression", write_ns);
+  summary("backend reads", backend_read_ns);
+  summary("reads with decompression", read_ns);
+}
+
+compressed_store::compressed_store(std::shared_ptr<storage_interface> inner)
+    : m_inner(std::move(inner)), m_level(Z_DEFAULT_COMPRESSION), m_min_size(0), m_streams_ready(false) {
+  std::lock_guard<std::mutex> lock(g_stats_mtx);
+  ++g_instances;
+}
+
+compressed_store::~compressed_store() {
+  if (m_streams_ready) {
+    deflateEnd(&m_deflate);
+    inflateEnd(&m_inflate);
+  }
+  std::lock_guard<std::mutex> lock(g_stats_mtx);
+  if (g_stats == nullptr)
+    g_stats.reset(new stats());
+  g_stats->merge(m_stats);
+  if (--g_instances == 0) {
+    if (g_stats->original_bytes > 0 || g_stats->read_ns.count() > 0)
+      g_stats->print(std::cerr);
+    g_stats.reset();
+  }
+}
+
+void compressed_store::init(const property_map &conf, bool create) {
+  auto c_conf = conf.get_child_optional("compress");
+  auto options = c_conf ? *c_conf : property_map();
+  m_level = options.get<int>("level", 6);
+  m_min_size = options.get<size_t>("min_size", 64);
+  if (m_level < 0 || m_level > 9)
+    throw std::invalid_argument("Compression level must be between 0 and 9");
+  if (!m_streams_ready) {
+    memset(&m_deflate, 0, sizeof(m_deflate));
+    memset(&m_inflate, 0, sizeof(m_inflate));
+    if (deflateInit(&m_deflate, m_level) != Z_OK)
+      throw std::runtime_error("zlib deflateInit failed");
+    if (inflateInit(&m_inflate) != Z_OK) {
+      deflateEnd(&m_deflate);
+      throw std::runtime_error("zlib inflateInit failed");
+    }
+    m_streams_ready = true;
+  }
+  m_inner->init(conf, create);
+}
+
+void compressed_store::encode(const char *value, size_t length, std::string &stored) {
+  if (length > std::numeric_limits<uint32_t>::max())
+    throw std::runtime_error("Value too large to compress: " + std::to_string(length) + " bytes");
+  auto t_b = hr_clock::now_ns();
+  auto original_size = static_cast<uint32_t>(length);
+  codec c = RAW;
+  if (length >= m_min_size) {
+    auto bound = deflateBound(&m_deflate, length);
+    stored.resize(HEADER_SIZE + bound);
+    deflateReset(&m_deflate);
+    m_deflate.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(value));
+    m_deflate.avail_in = static_cast<uInt>(length);
+    m_deflate.next_out = reinterpret_cast<Bytef *>(&stored[HEADER_SIZE]);
+    m_deflate.avail_out = static_cast<uInt>(bound);
+    auto ret = deflate(&m_deflate, Z_FINISH);
+    if (ret != Z_STREAM_END)
+      throw std::runtime_error("zlib compression failed: " + std::to_string(ret));
+    auto compressed_size = m_deflate.total_out;
+    // Values that do not shrink are not worth decompressing
+    if (compressed_size < length) {
+      stored.resize(HEADER_SIZE + compressed_size);
+      c = ZLIB;
+    }
+  }
+  if (c == RAW) {
+    stored.resize(HEADER_SIZE + length);
+    memcpy(&stored[HEADER_SIZE], value, length);
+    ++m_stats.raw_values;
+  } else {
+    ++m_stats.compressed_values;
+  }
+  stored[0] = c;
+  memcpy(&stored[1], &original_size, sizeof(original_size));
+  m_stats.original_bytes += length;
+  m_stats.stored_bytes += stored.size();
+  m_stats.compress_ns.record(hr_clock::elapsed_ns(t_b, hr_clock::now_ns()));
+}
+
+std::string compressed_store::decode(const std::string &stored) {
+  auto t_b = hr_clock::now_ns();
+  if (stored.size() < HEADER_SIZE)
+    throw std::runtime_error("Value is not compressed_store encoded");
+  uint32_t original_size;
+  memcpy(&original_size, &stored[1], sizeof(original_size));
+  std::string value;
+  if (stored[0] == RAW) {
+    value.assign(stored, HEADER_SIZE, std::string::npos);
+  } else if (stored[0] == ZLIB) {
+    value.resize(original_size);
+    inflateReset(&m_inflate);
+    m_inflate.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(&stored[HEADER_SIZE]));
+    m_inflate.avail_in = static_cast<uInt>(stored.size() - HEADER_SIZE);
+    m_inflate.next_out = reinterpret_cast<Bytef *>(&value[0]);
+    m_inflate.avail_out = original_size;
+    auto ret = inflate(&m_inflate, Z_FINISH);
+    if (ret != Z_STREAM_END || m_inflate.total_out != original_size)
+      throw std::runtime_error("zlib decompression failed: " + std::to_string(ret));
+  } else {
+    throw std::runtime_error("Value is not compressed_store encoded");
+  }
+  m_stats.decompress_ns.record(hr_clock::elapsed_ns(t_b, hr_clock::now_ns()));
+  return value;
+}
+
+void compressed_store::write(const std::string &key, const std::string &value) {
+  write_slice(key, value.data(), value.size());
+}
+
+std::string compressed_store::read(const std::string &key) {
+  auto t_b = hr_clock::now_ns();
+  auto stored = m_inner->read(key);
+  m_stats.backend_read_ns.record(hr_clock::elapsed_ns(t_b, hr_clock::now_ns()));
+  auto value = decode(stored);
+  m_stats.read_ns.record(hr_clock::elapsed_ns(t_b, hr_clock::now_ns()));
+  return value;
+}
+
+void compressed_store::destroy() {
+  m_inner->destroy();
+}
+
+void compressed_store::write_async(const std::string &key, const std::string &value) {
+  write_slice_async(key, value.data(), value.size());
+}
+
+void compressed_store::read_async(const std::string &key) {
+  m_inner->read_async(key);
+}
+
+void compressed_store::wait_write() {
+  m_inner->wait_write();
+  std::lock_guard<std::mutex> lock(m_mtx);
+  m_async_writes.pop();
+}
+
+std::string compressed_store::wait_read() {
+  return decode(m_inner->wait_read());
+}
+
+void compressed_store::write_slice(const std::string &key, const char *value, size_t length) {
+  auto t_b = hr_clock::now_ns();
+  std::string stored;
+  encode(value, length, stored);
+  auto t_c = hr_clock::now_ns();
+  m_inner->write_slice(key, stored.data(), stored.size());
+  auto t_e = hr_clock::now_ns();
+  m_stats.backend_write_ns.record(hr_clock::elapsed_ns(t_c, t_e));
+  m_stats.write_ns.record(hr_clock::elapsed_ns(t_b, t_e));
+}
+
+void compressed_store::write_slice_async(const std::string &key, const char *value, size_t length) {
+  std::string stored;
+  encode(value, length, stored);
+  const std::string *buffer;
+  {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_async_writes.push(std::move(stored));
+    buffer = &m_async_writes.back();
+  }
+  m_inner->write_slice_async(key, buffer->data(), buffer->size());
+}
+
+void compressed_store::submit_write(uint64_t tag, const std::string &key, const char *value, size_t length) {
+  std::string stored;
+  encode(value, length, stored);
+  const std::string *buffer;
+  {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    auto &entry = m_submitted_writes[tag];
+    entry = std::move(stored);
+    buffer = &entry;
+  }
+  m_inner->submit_write(tag, key, buffer->data(), buffer->size());
+}
+
+void compressed_store::submit_read(uint64_t tag, const std::string &key) {
+  m_inner->submit_read(tag, key);
+}
+
+storage_interface::completion compressed_store::wait_completion() {
+  auto c = m_inner->wait_completion();
+  {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    if (m_submitted_writes.erase(c.tag) > 0)
+      return c;
+  }
+  if (c.ok) {
+    try {
+      c.value = decode(c.value);
+    } catch (std::runtime_error &e) {
+      c.ok = false;
+      c.error = e.what();
+    }
+  }
+  return c;
+}
+
+void compressed_store::multi_read(const std::vector<std::string> &keys, std::vector<std::string> &values) {
+  m_inner->multi_read(keys, values);
+  for (auto &value: values)
+    value = decode(value);
+}
+
+void compressed_store::multi_write(const std::vector<std::string> &keys, const std::vector<value_slice> &values) {
+  std::vector<std::string> stored(values.size());
+  std::vector<value_slice> slices(values.size());
+  for (size_t i = 0; i < values.size(); ++i) {
+    encode(values[i].data, values[i].size, stored[i]);
+    slices[i] = value_slice{stored[i].data(), stored[i].size()};
+  }
+  m_inner->multi_write(keys, slices);
+}
+
+REGISTER_STORAGE_DECORATOR("compress", compressed_store);
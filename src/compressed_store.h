@@ -0,0 +1,95 @@
+#ifndef STORAGE_BENCH_COMPRESSED_STORE_H
+#define STORAGE_BENCH_COMPRESSED_STORE_H
+
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <unordered_map>
+#include <zlib.h>
+#include "storage_interface.h"
+#include "latency_histogram.h"
+
+/*
+ * Decorator that compresses values with zlib on their way to the backend it wraps and decompresses them on the
+ * way back, e.g. system=compress:s3. Configured by the [compress] section:
+ *
+ *   level=6        zlib compression level, 0 (store only) to 9
+ *   min_size=64    values smaller than this are stored uncompressed
+ *
+ * Every stored value starts with a header naming its codec and original size, so values that do not shrink are
+ * stored raw too. Values written without the decorator cannot be read through it, and neither can the values of
+ * backends that do not keep what was written, such as emulated.
+ *
+ * The compression ratio, the time spent compressing and decompressing, and the latency of the backend alone and
+ * of sync ops including compression are collected across all instances and printed when the last one goes away.
+ */
+class compressed_store : public storage_interface {
+ public:
+  explicit compressed_store(std::shared_ptr<storage_interface> inner);
+  ~compressed_store();
+
+  void init(const property_map &conf, bool create) override;
+  void write(const std::string &key, const std::string &value) override;
+  std::string read(const std::string &key) override;
+  void destroy() override;
+  void write_async(const std::string &key, const std::string &value) override;
+  void read_async(const std::string &key) override;
+  void wait_write() override;
+  std::string wait_read() override;
+  void write_slice(const std::string &key, const char *value, size_t length) override;
+  void write_slice_async(const std::string &key, const char *value, size_t length) override;
+  void submit_write(uint64_t tag, const std::string &key, const char *value, size_t length) override;
+  void submit_read(uint64_t tag, const std::string &key) override;
+  completion wait_completion() override;
+  void multi_read(const std::vector<std::string> &keys, std::vector<std::string> &values) override;
+  void multi_write(const std::vector<std::string> &keys, const std::vector<value_slice> &values) override;
+
+  struct stats {
+    size_t compressed_values = 0;
+    size_t raw_values = 0;
+    size_t original_bytes = 0;
+    size_t stored_bytes = 0;
+    latency_histogram compress_ns;
+    latency_histogram decompress_ns;
+    latency_histogram backend_write_ns;
+    latency_histogram write_ns;
+    latency_histogram backend_read_ns;
+    latency_histogram read_ns;
+
+    void merge(const stats &other);
+    void print(std::ostream &out) const;
+  };
+
+ private:
+  enum codec : char {
+    RAW = 0,
+    ZLIB = 1
+  };
+
+  // Codec (1 byte) and original size (4 bytes)
+  static const size_t HEADER_SIZE = 5;
+
+  void encode(const char *value, size_t length, std::string &stored);
+  std::string decode(const std::string &stored);
+
+  std::shared_ptr<storage_interface> m_inner;
+  int m_level;
+  size_t m_min_size;
+
+  // Set up once by init() and reset between values, since setting a stream up costs far more than compressing a
+  // small value. encode() and decode() are on different paths, so each has its own
+  bool m_streams_ready;
+  z_stream m_deflate;
+  z_stream m_inflate;
+
+  // Encoded values of writes in flight, which must outlive them
+  std::mutex m_mtx;
+  std::queue<std::string> m_async_writes;
+  std::unordered_map<uint64_t, std::string> m_submitted_writes;
+
+  // Writes and decompression may happen on different threads for async requests, so each path keeps to its own
+  // fields
+  stats m_stats;
+};
+
+#endif //STORAGE_BENCH_COMPRESSED_STORE_H
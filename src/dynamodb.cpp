@@ -11,6 +11,9 @@
 #include <aws/dynamodb/model/ScanRequest.h>
 #include <aws/dynamodb/model/UpdateItemRequest.h>
 #include <aws/dynamodb/model/DeleteItemRequest.h>
+#include <aws/dynamodb/model/BatchGetItemRequest.h>
+#include <aws/dynamodb/model/BatchWriteItemRequest.h>
+#include <unordered_map>
 
 using namespace Aws::Auth;
 using namespace Aws::Http;
@@ -84,6 +87,130 @@ std::string dynamodb::wait_read() {
   return parse_get_response(m_get_callables.pop().get());
 }
 
+void dynamodb::submit_write(uint64_t tag, const std::string &key, const char *value, size_t length) {
+  m_client->PutItemAsync(make_put_request(key, std::string(value, length)),
+                         [this, tag](const DynamoDBClient *, const PutItemRequest &, const PutItemOutcome &outcome,
+                                     const std::shared_ptr<const AsyncCallerContext> &) {
+                           m_completions.push(make_completion(tag, [&]() {
+                             parse_put_response(outcome);
+                             return std::string();
+                           }));
+                         });
+}
+
+void dynamodb::submit_read(uint64_t tag, const std::string &key) {
+  m_client->GetItemAsync(make_get_request(key),
+                         [this, tag](const DynamoDBClient *, const GetItemRequest &, const GetItemOutcome &outcome,
+                                     const std::shared_ptr<const AsyncCallerContext> &) {
+                           m_completions.push(make_completion(tag, [&]() { return parse_get_response(outcome); }));
+                         });
+}
+
+storage_interface::completion dynamodb::wait_completion() {
+  return m_completions.pop();
+}
+
+void dynamodb::multi_read(const std::vector<std::string> &keys, std::vector<std::string> &values) {
+  // DynamoDB rejects batches that name a key twice, so each distinct key is fetched once
+  std::unordered_map<std::string, std::vector<size_t>> positions;
+  std::vector<const std::string *> distinct_keys;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    auto &p = positions[keys[i]];
+    if (p.empty())
+      distinct_keys.push_back(&keys[i]);
+    p.push_back(i);
+  }
+
+  values.resize(keys.size());
+  size_t found = 0;
+  for (size_t begin = 0; begin < distinct_keys.size(); begin += MAX_BATCH_GET) {
+    KeysAndAttributes batch;
+    for (size_t i = begin; i < std::min(begin + MAX_BATCH_GET, distinct_keys.size()); ++i) {
+      AttributeValue key_attr;
+      key_attr.SetS(distinct_keys[i]->c_str());
+      Aws::Map<Aws::String, AttributeValue> key;
+      key[HASH_KEY_NAME] = key_attr;
+      batch.AddKeys(key);
+    }
+    batch.AddAttributesToGet(HASH_KEY_NAME);
+    batch.AddAttributesToGet(VALUE_NAME);
+    BatchGetItemRequest request;
+    request.AddRequestItems(m_table_name, batch);
+
+    for (int attempt = 0;; ++attempt) {
+      auto outcome = m_client->BatchGetItem(request);
+      if (!outcome.IsSuccess())
+        throw std::runtime_error(outcome.GetError().GetMessage().c_str());
+      const auto &result = outcome.GetResult();
+      auto responses = result.GetResponses().find(m_table_name);
+      if (responses != result.GetResponses().end()) {
+        for (const auto &item: responses->second) {
+          const auto &value = item.at(VALUE_NAME).GetS();
+          for (auto i: positions.at(item.at(HASH_KEY_NAME).GetS().c_str()))
+            values[i].assign(value.data(), value.size());
+          ++found;
+        }
+      }
+      if (result.GetUnprocessedKeys().empty())
+        break;
+      if (attempt == MAX_BATCH_RETRIES)
+        throw std::runtime_error("BatchGetItem left keys unprocessed after retrying");
+      backoff(attempt);
+      request.SetRequestItems(result.GetUnprocessedKeys());
+    }
+  }
+  if (found != distinct_keys.size())
+    throw std::runtime_error("BatchGetItem found " + std::to_string(found) + " of "
+                                 + std::to_string(distinct_keys.size()) + " keys");
+}
+
+void dynamodb::multi_write(const std::vector<std::string> &keys, const std::vector<value_slice> &values) {
+  // DynamoDB rejects batches that name a key twice, so only the last value written to each key is sent
+  std::unordered_map<std::string, size_t> last_write;
+  for (size_t i = 0; i < keys.size(); ++i)
+    last_write[keys[i]] = i;
+
+  std::vector<size_t> writes;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (last_write.at(keys[i]) == i)
+      writes.push_back(i);
+  }
+
+  for (size_t begin = 0; begin < writes.size(); begin += MAX_BATCH_WRITE) {
+    Aws::Vector<WriteRequest> batch;
+    for (size_t j = begin; j < std::min(begin + MAX_BATCH_WRITE, writes.size()); ++j) {
+      auto i = writes[j];
+      PutRequest put;
+      AttributeValue key_attr;
+      key_attr.SetS(keys[i].c_str());
+      put.AddItem(HASH_KEY_NAME, key_attr);
+      AttributeValue value_attr;
+      value_attr.SetS(Aws::String(values[i].data, values[i].size));
+      put.AddItem(VALUE_NAME, value_attr);
+      batch.push_back(WriteRequest().WithPutRequest(put));
+    }
+    BatchWriteItemRequest request;
+    request.AddRequestItems(m_table_name, batch);
+
+    for (int attempt = 0;; ++attempt) {
+      auto outcome = m_client->BatchWriteItem(request);
+      if (!outcome.IsSuccess())
+        throw std::runtime_error(outcome.GetError().GetMessage().c_str());
+      const auto &unprocessed = outcome.GetResult().GetUnprocessedItems();
+      if (unprocessed.empty())
+        break;
+      if (attempt == MAX_BATCH_RETRIES)
+        throw std::runtime_error("BatchWriteItem left items unprocessed after retrying");
+      backoff(attempt);
+      request.SetRequestItems(unprocessed);
+    }
+  }
+}
+
+void dynamodb::backoff(int attempt) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(10 << attempt));
+}
+
 PutItemRequest dynamodb::make_put_request(const std::string &key, const std::string &value) const {
   PutItemRequest request;
   request.SetTableName(m_table_name);
@@ -11,6 +11,11 @@ class dynamodb: public storage_interface {
  public:
   static constexpr const char *HASH_KEY_NAME = "HashKey";
   static constexpr const char *VALUE_NAME = "Value";
+  // Limits DynamoDB puts on a single BatchGetItem/BatchWriteItem request
+  static const size_t MAX_BATCH_GET = 100;
+  static const size_t MAX_BATCH_WRITE = 25;
+  // Times a batch is resent for the items DynamoDB left unprocessed, backing off exponentially
+  static const int MAX_BATCH_RETRIES = 8;
 
   dynamodb();
   ~dynamodb();
@@ -23,10 +28,16 @@ class dynamodb: public storage_interface {
   void read_async(const std::string &key) override;
   void wait_write() override;
   std::string wait_read() override;
+  void submit_write(uint64_t tag, const std::string &key, const char *value, size_t length) override;
+  void submit_read(uint64_t tag, const std::string &key) override;
+  completion wait_completion() override;
+  void multi_read(const std::vector<std::string> &keys, std::vector<std::string> &values) override;
+  void multi_write(const std::vector<std::string> &keys, const std::vector<value_slice> &values) override;
 
  private:
   void create_table(long long read_capacity, long long write_capacity);
   void wait_for_table();
+  static void backoff(int attempt);
 
   Aws::DynamoDB::Model::PutItemRequest make_put_request(const std::string &key, const std::string &value) const;
   Aws::DynamoDB::Model::GetItemRequest make_get_request(const std::string &key) const;
@@ -35,6 +46,8 @@ class dynamodb: public storage_interface {
 
   queue<Aws::DynamoDB::Model::PutItemOutcomeCallable> m_put_callables;
   queue<Aws::DynamoDB::Model::GetItemOutcomeCallable> m_get_callables;
+  // Pushed by the client's async response handlers
+  queue<completion> m_completions;
   Aws::String m_table_name;
   std::shared_ptr<Aws::DynamoDB::DynamoDBClient> m_client;
 };
@@ -0,0 +1,505 @@
+#include "emulated.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "benchmark_utils.h"
+#include "hr_clock.h"
+#include "result_file.h"
+
+// Service times, in ns, drawn from a parametric distribution or resampled from recorded latencies
+class latency_distribution {
+ public:
+  explicit latency_distribution(const std::string &spec, bool read) {
+    std::vector<std::string> args;
+    benchmark_utils::split(spec, args, ':');
+    auto param = [&](size_t i) {
+      if (i >= args.size())
+        throw std::invalid_argument("Missing parameter in latency model " + spec);
+      return std::stod(args[i]);
+    };
+    if (args.empty()) {
+      throw std::invalid_argument("Empty latency model");
+    } else if (args[0] == "fixed") {
+      m_type = FIXED;
+      m_a = param(1) * 1000.0;
+    } else if (args[0] == "uniform") {
+      m_type = UNIFORM;
+      m_a = param(1) * 1000.0;
+      m_b = param(2) * 1000.0;
+    } else if (args[0] == "exponential") {
+      m_type = EXPONENTIAL;
+      m_a = param(1) * 1000.0;
+    } else if (args[0] == "lognormal") {
+      m_type = LOGNORMAL;
+      m_a = std::log(param(1) * 1000.0);
+      m_b = param(2);
+    } else {
+      m_type = EMPIRICAL;
+      load(spec, read);
+    }
+  }
+
+  uint64_t sample(std::mt19937_64 &rng) const {
+    double ns = 0;
+    switch (m_type) {
+      case FIXED:
+        ns = m_a;
+        break;
+      case UNIFORM:
+        ns = std::uniform_real_distribution<double>(m_a, m_b)(rng);
+        break;
+      case EXPONENTIAL:
+        ns = std::exponential_distribution<double>(1.0 / m_a)(rng);
+        break;
+      case LOGNORMAL:
+        ns = std::lognormal_distribution<double>(m_a, m_b)(rng);
+        break;
+      case EMPIRICAL:
+      {
+        auto i = std::uniform_int_distribution<uint64_t>(0, m_cumulative.back() - 1)(rng);
+        return m_samples[std::upper_bound(m_cumulative.begin(), m_cumulative.end(), i) - m_cumulative.begin()];
+      }
+    }
+    return static_cast<uint64_t>(std::max(ns, 0.0));
+  }
+
+ private:
+  // Successful reads, or successful writes of any kind, from a results file; every sample in a text file
+  void load(const std::string &path, bool read) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+      throw std::invalid_argument("Could not open latency file " + path);
+    char magic[8] = {};
+    in.read(magic, sizeof(magic));
+    if (in && std::memcmp(magic, result_file::MAGIC, sizeof(magic)) == 0) {
+      result_file f;
+      f.read(path);
+      auto latency = f.integer_values("latency_ns");
+      std::vector<uint64_t> op, status;
+      if (f.has_column("op_status")) {
+        op = f.integer_values("op_status");
+        for (auto &o: op) {
+          status.push_back(o >> record_buffer::STATUS_SHIFT);
+          o &= record_buffer::OP_MASK;
+        }
+      } else {
+        // Version 1 files kept them apart
+        op = f.integer_values("op");
+        status = f.integer_values("status");
+      }
+      for (size_t i = 0; i < latency.size(); ++i) {
+        bool is_read = op[i] == record_buffer::OP_READ || op[i] == record_buffer::OP_SCAN;
+        if (status[i] == record_buffer::STATUS_OK && is_read == read)
+          add(latency[i], 1);
+      }
+    } else {
+      in.clear();
+      in.seekg(0);
+      std::string line;
+      while (std::getline(in, line)) {
+        std::vector<std::string> fields;
+        benchmark_utils::split(line, fields, '\t');
+        if (fields.size() == 2) {
+          // <timestamp>\t<latency_us>, one line per op
+          add(static_cast<uint64_t>(std::stod(fields[1]) * 1000.0), 1);
+        } else if (fields.size() == 3) {
+          // Histogram: <latency_ns>\t<count>\t<cumulative fraction>
+          add(std::stoull(fields[0]), std::stoull(fields[1]));
+        } else if (!fields.empty()) {
+          throw std::invalid_argument("Unrecognized line in latency file " + path + ": " + line);
+        }
+      }
+    }
+    if (m_samples.empty())
+      throw std::invalid_argument("No " + std::string(read ? "read" : "write") + " latencies in " + path);
+  }
+
+  void add(uint64_t latency_ns, uint64_t count) {
+    if (count == 0)
+      return;
+    m_samples.push_back(latency_ns);
+    m_cumulative.push_back((m_cumulative.empty() ? 0 : m_cumulative.back()) + count);
+  }
+
+  enum {
+    FIXED,
+    UNIFORM,
+    EXPONENTIAL,
+    LOGNORMAL,
+    EMPIRICAL
+  } m_type;
+  double m_a{0};
+  double m_b{0};
+  // Recorded latencies, each with the running total of their counts
+  std::vector<uint64_t> m_samples;
+  std::vector<uint64_t> m_cumulative;
+};
+
+// Capacity and concurrency state in a POSIX shared memory segment, so that every process on the host that names
+// the same segment queues behind the same store. The first process creates it and the others attach.
+class shared_queue {
+ public:
+  shared_queue(const std::string &name, size_t num_servers) : m_name(name) {
+    size_t size = sizeof(layout) + num_servers * sizeof(uint64_t);
+    int fd = shm_open(m_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd >= 0) {
+      if (ftruncate(fd, static_cast<off_t>(size)) != 0)
+        fail("Failed to size");
+      map(fd, size);
+      pthread_mutexattr_t attr;
+      pthread_mutexattr_init(&attr);
+      pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+      // A process that dies while holding the lock must not stall the others
+      pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+      pthread_mutex_init(&m_layout->mtx, &attr);
+      pthread_mutexattr_destroy(&attr);
+      m_layout->next_start = 0;
+      m_layout->num_servers = num_servers;
+      std::fill(servers(), servers() + num_servers, 0);
+      m_layout->magic.store(MAGIC, std::memory_order_release);
+    } else if (errno == EEXIST) {
+      attach();
+      if (m_layout->num_servers != num_servers)
+        std::cerr << "WARN Shared emulated store " << m_name << " has concurrency " << m_layout->num_servers
+                  << "; destroy it to change that" << std::endl;
+    } else {
+      fail("Failed to create");
+    }
+  }
+
+  ~shared_queue() {
+    munmap(m_layout, m_size);
+  }
+
+  void lock() {
+    if (pthread_mutex_lock(&m_layout->mtx) == EOWNERDEAD)
+      pthread_mutex_consistent(&m_layout->mtx);
+  }
+
+  void unlock() {
+    pthread_mutex_unlock(&m_layout->mtx);
+  }
+
+  double &next_start() {
+    return m_layout->next_start;
+  }
+
+  uint64_t *servers() {
+    return reinterpret_cast<uint64_t *>(m_layout + 1);
+  }
+
+  size_t num_servers() const {
+    return m_layout->num_servers;
+  }
+
+  void unlink() {
+    shm_unlink(m_name.c_str());
+  }
+
+ private:
+  static const uint64_t MAGIC = 0x5342454d51554531;
+
+  struct layout {
+    std::atomic<uint64_t> magic;
+    pthread_mutex_t mtx;
+    double next_start;
+    uint64_t num_servers;
+    // Followed by num_servers server free times
+  };
+
+  void attach() {
+    // The creator may still be setting the segment up
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    while (true) {
+      int fd = shm_open(m_name.c_str(), O_RDWR, 0600);
+      struct stat st{};
+      if (fd >= 0 && fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(layout)) {
+        map(fd, static_cast<size_t>(st.st_size));
+        if (m_layout->magic.load(std::memory_order_acquire) == MAGIC)
+          return;
+        munmap(m_layout, m_size);
+      } else if (fd >= 0) {
+        close(fd);
+      }
+      if (std::chrono::steady_clock::now() > deadline)
+        fail("Timed out attaching to");
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+
+  // Maps size bytes of fd and closes it
+  void map(int fd, size_t size) {
+    auto base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED)
+      fail("Failed to map");
+    close(fd);
+    m_layout = static_cast<layout *>(base);
+    m_size = size;
+  }
+
+  void fail(const std::string &what) const {
+    throw std::runtime_error(what + " shared emulated store " + m_name + ": " + std::strerror(errno));
+  }
+
+  std::string m_name;
+  layout *m_layout = nullptr;
+  size_t m_size = 0;
+};
+
+class emulated::model {
+ public:
+  explicit model(const property_map &conf)
+      : m_read(conf.get<std::string>("read_latency", "fixed:1000"), true),
+        m_write(conf.get<std::string>("write_latency", "fixed:1000"), false),
+        m_next_start(0),
+        m_rng(conf.get<uint64_t>("seed", std::random_device()())),
+        m_default_size(conf.get<size_t>("default_value_size", 0)) {
+    auto capacity = conf.get<double>("capacity", 0);
+    m_interval_ns = capacity > 0 ? 1e9 / capacity : 0;
+    m_servers.assign(conf.get<size_t>("concurrency", 0), 0);
+    auto on_overload = conf.get<std::string>("on_overload", "queue");
+    if (on_overload != "queue" && on_overload != "reject")
+      throw std::invalid_argument("on_overload must be queue or reject: " + on_overload);
+    m_reject = on_overload == "reject";
+    m_max_queue_delay_ns = static_cast<uint64_t>(conf.get<double>("max_queue_delay_us", 0) * 1000.0);
+    auto shared = conf.get<std::string>("shared_state", "");
+    if (!shared.empty())
+      m_shared.reset(new shared_queue(shared, m_servers.size()));
+  }
+
+  // When an op that arrives at now_ns completes, or 0 if it is rejected
+  uint64_t schedule(bool read, uint64_t now_ns) {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    if (m_shared != nullptr)
+      m_shared->lock();
+    auto &next_start = m_shared != nullptr ? m_shared->next_start() : m_next_start;
+    // servers is a min-heap of the times at which each server becomes free
+    auto servers = m_shared != nullptr ? m_shared->servers() : m_servers.data();
+    auto servers_end = servers + (m_shared != nullptr ? m_shared->num_servers() : m_servers.size());
+    double start = std::max(static_cast<double>(now_ns), next_start);
+    if (servers != servers_end)
+      start = std::max(start, static_cast<double>(*servers));
+    uint64_t due = 0;
+    if (!m_reject || start - now_ns <= m_max_queue_delay_ns) {
+      next_start = start + m_interval_ns;
+      due = static_cast<uint64_t>(start) + (read ? m_read : m_write).sample(m_rng);
+      if (servers != servers_end) {
+        std::pop_heap(servers, servers_end, std::greater<uint64_t>());
+        *(servers_end - 1) = due;
+        std::push_heap(servers, servers_end, std::greater<uint64_t>());
+      }
+    }
+    if (m_shared != nullptr)
+      m_shared->unlock();
+    return due;
+  }
+
+  void put(const std::string &key, size_t length) {
+    std::lock_guard<std::mutex> lock(m_data_mtx);
+    m_sizes[key] = length;
+  }
+
+  bool get(const std::string &key, size_t &length) {
+    std::lock_guard<std::mutex> lock(m_data_mtx);
+    auto it = m_sizes.find(key);
+    if (it == m_sizes.end()) {
+      length = m_default_size;
+      return m_default_size > 0;
+    }
+    length = it->second;
+    return true;
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock(m_data_mtx);
+    m_sizes.clear();
+    if (m_shared != nullptr)
+      m_shared->unlink();
+  }
+
+ private:
+  latency_distribution m_read;
+  latency_distribution m_write;
+  double m_interval_ns;
+  // Earliest time the next op may start under the capacity limit
+  double m_next_start;
+  std::vector<uint64_t> m_servers;
+  // Replaces m_next_start and m_servers if the state is shared with other processes
+  std::unique_ptr<shared_queue> m_shared;
+  bool m_reject;
+  uint64_t m_max_queue_delay_ns;
+  std::mt19937_64 m_rng;
+  std::mutex m_mtx;
+
+  // Size of the value read for keys that were never written; 0 if reading them fails
+  size_t m_default_size;
+  std::unordered_map<std::string, size_t> m_sizes;
+  std::mutex m_data_mtx;
+};
+
+// The model all instances in the process share; created by the first init()
+static std::shared_ptr<emulated::model> g_model;
+static std::mutex g_model_mtx;
+
+emulated::emulated() : m_stop(false) {}
+
+emulated::~emulated() {
+  {
+    std::lock_guard<std::mutex> lock(m_timer_mtx);
+    m_stop = true;
+  }
+  m_timer_cond.notify_one();
+  if (m_timer.joinable())
+    m_timer.join();
+}
+
+void emulated::init(const property_map &conf, bool) {
+  {
+    std::lock_guard<std::mutex> lock(g_model_mtx);
+    if (g_model == nullptr)
+      g_model = std::make_shared<model>(conf);
+    m_model = g_model;
+  }
+  m_timer = std::thread(&emulated::deliver, this);
+}
+
+void emulated::write(const std::string &key, const std::string &value) {
+  write_slice(key, value.data(), value.length());
+}
+
+std::string emulated::read(const std::string &key) {
+  auto t = execute(0, true, key, 0);
+  sleep_until(t.due_ns);
+  if (!t.c.ok)
+    throw std::runtime_error(t.c.error);
+  return std::move(t.c.value);
+}
+
+void emulated::destroy() {
+  m_model->clear();
+}
+
+void emulated::write_async(const std::string &key, const std::string &value) {
+  write_slice_async(key, value.data(), value.length());
+}
+
+void emulated::read_async(const std::string &key) {
+  m_read_results.push(execute(0, true, key, 0));
+}
+
+void emulated::wait_write() {
+  auto t = std::move(m_write_results.front());
+  m_write_results.pop();
+  sleep_until(t.due_ns);
+  complete(t);
+  if (!t.c.ok)
+    throw std::runtime_error(t.c.error);
+}
+
+std::string emulated::wait_read() {
+  auto t = std::move(m_read_results.front());
+  m_read_results.pop();
+  sleep_until(t.due_ns);
+  if (!t.c.ok)
+    throw std::runtime_error(t.c.error);
+  return std::move(t.c.value);
+}
+
+void emulated::write_slice(const std::string &key, const char *, size_t length) {
+  auto t = execute(0, false, key, length);
+  sleep_until(t.due_ns);
+  complete(t);
+  if (!t.c.ok)
+    throw std::runtime_error(t.c.error);
+}
+
+void emulated::write_slice_async(const std::string &key, const char *, size_t length) {
+  m_write_results.push(execute(0, false, key, length));
+}
+
+void emulated::submit_write(uint64_t tag, const std::string &key, const char *, size_t length) {
+  auto t = execute(tag, false, key, length);
+  std::lock_guard<std::mutex> lock(m_timer_mtx);
+  m_timers.push(std::move(t));
+  m_timer_cond.notify_one();
+}
+
+void emulated::submit_read(uint64_t tag, const std::string &key) {
+  auto t = execute(tag, true, key, 0);
+  std::lock_guard<std::mutex> lock(m_timer_mtx);
+  m_timers.push(std::move(t));
+  m_timer_cond.notify_one();
+}
+
+storage_interface::completion emulated::wait_completion() {
+  return m_completions.pop();
+}
+
+emulated::timed_completion emulated::execute(uint64_t tag, bool read, const std::string &key, size_t length) {
+  auto now = hr_clock::now_ns();
+  timed_completion t{m_model->schedule(read, now), completion{tag, true, "", ""}, "", 0};
+  if (t.due_ns == 0) {
+    t.due_ns = now;
+    t.c.ok = false;
+    t.c.error = "Request throttled: the emulated store is over capacity";
+  } else if (!read) {
+    t.written_key = key;
+    t.written_length = length;
+  } else if (m_model->get(key, length)) {
+    t.c.value.assign(length, '\0');
+  } else {
+    t.c.ok = false;
+    t.c.error = "No such key: " + key;
+  }
+  return t;
+}
+
+void emulated::complete(const timed_completion &t) {
+  if (t.c.ok && !t.written_key.empty())
+    m_model->put(t.written_key, t.written_length);
+}
+
+void emulated::deliver() {
+  std::unique_lock<std::mutex> lock(m_timer_mtx);
+  while (!m_stop) {
+    if (m_timers.empty()) {
+      m_timer_cond.wait(lock);
+      continue;
+    }
+    auto now = hr_clock::now_ns();
+    if (m_timers.top().due_ns > now) {
+      m_timer_cond.wait_for(lock, std::chrono::nanoseconds(m_timers.top().due_ns - now));
+      continue;
+    }
+    auto t = m_timers.top();
+    m_timers.pop();
+    lock.unlock();
+    complete(t);
+    m_completions.push(std::move(t.c));
+    lock.lock();
+  }
+}
+
+void emulated::sleep_until(uint64_t due_ns) {
+  // Sleeps overshoot by tens of microseconds, so the tail of the wait is spent spinning
+  const uint64_t spin_ns = 50000;
+  auto now = hr_clock::now_ns();
+  if (due_ns > now + spin_ns)
+    std::this_thread::sleep_for(std::chrono::nanoseconds(due_ns - now - spin_ns));
+  while (hr_clock::now_ns() < due_ns);
+}
+
+REGISTER_STORAGE_IFACE("emulated", emulated);
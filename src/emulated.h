@@ -0,0 +1,86 @@
+#ifndef STORAGE_BENCH_EMULATED_H
+#define STORAGE_BENCH_EMULATED_H
+
+#include <condition_variable>
+#include <functional>
+#include <queue>
+#include <thread>
+#include "storage_interface.h"
+#include "queue.h"
+
+/*
+ * Backend that stores nothing but value sizes and answers every request after a delay drawn from a latency
+ * model, so that large fan-out experiments can be developed offline at full scale.
+ *
+ * read_latency and write_latency each name either a distribution (fixed:<us>, uniform:<min_us>:<max_us>,
+ * exponential:<mean_us> or lognormal:<median_us>:<sigma>) or the results of an earlier run to resample: a
+ * *_ops.bin results file, a *_histogram.txt file, or a per-op *_latency.txt file from older versions with
+ * "<timestamp>\t<latency_us>" lines.
+ *
+ * Service time is added after a queueing delay from a model of the store's capacity, shared by every instance
+ * in the process: at most capacity ops/s start service, at most concurrency ops are in service at once (first
+ * come, first served), and with on_overload=reject an op that would queue for longer than max_queue_delay_us
+ * fails right away instead, like a throttled request. Zero means unlimited for capacity and concurrency. If
+ * shared_state names a POSIX shared memory segment, e.g. /storage_bench_emulated, the queue is shared by every
+ * process on the host that names it, so capacity and concurrency hold for all workers of a local fan-out
+ * together rather than for each; destroy removes the segment. Stored value sizes are always per process.
+ *
+ * Keys that were never written fail to read, unless default_value_size is set, so that read-only runs need no
+ * load phase.
+ */
+class emulated : public storage_interface {
+ public:
+  emulated();
+  ~emulated();
+
+  void init(const property_map &conf, bool create) override;
+  void write(const std::string &key, const std::string &value) override;
+  std::string read(const std::string &key) override;
+  void destroy() override;
+  void write_async(const std::string &key, const std::string &value) override;
+  void read_async(const std::string &key) override;
+  void wait_write() override;
+  std::string wait_read() override;
+  void write_slice(const std::string &key, const char *value, size_t length) override;
+  void write_slice_async(const std::string &key, const char *value, size_t length) override;
+  void submit_write(uint64_t tag, const std::string &key, const char *value, size_t length) override;
+  void submit_read(uint64_t tag, const std::string &key) override;
+  completion wait_completion() override;
+
+  class model;
+
+ private:
+  // A completion that is not to be delivered before due_ns, an hr_clock reading. A write takes effect when its
+  // completion is delivered, so reads only see writes that have completed.
+  struct timed_completion {
+    uint64_t due_ns;
+    completion c;
+    std::string written_key;
+    size_t written_length;
+
+    bool operator>(const timed_completion &other) const {
+      return due_ns > other.due_ns;
+    }
+  };
+
+  timed_completion execute(uint64_t tag, bool read, const std::string &key, size_t length);
+  // Applies the write of t, if it is a successful one
+  void complete(const timed_completion &t);
+  void deliver();
+  static void sleep_until(uint64_t due_ns);
+
+  std::shared_ptr<model> m_model;
+
+  // Completions of submitted requests wait here for deliver() to hand them out when they are due
+  std::priority_queue<timed_completion, std::vector<timed_completion>, std::greater<timed_completion>> m_timers;
+  std::mutex m_timer_mtx;
+  std::condition_variable m_timer_cond;
+  bool m_stop;
+  std::thread m_timer;
+  queue<completion> m_completions;
+
+  std::queue<timed_completion> m_write_results;
+  std::queue<timed_completion> m_read_results;
+};
+
+#endif //STORAGE_BENCH_EMULATED_H
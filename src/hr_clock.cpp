@@ -0,0 +1,88 @@
+#include "hr_clock.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#ifdef HR_CLOCK_HAS_TSC
+#include <cpuid.h>
+#endif
+
+hr_clock::source hr_clock::s_source = hr_clock::STEADY_CLOCK;
+uint64_t hr_clock::s_base_ns = 0;
+int64_t hr_clock::s_base_steady_ns = 0;
+uint64_t hr_clock::s_base_ticks = 0;
+double hr_clock::s_ns_per_tick = 1.0;
+uint64_t hr_clock::s_overhead_ns = 0;
+
+void hr_clock::init(const std::string &clock_source) {
+  if (clock_source == "tsc") {
+    if (!has_invariant_tsc())
+      throw std::invalid_argument("clock=tsc, but this CPU has no invariant TSC");
+    s_source = TSC;
+  } else if (clock_source == "steady_clock") {
+    s_source = STEADY_CLOCK;
+  } else if (clock_source == "auto") {
+    s_source = has_invariant_tsc() ? TSC : STEADY_CLOCK;
+  } else {
+    throw std::invalid_argument("Unknown clock source: " + clock_source);
+  }
+  calibrate();
+  measure_overhead();
+}
+
+bool hr_clock::has_invariant_tsc() {
+#ifdef HR_CLOCK_HAS_TSC
+  unsigned int eax, ebx, ecx, edx;
+  if (__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) == 0 || eax < 0x80000007)
+    return false;
+  __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+  return (edx & (1U << 8)) != 0;
+#else
+  return false;
+#endif
+}
+
+void hr_clock::calibrate() {
+  using namespace std::chrono;
+  s_base_steady_ns = steady_ns();
+  s_base_ns = static_cast<uint64_t>(duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count());
+#ifdef HR_CLOCK_HAS_TSC
+  if (s_source == TSC) {
+    // The longer the window, the smaller the error in the frequency; 20ms keeps drift well under 1us/s
+    s_base_ticks = __rdtsc();
+    std::this_thread::sleep_for(milliseconds(20));
+    auto ticks = __rdtsc() - s_base_ticks;
+    auto ns = steady_ns() - s_base_steady_ns;
+    s_ns_per_tick = static_cast<double>(ns) / static_cast<double>(ticks);
+  }
+#endif
+}
+
+void hr_clock::measure_overhead() {
+  // Median of the cost of back-to-back readings, so that preemption during a sample does not skew it
+  const size_t samples = 1001;
+  const size_t reads_per_sample = 100;
+  std::vector<uint64_t> costs(samples);
+  s_overhead_ns = 0;
+  for (auto &cost: costs) {
+    auto begin = now_ns();
+    for (size_t i = 0; i < reads_per_sample - 1; ++i)
+      now_ns();
+    cost = (now_ns() - begin) / reads_per_sample;
+  }
+  std::nth_element(costs.begin(), costs.begin() + samples / 2, costs.end());
+  s_overhead_ns = costs[samples / 2];
+}
+
+uint64_t hr_clock::overhead_ns() {
+  return s_overhead_ns;
+}
+
+void hr_clock::print(std::ostream &out) {
+  out << "Clock: source=" << (s_source == TSC ? "tsc" : "steady_clock");
+  if (s_source == TSC)
+    out << " tsc_ghz=" << 1.0 / s_ns_per_tick;
+  out << " overhead_ns=" << s_overhead_ns;
+}
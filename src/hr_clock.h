@@ -0,0 +1,71 @@
+#ifndef STORAGE_BENCH_HR_CLOCK_H
+#define STORAGE_BENCH_HR_CLOCK_H
+
+#include <cstdint>
+#include <chrono>
+#include <ostream>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HR_CLOCK_HAS_TSC 1
+#endif
+
+/*
+ * Monotonic nanosecond clock for timing operations. Reads the invariant TSC when the CPU has one, scaled by a
+ * frequency calibrated against steady_clock at startup, and steady_clock itself otherwise. Readings are
+ * anchored to the wall clock once, at calibration, so they never jump with NTP yet still line up across
+ * processes to within the hosts' clock skew; to_wall_us() turns them into wall clock timestamps for output.
+ */
+class hr_clock {
+ public:
+  enum source {
+    TSC,
+    STEADY_CLOCK
+  };
+
+  // Calibrates the clock and measures its overhead; must be called before any other thread reads the clock.
+  // clock_source is "auto", "tsc" or "steady_clock"; "auto" uses the TSC if it is invariant.
+  static void init(const std::string &clock_source = "auto");
+
+  static uint64_t now_ns() {
+#ifdef HR_CLOCK_HAS_TSC
+    if (s_source == TSC)
+      return s_base_ns + static_cast<uint64_t>(static_cast<double>(__rdtsc() - s_base_ticks) * s_ns_per_tick);
+#endif
+    return s_base_ns + static_cast<uint64_t>(steady_ns() - s_base_steady_ns);
+  }
+
+  // Time between two readings, less the cost of one reading, which the interval includes
+  static uint64_t elapsed_ns(uint64_t begin_ns, uint64_t end_ns) {
+    auto elapsed = end_ns - begin_ns;
+    return elapsed > s_overhead_ns ? elapsed - s_overhead_ns : 0;
+  }
+
+  static uint64_t to_wall_us(uint64_t ns) {
+    return ns / 1000;
+  }
+
+  // Measured cost of one now_ns() call
+  static uint64_t overhead_ns();
+  static void print(std::ostream &out);
+
+ private:
+  static int64_t steady_ns() {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+  }
+
+  static bool has_invariant_tsc();
+  static void calibrate();
+  static void measure_overhead();
+
+  static source s_source;
+  static uint64_t s_base_ns;
+  static int64_t s_base_steady_ns;
+  static uint64_t s_base_ticks;
+  static double s_ns_per_tick;
+  static uint64_t s_overhead_ns;
+};
+
+#endif //STORAGE_BENCH_HR_CLOCK_H
@@ -1,91 +1,221 @@
-
-#include <random>
-#include <sstream>
-#include <iomanip>
+#include <cmath>
+#include <cstring>
 #include "key_generator.h"
 
-std::string sequential_key_generator::next() {
-  return std::to_string(cur_key_++);
+std::string key_generator::next() {
+  char buf[MAX_KEY_LENGTH];
+  return std::string(buf, next(buf));
+}
+
+std::string key_generator::next(int len) {
+  std::string key;
+  next(key, len);
+  return key;
+}
+
+size_t key_generator::next(char *buf, int width) {
+  return format(next_id(), buf, width);
 }
 
-std::string sequential_key_generator::next(int len) {
-  std::stringstream ss;
-  ss << std::setw(len) << std::setfill('0') << cur_key_++;
-  return ss.str();
+void key_generator::next(std::string &key, int width) {
+  char buf[MAX_KEY_LENGTH];
+  auto id = next_id();
+  if (static_cast<size_t>(width) > MAX_KEY_LENGTH) {
+    key.resize(static_cast<size_t>(width));
+    format(id, &key[0], width);
+  } else {
+    key.assign(buf, format(id, buf, width));
+  }
+}
+
+size_t key_generator::format(uint64_t id, char *buf, int width) {
+  char digits[MAX_KEY_LENGTH];
+  size_t n = 0;
+  do {
+    digits[n++] = static_cast<char>('0' + id % 10);
+    id /= 10;
+  } while (id != 0);
+
+  size_t len = 0;
+  for (; static_cast<int>(len + n) < width; ++len)
+    buf[len] = '0';
+  while (n > 0)
+    buf[len++] = digits[--n];
+  return len;
+}
+
+sequential_key_generator::sequential_key_generator(size_t first_key) : first_key_(first_key), cur_key_(first_key) {}
+
+uint64_t sequential_key_generator::next_id() {
+  return cur_key_++;
 }
 
 void sequential_key_generator::reset() {
-  cur_key_ = 0;
+  cur_key_ = first_key_;
 }
 
-zipf_key_generator::zipf_key_generator(double theta, uint64_t n)
-    : theta_(theta), n_(n), zdist_(new double[n]), dist_(0, 1) {
+uniform_key_generator::uniform_key_generator(uint64_t n) : dist_(0, n == 0 ? 0 : n - 1) {
   rng_.seed(std::random_device()());
-  gen_zipf();
 }
 
-void zipf_key_generator::gen_zipf() {
-  double sum = 0.0;
-  double c;
-  double expo = 1.0 - theta_;
-  double sumc = 0.0;
-  uint64_t i;
+uint64_t uniform_key_generator::next_id() {
+  return dist_(rng_);
+}
+
+void uniform_key_generator::reset() {
+  // Do nothing
+}
+
+/*
+ * Numerically stable helpers for the rejection-inversion sampler:
+ *   helper1(x) = log(1 + x) / x
+ *   helper2(x) = (exp(x) - 1) / x
+ * using Taylor expansions near zero.
+ */
+static double helper1(double x) {
+  if (std::fabs(x) > 1e-8)
+    return std::log1p(x) / x;
+  return 1.0 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x));
+}
 
+static double helper2(double x) {
+  if (std::fabs(x) > 1e-8)
+    return std::expm1(x) / x;
+  return 1.0 + x * 0.5 * (1.0 + x * 1.0 / 3.0 * (1.0 + 0.25 * x));
+}
+
+zipf_key_generator::zipf_key_generator(double theta, uint64_t n)
+    : theta_(theta), n_(n == 0 ? 1 : n), exponent_(1.0 - theta), dist_(0, 1) {
   /*
    * Zipfian - p(i) = c / i ^^ (1 - theta)
    * At theta = 1, uniform
    * At theta = 0, pure zipfian
    */
+  h_integral_x1_ = h_integral(1.5) - 1.0;
+  h_integral_n_ = h_integral(static_cast<double>(n_) + 0.5);
+  s_ = 2.0 - h_integral_inverse(h_integral(2.5) - h(2.0));
+  rng_.seed(std::random_device()());
+}
+
+zipf_key_generator::zipf_key_generator(const zipf_key_generator &other)
+    : theta_(other.theta_),
+      n_(other.n_),
+      exponent_(other.exponent_),
+      h_integral_x1_(other.h_integral_x1_),
+      h_integral_n_(other.h_integral_n_),
+      s_(other.s_),
+      dist_(0, 1) {
+  rng_.seed(std::random_device()());
+}
 
-  for (i = 1; i <= n_; i++) {
-    sum += 1.0 / pow((double) i, expo);
+double zipf_key_generator::h(double x) const {
+  return std::exp(-exponent_ * std::log(x));
+}
+
+double zipf_key_generator::h_integral(double x) const {
+  double log_x = std::log(x);
+  return helper2((1.0 - exponent_) * log_x) * log_x;
+}
+
+double zipf_key_generator::h_integral_inverse(double x) const {
+  double t = x * (1.0 - exponent_);
+  if (t < -1.0) {
+    // Limit to the domain of log1p; only reached through rounding
+    t = -1.0;
   }
-  c = 1.0 / sum;
+  return std::exp(helper1(t) * x);
+}
 
-  for (i = 0; i < n_; i++) {
-    sumc += c / pow((double) (i + 1), expo);
-    zdist_[i] = sumc;
+uint64_t zipf_key_generator::next_id() {
+  while (true) {
+    double u = h_integral_n_ + dist_(rng_) * (h_integral_x1_ - h_integral_n_);
+    double x = h_integral_inverse(u);
+    double k = std::floor(x + 0.5);
+    if (k < 1.0) {
+      k = 1.0;
+    } else if (k > static_cast<double>(n_)) {
+      k = static_cast<double>(n_);
+    }
+    if (k - x <= s_ || u >= h_integral(k + 0.5) - h(k)) {
+      return static_cast<uint64_t>(k) - 1;
+    }
   }
 }
 
-zipf_key_generator::~zipf_key_generator() {
-  delete[] zdist_;
+void zipf_key_generator::reset() {
+  // Do nothing
 }
 
-std::string zipf_key_generator::next() {
-  double r = dist_(rng_);
-  int64_t lo = 0;
-  int64_t hi = n_;
-  while (lo != hi) {
-    int64_t mid = (lo + hi) / 2;
-    if (zdist_[mid] <= r) {
-      lo = mid + 1;
-    } else {
-      hi = mid;
-    }
+// 64-bit FNV-1a over the bytes of x
+static uint64_t fnv_hash64(uint64_t x) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (int i = 0; i < 8; ++i) {
+    hash ^= x & 0xff;
+    hash *= 0x100000001b3ULL;
+    x >>= 8;
   }
+  return hash;
+}
 
-  return std::to_string(lo);
+scrambled_zipf_key_generator::scrambled_zipf_key_generator(double theta, uint64_t n)
+    : ranks_(theta, n), n_(n == 0 ? 1 : n) {}
+
+uint64_t scrambled_zipf_key_generator::next_id() {
+  return fnv_hash64(ranks_.next_id()) % n_;
 }
 
-void zipf_key_generator::reset() {
+void scrambled_zipf_key_generator::reset() {
   // Do nothing
 }
 
-std::string zipf_key_generator::next(int len) {
-  double r = dist_(rng_);
-  int64_t lo = 0;
-  int64_t hi = n_;
-  while (lo != hi) {
-    int64_t mid = (lo + hi) / 2;
-    if (zdist_[mid] <= r) {
-      lo = mid + 1;
-    } else {
-      hi = mid;
-    }
+hotspot_key_generator::hotspot_key_generator(uint64_t n, double hot_set_fraction, double hot_op_fraction)
+    : n_(n == 0 ? 1 : n), hot_op_fraction_(hot_op_fraction), dist_(0, 1) {
+  hot_n_ = static_cast<uint64_t>(static_cast<double>(n_) * hot_set_fraction);
+  if (hot_n_ == 0)
+    hot_n_ = 1;
+  if (hot_n_ > n_)
+    hot_n_ = n_;
+  rng_.seed(std::random_device()());
+}
+
+uint64_t hotspot_key_generator::next_id() {
+  if (hot_n_ == n_ || dist_(rng_) < hot_op_fraction_) {
+    return static_cast<uint64_t>(dist_(rng_) * static_cast<double>(hot_n_));
   }
+  return hot_n_ + static_cast<uint64_t>(dist_(rng_) * static_cast<double>(n_ - hot_n_));
+}
+
+void hotspot_key_generator::reset() {
+  // Do nothing
+}
+
+latest_key_generator::latest_key_generator(const zipf_key_generator &ranks,
+                                           std::shared_ptr<std::atomic<uint64_t>> num_keys)
+    : ranks_(ranks), num_keys_(std::move(num_keys)) {}
+
+uint64_t latest_key_generator::next_id() {
+  uint64_t n = num_keys_->load();
+  uint64_t rank = ranks_.next_id();
+  return rank < n ? n - 1 - rank : 0;
+}
+
+void latest_key_generator::reset() {
+  // Do nothing
+}
+
+key_schedule::key_schedule(std::shared_ptr<key_generator> key_gen, size_t length) : key_gen_(std::move(key_gen)) {
+  ids_.reserve(length);
+  for (size_t i = 0; i < length; ++i) {
+    ids_.push_back(key_gen_->next_id());
+  }
+}
+
+uint64_t key_schedule::next_id() {
+  if (pos_ < ids_.size())
+    return ids_[pos_++];
+  return key_gen_->next_id();
+}
 
-  std::stringstream ss;
-  ss << std::setw(len) << std::setfill('0') << lo;
-  return ss.str();
+void key_schedule::reset() {
+  pos_ = 0;
 }
@@ -3,42 +3,160 @@
 
 #include <string>
 #include <random>
+#include <memory>
+#include <vector>
+#include <atomic>
 
-class sequential_key_generator {
+/*
+ * Generates a stream of numeric key ids; next() formats them as keys. All generators sample in constant time
+ * and memory, and formatting into a caller supplied buffer does not allocate.
+ */
+class key_generator {
  public:
-  sequential_key_generator() = default;
+  // Digits in the largest uint64_t
+  static const size_t MAX_KEY_LENGTH = 20;
+
+  virtual ~key_generator() = default;
+
+  virtual uint64_t next_id() = 0;
+  virtual void reset() = 0;
 
   std::string next();
+  // Zero padded to len digits
   std::string next(int len);
-  void reset();
+
+  // Formats the next key into buf, which must hold max(width, MAX_KEY_LENGTH) characters, zero padded to width
+  // digits. Returns the length of the key.
+  size_t next(char *buf, int width = 0);
+  // Formats the next key into key, reusing its storage
+  void next(std::string &key, int width = 0);
+
+  static size_t format(uint64_t id, char *buf, int width = 0);
+};
+
+class sequential_key_generator : public key_generator {
+ public:
+  sequential_key_generator() = default;
+  explicit sequential_key_generator(size_t first_key);
+
+  uint64_t next_id() override;
+  void reset() override;
 
  private:
+  size_t first_key_{0};
   size_t cur_key_{0};
 };
 
-class zipf_key_generator {
+class uniform_key_generator : public key_generator {
  public:
-  struct probvals {
-    double prob;        // The access probability
-    double cum_prob;    // The cumulative access probability
-  };
+  explicit uniform_key_generator(uint64_t n);
+
+  uint64_t next_id() override;
+  void reset() override;
 
+ private:
+  std::mt19937_64 rng_;
+  std::uniform_int_distribution<uint64_t> dist_;
+};
+
+/*
+ * Zipf distributed ranks over [0, n), rank 0 being the most popular, drawn with Hormann and Derflinger's
+ * rejection-inversion method ("Rejection-inversion to generate variates from monotone discrete
+ * distributions", 1996), which needs neither a precomputed CDF nor a search.
+ */
+class zipf_key_generator : public key_generator {
+ public:
   zipf_key_generator(double theta, uint64_t n);
-  ~zipf_key_generator();
+  // Same distribution as other, but drawn from an independently seeded stream
+  zipf_key_generator(const zipf_key_generator &other);
 
-  std::string next();
-  std::string next(int len);
-  void reset();
+  uint64_t next_id() override;
+  void reset() override;
 
  private:
-  void gen_zipf();
+  double h(double x) const;
+  double h_integral(double x) const;
+  double h_integral_inverse(double x) const;
 
   double theta_;       // The skew parameter (0=pure zipf, 1=pure uniform)
   uint64_t n_;         // The number of objects
-  double *zdist_;
+  double exponent_;
+  double h_integral_x1_;
+  double h_integral_n_;
+  double s_;
 
-  std::mt19937 rng_;
+  std::mt19937_64 rng_;
   std::uniform_real_distribution<> dist_;
 };
 
+/*
+ * Zipf distributed keys whose ranks are hashed over [0, n), so the popular keys are spread over the key space
+ * rather than clustered at its start (and on whichever shard owns it).
+ */
+class scrambled_zipf_key_generator : public key_generator {
+ public:
+  scrambled_zipf_key_generator(double theta, uint64_t n);
+
+  uint64_t next_id() override;
+  void reset() override;
+
+ private:
+  zipf_key_generator ranks_;
+  uint64_t n_;
+};
+
+/*
+ * Sends hot_op_fraction of the accesses uniformly to the first hot_set_fraction of [0, n), and the rest
+ * uniformly to the remaining keys.
+ */
+class hotspot_key_generator : public key_generator {
+ public:
+  hotspot_key_generator(uint64_t n, double hot_set_fraction, double hot_op_fraction);
+
+  uint64_t next_id() override;
+  void reset() override;
+
+ private:
+  uint64_t n_;
+  uint64_t hot_n_;
+  double hot_op_fraction_;
+
+  std::mt19937_64 rng_;
+  std::uniform_real_distribution<> dist_;
+};
+
+/*
+ * Skews accesses towards the most recently inserted keys: draws a zipf rank r and returns the key r places
+ * behind the newest one, as tracked by a counter shared with the inserting workers.
+ */
+class latest_key_generator : public key_generator {
+ public:
+  latest_key_generator(const zipf_key_generator &ranks, std::shared_ptr<std::atomic<uint64_t>> num_keys);
+
+  uint64_t next_id() override;
+  void reset() override;
+
+ private:
+  zipf_key_generator ranks_;
+  std::shared_ptr<std::atomic<uint64_t>> num_keys_;
+};
+
+/*
+ * Replays key ids drawn from another generator ahead of time, so sampling costs nothing during the measured
+ * phase. Once the schedule runs out, ids are drawn from the generator directly.
+ */
+class key_schedule : public key_generator {
+ public:
+  key_schedule(std::shared_ptr<key_generator> key_gen, size_t length);
+
+  uint64_t next_id() override;
+  // Rewinds to the start of the schedule
+  void reset() override;
+
+ private:
+  std::shared_ptr<key_generator> key_gen_;
+  std::vector<uint64_t> ids_;
+  size_t pos_{0};
+};
+
 #endif //STORAGE_BENCH_KEY_GENERATOR_H
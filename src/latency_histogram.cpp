@@ -0,0 +1,186 @@
+#include "latency_histogram.h"
+#include "hr_clock.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+
+latency_histogram::latency_histogram(uint64_t highest_trackable)
+    : m_highest(highest_trackable),
+      m_total(0),
+      m_max(0),
+      m_min(std::numeric_limits<uint64_t>::max()),
+      m_sum(0) {
+  size_t bucket_count = 1;
+  uint64_t smallest_untrackable = SUB_BUCKET_COUNT;
+  while (smallest_untrackable <= m_highest) {
+    if (smallest_untrackable > (std::numeric_limits<uint64_t>::max() >> 1)) {
+      ++bucket_count;
+      break;
+    }
+    smallest_untrackable <<= 1;
+    ++bucket_count;
+  }
+  m_counts.resize((bucket_count + 1) * SUB_BUCKET_HALF_COUNT, 0);
+}
+
+void latency_histogram::merge(const latency_histogram &other) {
+  if (other.m_counts.size() > m_counts.size()) {
+    m_counts.resize(other.m_counts.size(), 0);
+    m_highest = other.m_highest;
+  }
+  for (size_t i = 0; i < other.m_counts.size(); ++i) {
+    m_counts[i] += other.m_counts[i];
+  }
+  m_total += other.m_total;
+  m_sum += other.m_sum;
+  if (other.m_max > m_max)
+    m_max = other.m_max;
+  if (other.m_min < m_min)
+    m_min = other.m_min;
+}
+
+void latency_histogram::reset() {
+  std::fill(m_counts.begin(), m_counts.end(), 0);
+  m_total = 0;
+  m_max = 0;
+  m_min = std::numeric_limits<uint64_t>::max();
+  m_sum = 0;
+}
+
+uint64_t latency_histogram::count() const {
+  return m_total;
+}
+
+uint64_t latency_histogram::max() const {
+  return m_max;
+}
+
+uint64_t latency_histogram::min() const {
+  return m_total == 0 ? 0 : m_min;
+}
+
+double latency_histogram::mean() const {
+  return m_total == 0 ? 0.0 : static_cast<double>(m_sum) / static_cast<double>(m_total);
+}
+
+uint64_t latency_histogram::value_at_percentile(double percentile) const {
+  if (m_total == 0)
+    return 0;
+  auto target = static_cast<uint64_t>(std::ceil(percentile / 100.0 * static_cast<double>(m_total)));
+  if (target < 1)
+    target = 1;
+  uint64_t cumulative = 0;
+  for (size_t i = 0; i < m_counts.size(); ++i) {
+    cumulative += m_counts[i];
+    if (cumulative >= target) {
+      // The last non-empty bucket may hold clamped values, so report the exact maximum there
+      return cumulative == m_total ? m_max : std::min(highest_equivalent_value(i), m_max);
+    }
+  }
+  return m_max;
+}
+
+void latency_histogram::write_distribution(std::ostream &out) const {
+  uint64_t cumulative = 0;
+  for (size_t i = 0; i < m_counts.size(); ++i) {
+    if (m_counts[i] == 0)
+      continue;
+    cumulative += m_counts[i];
+    out << (cumulative == m_total ? m_max : std::min(highest_equivalent_value(i), m_max)) << "\t" << m_counts[i] << "\t"
+        << (static_cast<double>(cumulative) / static_cast<double>(m_total)) << "\n";
+  }
+}
+
+void latency_histogram::write_summary(std::ostream &out) const {
+  out << count() << "\t" << value_at_percentile(50.0) << "\t" << value_at_percentile(90.0) << "\t"
+      << value_at_percentile(99.0) << "\t" << value_at_percentile(99.9) << "\t" << max();
+}
+
+uint64_t latency_histogram::highest_equivalent_value(size_t index) {
+  auto bucket_idx = static_cast<int>(index >> SUB_BUCKET_HALF_COUNT_MAGNITUDE) - 1;
+  auto sub_bucket_idx = (index & (SUB_BUCKET_HALF_COUNT - 1)) + SUB_BUCKET_HALF_COUNT;
+  if (bucket_idx < 0) {
+    sub_bucket_idx -= SUB_BUCKET_HALF_COUNT;
+    bucket_idx = 0;
+  }
+  return (sub_bucket_idx << bucket_idx) + (1ULL << bucket_idx) - 1;
+}
+
+latency_log::recorder::recorder(latency_log &log) : m_log(&log), m_interval(0) {}
+
+latency_log::recorder::~recorder() {
+  flush();
+}
+
+void latency_log::recorder::flush() {
+  if (m_histogram.count() == 0)
+    return;
+  m_log->add(m_interval, m_histogram);
+  m_histogram.reset();
+}
+
+latency_log::latency_log(uint64_t interval_ns) : m_interval_ns(interval_ns) {}
+
+latency_log::summary::summary(const latency_histogram &histogram)
+    : count(histogram.count()), p50(histogram.value_at_percentile(50.0)), p90(histogram.value_at_percentile(90.0)),
+      p99(histogram.value_at_percentile(99.0)), p999(histogram.value_at_percentile(99.9)), max(histogram.max()) {}
+
+void latency_log::summary::write(std::ostream &out) const {
+  out << count << "\t" << p50 << "\t" << p90 << "\t" << p99 << "\t" << p999 << "\t" << max;
+}
+
+void latency_log::add(uint64_t interval, const latency_histogram &histogram) {
+  std::lock_guard<std::mutex> lock(m_mtx);
+  m_total.merge(histogram);
+  auto closed = m_closed.find(interval);
+  if (closed != m_closed.end()) {
+    // A worker that was blocked for longer than the open intervals; its percentiles can only be bounded from above
+    summary late(histogram);
+    auto &row = closed->second;
+    row.count += late.count;
+    row.p50 = std::max(row.p50, late.p50);
+    row.p90 = std::max(row.p90, late.p90);
+    row.p99 = std::max(row.p99, late.p99);
+    row.p999 = std::max(row.p999, late.p999);
+    row.max = std::max(row.max, late.max);
+    return;
+  }
+  auto it = m_open.find(interval);
+  if (it == m_open.end()) {
+    m_open.insert({interval, histogram});
+  } else {
+    it->second.merge(histogram);
+  }
+  while (m_open.size() > OPEN_INTERVALS) {
+    m_closed.insert({m_open.begin()->first, summary(m_open.begin()->second)});
+    m_open.erase(m_open.begin());
+  }
+}
+
+latency_histogram latency_log::total() const {
+  std::lock_guard<std::mutex> lock(m_mtx);
+  return m_total;
+}
+
+void latency_log::write(const std::string &output_prefix) const {
+  std::lock_guard<std::mutex> lock(m_mtx);
+  std::ofstream l(output_prefix + "_latency.txt");
+  // Intervals are only closed once newer ones are open, so the closed ones all come first
+  for (const auto &entry: m_closed) {
+    l << hr_clock::to_wall_us((entry.first + 1) * m_interval_ns) << "\t";
+    entry.second.write(l);
+    l << "\n";
+  }
+  for (const auto &entry: m_open) {
+    l << hr_clock::to_wall_us((entry.first + 1) * m_interval_ns) << "\t";
+    entry.second.write_summary(l);
+    l << "\n";
+  }
+  l.close();
+
+  std::ofstream h(output_prefix + "_histogram.txt");
+  m_total.write_distribution(h);
+  h.close();
+}
@@ -0,0 +1,137 @@
+#ifndef STORAGE_BENCH_LATENCY_HISTOGRAM_H
+#define STORAGE_BENCH_LATENCY_HISTOGRAM_H
+
+#include <cstdint>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <string>
+#include <ostream>
+
+/*
+ * Fixed-memory, log-linear latency histogram in the style of HdrHistogram: values are split into power-of-two
+ * buckets, each with 128 linear sub-buckets, so every recorded value is kept to within 1% (~2 significant
+ * digits). Values beyond the highest trackable value are clamped into the last bucket, but the exact maximum
+ * is still tracked. Recording never allocates.
+ */
+class latency_histogram {
+ public:
+  // 60s in nanoseconds
+  static const uint64_t DEFAULT_HIGHEST = 60ULL * 1000 * 1000 * 1000;
+
+  explicit latency_histogram(uint64_t highest_trackable = DEFAULT_HIGHEST);
+
+  void record(uint64_t value) {
+    ++m_counts[counts_index(value < m_highest ? value : m_highest)];
+    ++m_total;
+    if (value > m_max)
+      m_max = value;
+    if (value < m_min)
+      m_min = value;
+    m_sum += value;
+  }
+
+  void merge(const latency_histogram &other);
+  void reset();
+
+  uint64_t count() const;
+  uint64_t max() const;
+  uint64_t min() const;
+  double mean() const;
+  uint64_t value_at_percentile(double percentile) const;
+
+  // Writes one line per non-empty bucket: value, count, cumulative fraction
+  void write_distribution(std::ostream &out) const;
+  // Writes count, p50, p90, p99, p99.9 and max, tab separated
+  void write_summary(std::ostream &out) const;
+
+ private:
+  static const int SUB_BUCKET_HALF_COUNT_MAGNITUDE = 7;
+  static const uint64_t SUB_BUCKET_HALF_COUNT = 1ULL << SUB_BUCKET_HALF_COUNT_MAGNITUDE;
+  static const uint64_t SUB_BUCKET_COUNT = SUB_BUCKET_HALF_COUNT << 1;
+  static const uint64_t SUB_BUCKET_MASK = SUB_BUCKET_COUNT - 1;
+
+  static size_t counts_index(uint64_t value) {
+    auto bucket_idx = static_cast<int>(64 - __builtin_clzll(value | SUB_BUCKET_MASK))
+        - (SUB_BUCKET_HALF_COUNT_MAGNITUDE + 1);
+    auto sub_bucket_idx = value >> bucket_idx;
+    return (static_cast<size_t>(bucket_idx + 1) << SUB_BUCKET_HALF_COUNT_MAGNITUDE)
+        + (sub_bucket_idx - SUB_BUCKET_HALF_COUNT);
+  }
+
+  static uint64_t highest_equivalent_value(size_t index);
+
+  uint64_t m_highest;
+  std::vector<uint64_t> m_counts;
+  uint64_t m_total;
+  uint64_t m_max;
+  uint64_t m_min;
+  uint64_t m_sum;
+};
+
+/*
+ * Latency log for a single benchmark phase. Worker threads record into their own recorder, which hands a
+ * histogram over to the log once per interval. The log merges the histograms of the last few intervals across
+ * workers, then keeps only a summary row for each older interval and folds it into a merged histogram for the
+ * whole phase, so its memory grows by a few dozen bytes per interval however long the run.
+ */
+class latency_log {
+ public:
+  class recorder {
+   public:
+    explicit recorder(latency_log &log);
+    ~recorder();
+
+    void record(uint64_t end_ns, uint64_t latency_ns) {
+      auto interval = end_ns / m_log->m_interval_ns;
+      if (interval != m_interval) {
+        flush();
+        m_interval = interval;
+      }
+      m_histogram.record(latency_ns);
+    }
+
+    void flush();
+
+   private:
+    latency_log *m_log;
+    latency_histogram m_histogram;
+    uint64_t m_interval;
+  };
+
+  // Timestamps are hr_clock readings. Intervals are aligned to multiples of interval_ns since the epoch, so logs
+  // from different workers and processes line up
+  explicit latency_log(uint64_t interval_ns);
+
+  // Writes per-interval summaries to <prefix>_latency.txt, each labelled with the wall clock time in us at which
+  // the interval ends, and the merged distribution to <prefix>_histogram.txt
+  void write(const std::string &output_prefix) const;
+
+  latency_histogram total() const;
+
+ private:
+  // Intervals whose histograms are still kept, for workers that hand theirs over late
+  static const size_t OPEN_INTERVALS = 8;
+
+  struct summary {
+    uint64_t count;
+    uint64_t p50;
+    uint64_t p90;
+    uint64_t p99;
+    uint64_t p999;
+    uint64_t max;
+
+    explicit summary(const latency_histogram &histogram);
+    void write(std::ostream &out) const;
+  };
+
+  void add(uint64_t interval, const latency_histogram &histogram);
+
+  uint64_t m_interval_ns;
+  mutable std::mutex m_mtx;
+  std::map<uint64_t, latency_histogram> m_open;
+  std::map<uint64_t, summary> m_closed;
+  latency_histogram m_total;
+};
+
+#endif //STORAGE_BENCH_LATENCY_HISTOGRAM_H
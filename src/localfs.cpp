@@ -0,0 +1,514 @@
+#include "localfs.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Passed by reference to property_map::get() and std::max(), so they need a definition
+const unsigned localfs::DEFAULT_QUEUE_DEPTH;
+const size_t localfs::DEFAULT_BLOCK_SIZE;
+const size_t localfs::DEFAULT_FSYNC_EVERY;
+
+// Every key is stored as a record: this header, the key, the value, and padding up to record_length
+struct record_header {
+  uint32_t magic;
+  uint32_t key_length;
+  uint32_t value_length;
+  uint32_t record_length;
+};
+
+static const uint32_t RECORD_MAGIC = 0x5342524b;
+
+// Distinguishes the fsync linked to a write from the write itself in user_data; requests are at least 8-aligned
+static const uint64_t FSYNC_CQE = 1;
+
+static std::string error_string(const std::string &what, int err) {
+  return what + ": " + std::strerror(err);
+}
+
+class localfs::volume {
+ public:
+  struct location {
+    int fd;
+    uint64_t offset;
+    size_t length;
+  };
+
+  volume(const std::string &path, layout_type layout, bool direct, bool create)
+      : m_path(path), m_layout(layout), m_flags(direct ? O_DIRECT : 0), m_log_fd(-1), m_log_tail(0) {
+    if (create && mkdir(m_path.c_str(), 0755) != 0 && errno != EEXIST) {
+      std::cerr << error_string("Failed to create directory " + m_path, errno) << std::endl;
+      exit(1);
+    }
+    if (m_layout == LOG) {
+      recover();
+      // Zero-padded creation time, so that logs sort in the order they were written
+      char name[32];
+      using namespace std::chrono;
+      snprintf(name, sizeof(name), "%020llu.log",
+               static_cast<unsigned long long>(duration_cast<nanoseconds>(
+                   system_clock::now().time_since_epoch()).count()));
+      m_log_fd = open((m_path + "/" + name).c_str(), O_RDWR | O_CREAT | O_EXCL | m_flags, 0644);
+      if (m_log_fd < 0) {
+        std::cerr << error_string("Failed to create log in " + m_path, errno) << std::endl;
+        exit(1);
+      }
+      m_logs.push_back(m_log_fd);
+    }
+  }
+
+  ~volume() {
+    for (auto fd: m_logs)
+      close(fd);
+  }
+
+  layout_type layout() const {
+    return m_layout;
+  }
+
+  std::string file(const std::string &key) const {
+    return m_path + "/" + key;
+  }
+
+  int flags() const {
+    return m_flags;
+  }
+
+  int log_fd() const {
+    return m_log_fd;
+  }
+
+  // Claims length bytes at the end of the log
+  uint64_t append(size_t length) {
+    return m_log_tail.fetch_add(length);
+  }
+
+  bool lookup(const std::string &key, location &loc) {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    auto it = m_index.find(key);
+    if (it == m_index.end())
+      return false;
+    loc = it->second;
+    return true;
+  }
+
+  void insert(const std::string &key, const location &loc) {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_index[key] = loc;
+  }
+
+  void remove_all() {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_index.clear();
+    for (auto fd: m_logs)
+      close(fd);
+    m_logs.clear();
+    for (const auto &name: list()) {
+      if (unlink(file(name).c_str()) != 0)
+        std::cerr << error_string("Failed to remove " + file(name), errno) << std::endl;
+    }
+    if (rmdir(m_path.c_str()) != 0)
+      std::cerr << error_string("Failed to remove directory " + m_path, errno) << std::endl;
+  }
+
+ private:
+  std::vector<std::string> list() const {
+    std::vector<std::string> names;
+    auto dir = opendir(m_path.c_str());
+    if (dir == nullptr) {
+      std::cerr << error_string("Failed to open directory " + m_path, errno) << std::endl;
+      exit(1);
+    }
+    while (auto entry = readdir(dir)) {
+      std::string name = entry->d_name;
+      if (name != "." && name != "..")
+        names.push_back(name);
+    }
+    closedir(dir);
+    std::sort(names.begin(), names.end());
+    return names;
+  }
+
+  // Indexes the logs left by earlier runs, oldest first so that later writes win. A log stops at its first
+  // incomplete or corrupt record.
+  void recover() {
+    for (const auto &name: list()) {
+      if (name.size() < 4 || name.compare(name.size() - 4, 4, ".log") != 0)
+        continue;
+      // Scanned through a buffered descriptor, since records need not be aligned to the block size
+      int scan_fd = open(file(name).c_str(), O_RDONLY);
+      int fd = open(file(name).c_str(), O_RDONLY | m_flags);
+      if (scan_fd < 0 || fd < 0) {
+        std::cerr << error_string("Failed to open log " + file(name), errno) << std::endl;
+        exit(1);
+      }
+      struct stat st{};
+      fstat(scan_fd, &st);
+      uint64_t size = static_cast<uint64_t>(st.st_size);
+      uint64_t offset = 0;
+      record_header h{};
+      std::string key;
+      while (offset + sizeof(h) <= size && pread(scan_fd, &h, sizeof(h), offset) == sizeof(h)) {
+        if (h.magic != RECORD_MAGIC || h.record_length < sizeof(h) + h.key_length + h.value_length
+            || offset + h.record_length > size)
+          break;
+        key.resize(h.key_length);
+        if (pread(scan_fd, &key[0], h.key_length, offset + sizeof(h)) != h.key_length)
+          break;
+        m_index[key] = location{fd, offset, h.record_length};
+        offset += h.record_length;
+      }
+      close(scan_fd);
+      m_logs.push_back(fd);
+    }
+  }
+
+  std::string m_path;
+  layout_type m_layout;
+  int m_flags;
+  int m_log_fd;
+  std::atomic<uint64_t> m_log_tail;
+  // Every log this process has open; the last is the one being appended to
+  std::vector<int> m_logs;
+  std::mutex m_mtx;
+  std::unordered_map<std::string, location> m_index;
+};
+
+// The volumes the instances in the process share, by configured path; each created by the first init() naming it
+static std::map<std::string, std::shared_ptr<localfs::volume>> g_volumes;
+static std::mutex g_volume_mtx;
+
+localfs::localfs() : m_align(1), m_fsync(NEVER), m_fsync_every(DEFAULT_FSYNC_EVERY), m_writes_since_fsync(0),
+                     m_async_issued{0, 0}, m_async_waited{0, 0} {}
+
+localfs::~localfs() {
+  for (auto &r: m_pool)
+    free(r->buf);
+}
+
+void localfs::init(const property_map &conf, bool create) {
+  auto layout_name = conf.get<std::string>("layout", "file");
+  layout_type layout;
+  if (layout_name == "file") {
+    layout = FILE_PER_KEY;
+  } else if (layout_name == "log") {
+    layout = LOG;
+  } else {
+    throw std::invalid_argument("Unknown layout: " + layout_name);
+  }
+
+  auto fsync_name = conf.get<std::string>("fsync", "never");
+  if (fsync_name == "never") {
+    m_fsync = NEVER;
+  } else if (fsync_name == "always") {
+    m_fsync = ALWAYS;
+  } else if (fsync_name == "periodic" && layout == LOG) {
+    m_fsync = PERIODIC;
+  } else {
+    throw std::invalid_argument("Unsupported fsync policy for layout=" + layout_name + ": " + fsync_name);
+  }
+  m_fsync_every = std::max<size_t>(conf.get<size_t>("fsync_every", DEFAULT_FSYNC_EVERY), 1);
+
+  bool direct = conf.get<bool>("direct", false);
+  m_align = direct ? conf.get<size_t>("block_size", DEFAULT_BLOCK_SIZE) : 1;
+
+  {
+    std::lock_guard<std::mutex> lock(g_volume_mtx);
+    auto path = conf.get<std::string>("path", "/tmp/test");
+    auto &volume = g_volumes[path];
+    if (volume == nullptr) {
+      if (path == "/tmp/test") {
+        path += random_string(10);
+        create = true;
+      }
+      volume = std::make_shared<localfs::volume>(path, layout, direct, create);
+    }
+    m_volume = volume;
+  }
+
+  // A write with fsync=always takes two entries, and the queue is flushed after every request
+  auto queue_depth = std::max(conf.get<unsigned>("queue_depth", DEFAULT_QUEUE_DEPTH), 2U);
+  try {
+    m_ring.reset(new uring(queue_depth));
+  } catch (std::runtime_error &e) {
+    std::cerr << "Failed to set up io_uring: " << e.what() << std::endl;
+    exit(1);
+  }
+}
+
+void localfs::write(const std::string &key, const std::string &value) {
+  write_slice(key, value.data(), value.length());
+}
+
+std::string localfs::read(const std::string &key) {
+  submit_read(0, key);
+  auto c = wait_completion();
+  if (!c.ok)
+    throw std::runtime_error(c.error);
+  return std::move(c.value);
+}
+
+void localfs::destroy() {
+  m_volume->remove_all();
+}
+
+void localfs::write_async(const std::string &key, const std::string &value) {
+  m_async_values.push_back(value);
+  submit_write(m_async_issued[0]++ << 1, key, m_async_values.back().data(), value.length());
+}
+
+void localfs::read_async(const std::string &key) {
+  submit_read((m_async_issued[1]++ << 1) | 1, key);
+}
+
+void localfs::wait_write() {
+  auto c = wait_async(m_async_waited[0]++ << 1);
+  m_async_values.pop_front();
+  if (!c.ok)
+    throw std::runtime_error(c.error);
+}
+
+std::string localfs::wait_read() {
+  auto c = wait_async((m_async_waited[1]++ << 1) | 1);
+  if (!c.ok)
+    throw std::runtime_error(c.error);
+  return std::move(c.value);
+}
+
+void localfs::write_slice(const std::string &key, const char *value, size_t length) {
+  submit_write(0, key, value, length);
+  auto c = wait_completion();
+  if (!c.ok)
+    throw std::runtime_error(c.error);
+}
+
+void localfs::write_slice_async(const std::string &key, const char *value, size_t length) {
+  // Nothing to keep alive, but wait_write pops one value per write
+  m_async_values.emplace_back();
+  submit_write(m_async_issued[0]++ << 1, key, value, length);
+}
+
+void localfs::submit_write(uint64_t tag, const std::string &key, const char *value, size_t length) {
+  auto r = acquire(tag, false, key);
+  record_header h{RECORD_MAGIC, static_cast<uint32_t>(key.size()), static_cast<uint32_t>(length), 0};
+  size_t header_length = sizeof(h) + key.size();
+  size_t record_length = (header_length + length + m_align - 1) / m_align * m_align;
+  h.record_length = static_cast<uint32_t>(record_length);
+  // With O_DIRECT the record has to be one aligned buffer; otherwise the value is sent from the caller's buffer
+  reserve(r, m_align > 1 ? record_length : header_length);
+  std::memcpy(r->buf, &h, sizeof(h));
+  std::memcpy(r->buf + sizeof(h), key.data(), key.size());
+  r->length = record_length;
+
+  if (m_volume->layout() == LOG) {
+    r->fd = m_volume->log_fd();
+    r->offset = m_volume->append(record_length);
+  } else {
+    r->fd = open(m_volume->file(key).c_str(), O_WRONLY | O_CREAT | O_TRUNC | m_volume->flags(), 0644);
+    if (r->fd < 0) {
+      fail(r, error_string("Failed to open " + m_volume->file(key), errno));
+      return;
+    }
+    r->close_fd = true;
+    r->offset = 0;
+  }
+
+  std::lock_guard<std::mutex> lock(m_submit_mtx);
+  auto sqe = m_ring->prepare();
+  sqe->fd = r->fd;
+  sqe->off = r->offset;
+  sqe->user_data = reinterpret_cast<uintptr_t>(r);
+  if (m_align > 1) {
+    std::memcpy(r->buf + header_length, value, length);
+    std::memset(r->buf + header_length + length, 0, record_length - header_length - length);
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->addr = reinterpret_cast<uintptr_t>(r->buf);
+    sqe->len = static_cast<uint32_t>(record_length);
+  } else {
+    r->iov[0] = iovec{r->buf, header_length};
+    r->iov[1] = iovec{const_cast<char *>(value), length};
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->addr = reinterpret_cast<uintptr_t>(r->iov);
+    sqe->len = 2;
+  }
+
+  if (m_fsync == ALWAYS) {
+    sqe->flags |= IOSQE_IO_LINK;
+    auto fsync_sqe = m_ring->prepare();
+    fsync_sqe->opcode = IORING_OP_FSYNC;
+    fsync_sqe->fd = r->fd;
+    fsync_sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+    fsync_sqe->user_data = reinterpret_cast<uintptr_t>(r) | FSYNC_CQE;
+    r->pending = 2;
+  } else if (m_fsync == PERIODIC && ++m_writes_since_fsync == m_fsync_every) {
+    m_writes_since_fsync = 0;
+    auto f = acquire(0, false, "");
+    f->internal = true;
+    auto fsync_sqe = m_ring->prepare();
+    fsync_sqe->opcode = IORING_OP_FSYNC;
+    fsync_sqe->fd = m_volume->log_fd();
+    fsync_sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+    fsync_sqe->user_data = reinterpret_cast<uintptr_t>(f) | FSYNC_CQE;
+  }
+  m_ring->submit();
+}
+
+void localfs::submit_read(uint64_t tag, const std::string &key) {
+  auto r = acquire(tag, true, key);
+  volume::location loc{};
+  if (m_volume->layout() == LOG) {
+    if (!m_volume->lookup(key, loc)) {
+      fail(r, "No such key: " + key);
+      return;
+    }
+    r->fd = loc.fd;
+  } else {
+    r->fd = open(m_volume->file(key).c_str(), O_RDONLY | m_volume->flags());
+    if (r->fd < 0) {
+      fail(r, errno == ENOENT ? "No such key: " + key : error_string("Failed to open " + m_volume->file(key), errno));
+      return;
+    }
+    r->close_fd = true;
+    // Files written by an earlier run are not in the index yet
+    struct stat st{};
+    if (!m_volume->lookup(key, loc) && fstat(r->fd, &st) == 0)
+      loc = volume::location{-1, 0, static_cast<size_t>(st.st_size)};
+  }
+  reserve(r, loc.length);
+  r->offset = loc.offset;
+  r->length = loc.length;
+
+  std::lock_guard<std::mutex> lock(m_submit_mtx);
+  auto sqe = m_ring->prepare();
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = r->fd;
+  sqe->off = r->offset;
+  sqe->addr = reinterpret_cast<uintptr_t>(r->buf);
+  sqe->len = static_cast<uint32_t>(r->length);
+  sqe->user_data = reinterpret_cast<uintptr_t>(r);
+  m_ring->submit();
+}
+
+storage_interface::completion localfs::wait_completion() {
+  while (true) {
+    auto cqe = m_ring->wait();
+    auto r = reinterpret_cast<request *>(cqe.user_data & ~FSYNC_CQE);
+    if (cqe.res < 0) {
+      if (r->error.empty())
+        r->error = std::strerror(-cqe.res);
+    } else if ((cqe.user_data & FSYNC_CQE) == 0 && static_cast<size_t>(cqe.res) != r->length) {
+      if (r->error.empty())
+        r->error = r->read ? "Short read" : "Short write";
+    }
+    if (--r->pending > 0)
+      continue;
+    if (r->internal) {
+      if (!r->error.empty())
+        std::cerr << "WARN fsync failed: " << r->error << std::endl;
+      release(r);
+      continue;
+    }
+    return finish(r);
+  }
+}
+
+localfs::request *localfs::acquire(uint64_t tag, bool read, const std::string &key) {
+  request *r;
+  {
+    std::lock_guard<std::mutex> lock(m_pool_mtx);
+    if (m_free.empty()) {
+      m_pool.emplace_back(new request());
+      r = m_pool.back().get();
+    } else {
+      r = m_free.back();
+      m_free.pop_back();
+    }
+  }
+  r->tag = tag;
+  r->read = read;
+  r->internal = false;
+  r->key = key;
+  r->fd = -1;
+  r->close_fd = false;
+  r->offset = 0;
+  r->length = 0;
+  r->pending = 1;
+  r->error.clear();
+  return r;
+}
+
+void localfs::release(request *r) {
+  std::lock_guard<std::mutex> lock(m_pool_mtx);
+  m_free.push_back(r);
+}
+
+void localfs::reserve(request *r, size_t size) {
+  if (r->buf_size >= size)
+    return;
+  free(r->buf);
+  r->buf = nullptr;
+  r->buf_size = 0;
+  void *buf;
+  if (posix_memalign(&buf, std::max<size_t>(m_align, sizeof(void *)), std::max<size_t>(size, 1)) != 0)
+    throw std::bad_alloc();
+  r->buf = static_cast<char *>(buf);
+  r->buf_size = size;
+}
+
+void localfs::fail(request *r, const std::string &error) {
+  r->error = error;
+  r->length = 0;
+  std::lock_guard<std::mutex> lock(m_submit_mtx);
+  auto sqe = m_ring->prepare();
+  sqe->opcode = IORING_OP_NOP;
+  sqe->user_data = reinterpret_cast<uintptr_t>(r);
+  m_ring->submit();
+}
+
+storage_interface::completion localfs::finish(request *r) {
+  completion c{r->tag, r->error.empty(), "", r->error};
+  if (c.ok && r->read) {
+    record_header h{};
+    if (r->length >= sizeof(h))
+      std::memcpy(&h, r->buf, sizeof(h));
+    if (r->length < sizeof(h) || h.magic != RECORD_MAGIC || h.key_length != r->key.size()
+        || sizeof(h) + h.key_length + h.value_length > r->length
+        || std::memcmp(r->buf + sizeof(h), r->key.data(), r->key.size()) != 0) {
+      c.ok = false;
+      c.error = "Corrupt record for key " + r->key;
+    } else {
+      c.value.assign(r->buf + sizeof(h) + h.key_length, h.value_length);
+    }
+  } else if (c.ok) {
+    m_volume->insert(r->key, volume::location{m_volume->layout() == LOG ? r->fd : -1, r->offset, r->length});
+  }
+  if (r->close_fd)
+    close(r->fd);
+  release(r);
+  return c;
+}
+
+storage_interface::completion localfs::wait_async(uint64_t tag) {
+  auto it = m_stash.find(tag);
+  if (it != m_stash.end()) {
+    auto c = std::move(it->second);
+    m_stash.erase(it);
+    return c;
+  }
+  while (true) {
+    auto c = wait_completion();
+    if (c.tag == tag)
+      return c;
+    m_stash.emplace(c.tag, std::move(c));
+  }
+}
+
+REGISTER_STORAGE_IFACE("localfs", localfs);
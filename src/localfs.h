@@ -0,0 +1,105 @@
+#ifndef STORAGE_BENCH_LOCALFS_H
+#define STORAGE_BENCH_LOCALFS_H
+
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <sys/uio.h>
+#include "storage_interface.h"
+#include "uring.h"
+
+/*
+ * Local disk backend, for comparing the remote stores against the NVMe on the same host. Keys are stored either
+ * one file per key (layout=file) or as records appended to a log with an in-memory index (layout=log), and all
+ * I/O goes through a per-instance io_uring, so the async modes keep up to queue_depth requests in the device
+ * queue. direct=true opens files with O_DIRECT, padding every record to block_size.
+ *
+ * fsync=never leaves durability to the page cache, fsync=always links an fdatasync to every write and completes
+ * the write only once both are done, and fsync=periodic (log layout only) issues an fdatasync on the log after
+ * every fsync_every writes.
+ */
+class localfs : public storage_interface {
+ public:
+  static const unsigned DEFAULT_QUEUE_DEPTH = 64;
+  static const size_t DEFAULT_BLOCK_SIZE = 4096;
+  static const size_t DEFAULT_FSYNC_EVERY = 64;
+
+  localfs();
+  ~localfs();
+
+  void init(const property_map &conf, bool create) override;
+  void write(const std::string &key, const std::string &value) override;
+  std::string read(const std::string &key) override;
+  void destroy() override;
+  void write_async(const std::string &key, const std::string &value) override;
+  void read_async(const std::string &key) override;
+  void wait_write() override;
+  std::string wait_read() override;
+  void write_slice(const std::string &key, const char *value, size_t length) override;
+  void write_slice_async(const std::string &key, const char *value, size_t length) override;
+  void submit_write(uint64_t tag, const std::string &key, const char *value, size_t length) override;
+  void submit_read(uint64_t tag, const std::string &key) override;
+  completion wait_completion() override;
+
+  enum layout_type {
+    FILE_PER_KEY,
+    LOG
+  };
+
+  enum fsync_policy {
+    NEVER,
+    ALWAYS,
+    PERIODIC
+  };
+
+  class volume;
+
+ private:
+  struct request {
+    uint64_t tag;
+    bool read;
+    // Periodic fsyncs, which are not reported to the caller
+    bool internal;
+    std::string key;
+    int fd;
+    bool close_fd;
+    uint64_t offset;
+    size_t length;
+    // CQEs still to come, and the first error among those already reaped
+    unsigned pending;
+    std::string error;
+    // Record header and key, or the whole record when it cannot be written from the caller's buffer
+    char *buf;
+    size_t buf_size;
+    iovec iov[2];
+  };
+
+  request *acquire(uint64_t tag, bool read, const std::string &key);
+  void release(request *r);
+  void reserve(request *r, size_t size);
+  // Queues a no-op that completes r with r->error, for requests that fail before reaching the disk
+  void fail(request *r, const std::string &error);
+  completion finish(request *r);
+  completion wait_async(uint64_t tag);
+
+  std::shared_ptr<volume> m_volume;
+  std::unique_ptr<uring> m_ring;
+  size_t m_align;
+  fsync_policy m_fsync;
+  size_t m_fsync_every;
+  size_t m_writes_since_fsync;
+
+  std::mutex m_submit_mtx;
+  std::mutex m_pool_mtx;
+  std::vector<std::unique_ptr<request>> m_pool;
+  std::vector<request *> m_free;
+
+  // write_async/read_async go through the ring as well; completions are held here until wait_write/wait_read
+  // asks for them in issue order
+  std::deque<std::string> m_async_values;
+  uint64_t m_async_issued[2];
+  uint64_t m_async_waited[2];
+  std::unordered_map<uint64_t, completion> m_stash;
+};
+
+#endif //STORAGE_BENCH_LOCALFS_H
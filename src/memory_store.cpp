@@ -0,0 +1,213 @@
+#include "memory_store.h"
+
+#include <cstring>
+
+// Passed by reference to property_map::get(), so they need a definition
+const size_t memory_store::DEFAULT_SHARDS;
+const size_t memory_store::DEFAULT_CAPACITY;
+const size_t memory_store::DEFAULT_ASYNC_THREADS;
+
+class memory_store::store {
+ public:
+  store(size_t num_shards, size_t capacity) : m_mask(num_shards - 1), m_shards(new shard[num_shards]) {
+    for (size_t i = 0; i < num_shards; ++i)
+      m_shards[i].init(capacity / num_shards);
+  }
+
+  shard &shard_of(const std::string &key) {
+    return m_shards[std::hash<std::string>()(key) & m_mask];
+  }
+
+  void clear() {
+    for (size_t i = 0; i <= m_mask; ++i)
+      m_shards[i].clear();
+  }
+
+ private:
+  size_t m_mask;
+  std::unique_ptr<shard[]> m_shards;
+};
+
+// The store all instances in the process share; created by the first init()
+static std::shared_ptr<memory_store::store> g_store;
+static std::mutex g_store_mtx;
+
+memory_store::shard::shard() : m_capacity(0), m_used(0) {
+  m_lock.clear();
+}
+
+void memory_store::shard::init(size_t capacity) {
+  m_slab.reset(new char[capacity]);
+  m_capacity = capacity;
+  m_used = 0;
+}
+
+int memory_store::shard::size_class(size_t length) {
+  int c = 0;
+  while ((MIN_CHUNK << c) < length) {
+    if (++c == NUM_CLASSES)
+      throw std::runtime_error("Value too large: " + std::to_string(length) + " bytes");
+  }
+  return c;
+}
+
+char *memory_store::shard::allocate(int c) {
+  if (!m_free[c].empty()) {
+    auto chunk = m_free[c].back();
+    m_free[c].pop_back();
+    return chunk;
+  }
+  size_t size = MIN_CHUNK << c;
+  if (m_capacity - m_used < size)
+    throw std::runtime_error("Out of memory: shard slab of " + std::to_string(m_capacity) + " bytes is full");
+  auto chunk = m_slab.get() + m_used;
+  m_used += size;
+  return chunk;
+}
+
+void memory_store::shard::put(const std::string &key, const char *value, size_t length) {
+  int c = size_class(length);
+  lock();
+  try {
+    auto it = m_index.find(key);
+    if (it == m_index.end()) {
+      it = m_index.emplace(key, entry{allocate(c), 0, c}).first;
+    } else if (it->second.size_class != c) {
+      auto chunk = allocate(c);
+      m_free[it->second.size_class].push_back(it->second.data);
+      it->second = entry{chunk, 0, c};
+    }
+    std::memcpy(it->second.data, value, length);
+    it->second.length = length;
+  } catch (...) {
+    unlock();
+    throw;
+  }
+  unlock();
+}
+
+bool memory_store::shard::get(const std::string &key, std::string &value) {
+  lock();
+  auto it = m_index.find(key);
+  bool found = it != m_index.end();
+  if (found)
+    value.assign(it->second.data, it->second.length);
+  unlock();
+  return found;
+}
+
+void memory_store::shard::clear() {
+  lock();
+  m_index.clear();
+  for (auto &free_list: m_free)
+    free_list.clear();
+  m_used = 0;
+  unlock();
+}
+
+memory_store::memory_store() = default;
+
+memory_store::~memory_store() {
+  for (size_t i = 0; i < m_threads.size(); ++i)
+    m_requests.push(request{0, false, true, "", nullptr, 0});
+  for (auto &t: m_threads)
+    t.join();
+}
+
+void memory_store::init(const property_map &conf, bool) {
+  {
+    std::lock_guard<std::mutex> lock(g_store_mtx);
+    if (g_store == nullptr) {
+      size_t num_shards = 1;
+      while (num_shards < conf.get<size_t>("shards", DEFAULT_SHARDS))
+        num_shards <<= 1;
+      g_store = std::make_shared<store>(num_shards, conf.get<size_t>("capacity", DEFAULT_CAPACITY));
+    }
+    m_store = g_store;
+  }
+
+  auto num_threads = conf.get<size_t>("async_threads", DEFAULT_ASYNC_THREADS);
+  if (num_threads == 0)
+    throw std::invalid_argument("async_threads must be at least 1");
+  for (size_t i = 0; i < num_threads; ++i)
+    m_threads.emplace_back(&memory_store::serve, this);
+}
+
+void memory_store::write(const std::string &key, const std::string &value) {
+  m_store->shard_of(key).put(key, value.data(), value.length());
+}
+
+std::string memory_store::read(const std::string &key) {
+  std::string value;
+  if (!m_store->shard_of(key).get(key, value))
+    throw std::runtime_error("No such key: " + key);
+  return value;
+}
+
+void memory_store::destroy() {
+  m_store->clear();
+}
+
+void memory_store::write_async(const std::string &key, const std::string &value) {
+  write_slice_async(key, value.data(), value.length());
+}
+
+void memory_store::read_async(const std::string &key) {
+  m_read_results.push(make_completion(0, [&]() { return read(key); }));
+}
+
+void memory_store::wait_write() {
+  auto c = std::move(m_write_results.front());
+  m_write_results.pop();
+  if (!c.ok)
+    throw std::runtime_error(c.error);
+}
+
+std::string memory_store::wait_read() {
+  auto c = std::move(m_read_results.front());
+  m_read_results.pop();
+  if (!c.ok)
+    throw std::runtime_error(c.error);
+  return std::move(c.value);
+}
+
+void memory_store::write_slice(const std::string &key, const char *value, size_t length) {
+  m_store->shard_of(key).put(key, value, length);
+}
+
+void memory_store::write_slice_async(const std::string &key, const char *value, size_t length) {
+  m_write_results.push(make_completion(0, [&]() {
+    write_slice(key, value, length);
+    return std::string();
+  }));
+}
+
+void memory_store::submit_write(uint64_t tag, const std::string &key, const char *value, size_t length) {
+  m_requests.push(request{tag, false, false, key, value, length});
+}
+
+void memory_store::submit_read(uint64_t tag, const std::string &key) {
+  m_requests.push(request{tag, true, false, key, nullptr, 0});
+}
+
+storage_interface::completion memory_store::wait_completion() {
+  return m_completions.pop();
+}
+
+void memory_store::serve() {
+  while (true) {
+    auto r = m_requests.pop();
+    if (r.stop)
+      return;
+    if (r.read) {
+      m_completions.push(make_completion(r.tag, [&]() { return read(r.key); }));
+    } else {
+      m_completions.push(make_completion(r.tag, [&]() {
+        write_slice(r.key, r.value, r.length);
+        return std::string();
+      }));
+    }
+  }
+}
+
+REGISTER_STORAGE_IFACE("memory", memory_store);
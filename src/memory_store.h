@@ -0,0 +1,109 @@
+#ifndef STORAGE_BENCH_MEMORY_STORE_H
+#define STORAGE_BENCH_MEMORY_STORE_H
+
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+#include "storage_interface.h"
+#include "queue.h"
+
+/*
+ * In-process key-value store with no network or SDK underneath, so a run against it measures the harness alone
+ * and bounds what any real backend can reach in the same mode.
+ *
+ * Keys hash to one of a power-of-two number of shards, each guarded by its own spinlock. Values live in a slab
+ * preallocated per shard and carved into power-of-two size classes; an overwrite reuses its chunk when the size
+ * class does not change, and freed chunks go back on their class's free list, so steady-state writes do not
+ * touch the allocator. All instances in a process share one store, so every worker sees every key.
+ *
+ * submit_* hand requests to a pool of async_threads threads that serve them and push their completions, so
+ * requests really are in flight while the caller issues more.
+ */
+class memory_store : public storage_interface {
+ public:
+  static const size_t DEFAULT_SHARDS = 64;
+  static const size_t DEFAULT_CAPACITY = 256 * 1024 * 1024;
+  static const size_t DEFAULT_ASYNC_THREADS = 1;
+
+  memory_store();
+  ~memory_store();
+
+  void init(const property_map &conf, bool create) override;
+  void write(const std::string &key, const std::string &value) override;
+  std::string read(const std::string &key) override;
+  void destroy() override;
+  void write_async(const std::string &key, const std::string &value) override;
+  void read_async(const std::string &key) override;
+  void wait_write() override;
+  std::string wait_read() override;
+  void write_slice(const std::string &key, const char *value, size_t length) override;
+  void write_slice_async(const std::string &key, const char *value, size_t length) override;
+  void submit_write(uint64_t tag, const std::string &key, const char *value, size_t length) override;
+  void submit_read(uint64_t tag, const std::string &key) override;
+  completion wait_completion() override;
+
+  class shard;
+  class store;
+
+ private:
+  struct request {
+    uint64_t tag;
+    bool read;
+    bool stop;
+    std::string key;
+    const char *value;
+    size_t length;
+  };
+
+  void serve();
+
+  std::shared_ptr<store> m_store;
+  std::vector<std::thread> m_threads;
+  queue<request> m_requests;
+  queue<completion> m_completions;
+  // Outcomes of write_async/read_async, which are served inline
+  std::queue<completion> m_write_results;
+  std::queue<completion> m_read_results;
+};
+
+class memory_store::shard {
+ public:
+  shard();
+
+  void init(size_t capacity);
+  void put(const std::string &key, const char *value, size_t length);
+  // False if key is absent
+  bool get(const std::string &key, std::string &value);
+  void clear();
+
+ private:
+  // Chunks of size class c hold up to MIN_CHUNK << c bytes
+  static const size_t MIN_CHUNK = 16;
+  static const int NUM_CLASSES = 48;
+
+  struct entry {
+    char *data;
+    size_t length;
+    int size_class;
+  };
+
+  static int size_class(size_t length);
+  char *allocate(int c);
+
+  void lock() {
+    while (m_lock.test_and_set(std::memory_order_acquire));
+  }
+
+  void unlock() {
+    m_lock.clear(std::memory_order_release);
+  }
+
+  std::atomic_flag m_lock;
+  std::unordered_map<std::string, entry> m_index;
+  std::unique_ptr<char[]> m_slab;
+  size_t m_capacity;
+  size_t m_used;
+  std::vector<char *> m_free[NUM_CLASSES];
+};
+
+#endif //STORAGE_BENCH_MEMORY_STORE_H
@@ -75,4 +75,24 @@ std::string memorymux::wait_read() {
   return r;
 }
 
+void memorymux::multi_read(const std::vector<std::string> &keys, std::vector<std::string> &values) {
+  values = m_client->get(keys);
+  for (const auto &v: values) {
+    if (!v.empty() && v.front() == '!')
+      throw std::runtime_error(v);
+  }
+}
+
+void memorymux::multi_write(const std::vector<std::string> &keys, const std::vector<value_slice> &values) {
+  m_batch.resize(2 * keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    m_batch[2 * i] = keys[i];
+    m_batch[2 * i + 1].assign(values[i].data, values[i].size);
+  }
+  for (const auto &r: m_client->put(m_batch)) {
+    if (r != "!ok")
+      throw std::runtime_error(r);
+  }
+}
+
 REGISTER_STORAGE_IFACE("mmux", memorymux);
@@ -14,12 +14,16 @@ class memorymux: public storage_interface {
   void read_async(const std::string &key) override;
   void wait_write() override;
   std::string wait_read() override;
+  void multi_read(const std::vector<std::string> &keys, std::vector<std::string> &values) override;
+  void multi_write(const std::vector<std::string> &keys, const std::vector<value_slice> &values) override;
 
  private:
   std::vector<std::string> m_writes;
   std::vector<std::string> m_reads;
   std::queue<std::string> m_read_results;
   std::queue<std::string> m_write_results;
+  // Interleaved keys and values of the current multi_write
+  std::vector<std::string> m_batch;
   std::string m_mmux_path;
   std::shared_ptr<mmux::client::mmux_client> m_mmux_client;
   std::shared_ptr<mmux::storage::kv_client> m_client;
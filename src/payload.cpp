@@ -0,0 +1,113 @@
+#include "payload.h"
+
+#include <algorithm>
+#include "benchmark_utils.h"
+
+payload::payload(const storage_interface::property_map &conf, size_t value_size)
+    : m_dist(FIXED), m_min_value_size(value_size), m_max_value_size(value_size) {
+  auto dist = conf.get<std::string>("value_size_distribution", "fixed");
+  if (dist == "uniform" || dist == "zipf") {
+    m_dist = dist == "uniform" ? UNIFORM : ZIPF;
+    m_min_value_size = conf.get<size_t>("min_value_size", 1);
+    m_max_value_size = conf.get<size_t>("max_value_size", value_size);
+    if (m_min_value_size > m_max_value_size)
+      throw std::invalid_argument("min_value_size must not exceed max_value_size");
+    if (m_dist == ZIPF)
+      m_zipf = std::make_shared<zipf_key_generator>(conf.get<double>("value_size_zipf_theta", 0.01),
+                                                    m_max_value_size - m_min_value_size + 1);
+  } else if (dist == "histogram") {
+    m_dist = HISTOGRAM;
+    std::vector<std::string> entries;
+    benchmark_utils::split(conf.get<std::string>("value_size_histogram", ""), entries, ',');
+    for (const auto &entry: entries) {
+      auto sep = entry.find(':');
+      if (sep == std::string::npos)
+        throw std::invalid_argument("Malformed value_size_histogram entry: " + entry);
+      m_histogram_sizes.push_back(std::stoull(entry.substr(0, sep)));
+      m_histogram_weights.push_back(std::stod(entry.substr(sep + 1)));
+    }
+    if (m_histogram_sizes.empty())
+      throw std::invalid_argument("value_size_histogram is empty");
+    m_min_value_size = *std::min_element(m_histogram_sizes.begin(), m_histogram_sizes.end());
+    m_max_value_size = *std::max_element(m_histogram_sizes.begin(), m_histogram_sizes.end());
+    m_histogram = std::discrete_distribution<size_t>(m_histogram_weights.begin(), m_histogram_weights.end());
+  } else if (dist != "fixed") {
+    throw std::invalid_argument("Unknown value size distribution: " + dist);
+  }
+
+  m_compressibility = conf.get<double>("compressibility", 0.0);
+  if (m_compressibility < 0.0 || m_compressibility > 1.0)
+    throw std::invalid_argument("compressibility must be between 0 and 1");
+  auto pool_size = std::max(conf.get<size_t>("pool_size", 16 * 1024 * 1024), 2 * m_max_value_size);
+  m_rng.seed(std::random_device()());
+  fill_pool(pool_size, m_compressibility);
+}
+
+payload::payload(const payload &other)
+    : m_dist(other.m_dist),
+      m_min_value_size(other.m_min_value_size),
+      m_max_value_size(other.m_max_value_size),
+      m_compressibility(other.m_compressibility),
+      m_histogram_sizes(other.m_histogram_sizes),
+      m_histogram_weights(other.m_histogram_weights),
+      m_pool(other.m_pool),
+      m_histogram(other.m_histogram) {
+  m_rng.seed(std::random_device()());
+  if (other.m_zipf != nullptr)
+    m_zipf = std::make_shared<zipf_key_generator>(*other.m_zipf);
+}
+
+void payload::fill_pool(size_t pool_size, double compressibility) {
+  // Each run starts with zeros that compress away, followed by random bytes that do not. The number of zeros per
+  // run is carried over from run to run so that they add up to the exact fraction, and any slice of a few runs
+  // compresses close to it
+  m_pool = std::make_shared<std::vector<char>>(pool_size);
+  auto &pool = *m_pool;
+  double carry = 0.0;
+  size_t zeros = 0;
+  for (size_t i = 0; i < pool_size; i += sizeof(uint64_t)) {
+    if (i % RUN_SIZE == 0) {
+      carry += compressibility * RUN_SIZE;
+      zeros = static_cast<size_t>(carry);
+      carry -= zeros;
+    }
+    uint64_t r = m_rng();
+    for (size_t j = 0; j < sizeof(uint64_t) && i + j < pool_size; ++j) {
+      pool[i + j] = (i + j) % RUN_SIZE < zeros ? '\0' : static_cast<char>(r >> (8 * j));
+    }
+  }
+}
+
+size_t payload::next_size() {
+  switch (m_dist) {
+    case UNIFORM:
+      return std::uniform_int_distribution<size_t>(m_min_value_size, m_max_value_size)(m_rng);
+    case ZIPF:
+      return m_min_value_size + m_zipf->next_id();
+    case HISTOGRAM:
+      return m_histogram_sizes[m_histogram(m_rng)];
+    default:
+      return m_max_value_size;
+  }
+}
+
+payload::slice payload::next() {
+  return next(next_size());
+}
+
+payload::slice payload::next(size_t size) {
+  // Random offsets keep consecutive values from being identical, which deduplicating stores would exploit
+  auto offset = std::uniform_int_distribution<size_t>(0, m_pool->size() - size)(m_rng);
+  return {m_pool->data() + offset, size};
+}
+
+size_t payload::max_value_size() const {
+  return m_max_value_size;
+}
+
+void payload::print(std::ostream &out) const {
+  static const char *DIST_NAMES[] = {"fixed", "uniform", "zipf", "histogram"};
+  out << "Payload: value_size_distribution=" << DIST_NAMES[m_dist] << " min_value_size=" << m_min_value_size
+      << " max_value_size=" << m_max_value_size << " compressibility=" << m_compressibility
+      << " pool_size=" << m_pool->size();
+}
@@ -0,0 +1,65 @@
+#ifndef STORAGE_BENCH_PAYLOAD_H
+#define STORAGE_BENCH_PAYLOAD_H
+
+#include <string>
+#include <memory>
+#include <random>
+#include <vector>
+#include <ostream>
+#include "storage_interface.h"
+#include "key_generator.h"
+
+/*
+ * Values for writes, handed out as slices of a pool of pre-generated data so that no op copies or allocates
+ * its value. Configured by the [payload] section:
+ *
+ *   value_size_distribution=fixed   fixed (the value_size argument), uniform, zipf or histogram
+ *   min_value_size, max_value_size  size range for uniform and zipf; zipf favours the small sizes
+ *   value_size_zipf_theta=0.01      skew of zipf (0=pure zipf, 1=uniform)
+ *   value_size_histogram            empirical sizes as size:weight pairs, e.g. 128:0.6,4096:0.3,65536:0.1
+ *   compressibility=0               fraction of the data that compresses away (0=random, 1=all zeros)
+ *   pool_size=16777216              bytes of data to take slices from (at least twice the largest value)
+ */
+class payload {
+ public:
+  typedef storage_interface::value_slice slice;
+
+  payload(const storage_interface::property_map &conf, size_t value_size);
+  // Shares the pool of other, but draws sizes and offsets from an independently seeded stream
+  payload(const payload &other);
+
+  slice next();
+  // A value of the given size, at most max_value_size()
+  slice next(size_t size);
+
+  size_t max_value_size() const;
+  void print(std::ostream &out) const;
+
+ private:
+  enum distribution {
+    FIXED,
+    UNIFORM,
+    ZIPF,
+    HISTOGRAM
+  };
+
+  // Granularity at which zeros and random bytes alternate, fine enough for the smallest values to compress alike
+  static const size_t RUN_SIZE = 64;
+
+  size_t next_size();
+  void fill_pool(size_t pool_size, double compressibility);
+
+  distribution m_dist;
+  size_t m_min_value_size;
+  size_t m_max_value_size;
+  double m_compressibility;
+  std::vector<size_t> m_histogram_sizes;
+  std::vector<double> m_histogram_weights;
+  std::shared_ptr<std::vector<char>> m_pool;
+
+  std::mt19937_64 m_rng;
+  std::shared_ptr<zipf_key_generator> m_zipf;
+  std::discrete_distribution<size_t> m_histogram;
+};
+
+#endif //STORAGE_BENCH_PAYLOAD_H
@@ -1,64 +1,105 @@
 #include "rate_limiter.h"
+#include "hr_clock.h"
 
+#include <algorithm>
+#include <chrono>
+#include <limits>
 #include <thread>
 
-rate_limiter::rate_limiter() : m_interval(0), m_max_permits(0), m_stored_permits(0), m_next_free(0) {}
-
-rate_limiter::rate_limiter(double rate) : m_interval(0), m_max_permits(0), m_stored_permits(0), m_next_free(0) {
+rate_limiter::rate_limiter(double rate, const std::shared_ptr<rate_limiter> &parent)
+    : m_schedule(1, std::numeric_limits<double>::infinity()), m_parent(parent), m_first_slot(0), m_next_offset(0),
+      m_slots(0), m_late_slots(0), m_wake_error_ns(0), m_max_wake_error_ns(0) {
   set_rate(rate);
 }
 
-int64_t rate_limiter::acquire() {
-  auto wait_time = claim_next(1);
-  std::this_thread::sleep_for(wait_time);
-  return static_cast<int64_t>(wait_time.count() / 1000.0);
-}
-
-void rate_limiter::set_rate(double rate) {
-  if (rate <= 0.0) {
-    throw std::runtime_error("RateLimiter: Rate must be greater than 0");
+uint64_t rate_limiter::acquire_slot(uint64_t permits) {
+  auto slot = reserve(permits);
+  if (slot <= hr_clock::now_ns()) {
+    record_pacing(true, 0);
+    return slot;
   }
 
-  std::lock_guard<std::mutex> lock(m_mtx);
-  m_interval = 1000000.0 / rate;
+  wait_until(slot);
+  record_pacing(false, hr_clock::now_ns() - slot);
+  return slot;
 }
 
-double rate_limiter::get_rate() const {
-  return 1000000.0 / m_interval;
+uint64_t rate_limiter::reserve(uint64_t permits) {
+  uint64_t slot;
+  if (m_arrivals == nullptr) {
+    slot = m_schedule.reserve(permits);
+  } else {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    if (m_first_slot == 0) {
+      m_first_slot = hr_clock::now_ns();
+      m_next_offset = 0;
+      m_arrivals->restart();
+    }
+    // A batch is sent at the arrival of its first item, and the next one waits for the arrivals of the rest
+    slot = m_first_slot + static_cast<uint64_t>(m_next_offset);
+    for (uint64_t i = 0; i < permits; ++i)
+      m_next_offset = m_arrivals->next(m_next_offset, m_schedule.rate());
+  }
+  if (m_parent != nullptr)
+    slot = std::max(slot, m_parent->reserve(permits));
+  return slot;
 }
 
-void rate_limiter::sync(uint64_t now) {
-  // If we're passed the next_free, then recalculate
-  // stored permits, and update next_free_
-  if (now > m_next_free) {
-    m_stored_permits = std::min(m_max_permits, m_stored_permits + (now - m_next_free) / m_interval);
-    m_next_free = now;
+void rate_limiter::record_pacing(bool late, uint64_t wake_error_ns) {
+  for (auto limiter = this; limiter != nullptr; limiter = limiter->m_parent.get()) {
+    limiter->m_slots.fetch_add(1, std::memory_order_relaxed);
+    if (late) {
+      limiter->m_late_slots.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
+    limiter->m_wake_error_ns.fetch_add(wake_error_ns, std::memory_order_relaxed);
+    auto max_error = limiter->m_max_wake_error_ns.load(std::memory_order_relaxed);
+    while (wake_error_ns > max_error
+        && !limiter->m_max_wake_error_ns.compare_exchange_weak(max_error, wake_error_ns, std::memory_order_relaxed));
   }
 }
 
-std::chrono::microseconds rate_limiter::claim_next(double permits) {
+void rate_limiter::wait_until(uint64_t slot_ns) {
   using namespace std::chrono;
 
-  std::lock_guard<std::mutex> lock(m_mtx);
-
-  uint64_t now = static_cast<uint64_t>(duration_cast<microseconds>(system_clock::now().time_since_epoch()).count());
-
-  // Make sure we're synced
-  sync(now);
+  auto now = hr_clock::now_ns();
+  if (slot_ns > now + SLEEP_MARGIN_NS)
+    std::this_thread::sleep_for(nanoseconds(slot_ns - now - SLEEP_MARGIN_NS));
+  while ((now = hr_clock::now_ns()) + SPIN_NS < slot_ns)
+    std::this_thread::yield();
+  while (hr_clock::now_ns() < slot_ns);
+}
 
-  // Since we synced before hand, this will always be >= 0.
-  unsigned long long wait = m_next_free - now;
+void rate_limiter::set_rate(double rate) {
+  if (rate <= 0.0) {
+    throw std::runtime_error("RateLimiter: Rate must be greater than 0");
+  }
+  m_schedule.set_rate(rate);
+}
 
-  // Determine how many stored and freh permits to consume
-  double stored = std::min(permits, m_stored_permits);
-  double fresh = permits - stored;
+double rate_limiter::get_rate() const {
+  return m_schedule.rate();
+}
 
-  // In the general RateLimiter, stored permits have no wait time,
-  // and thus we only have to wait for however many fresh permits we consume
-  long next_free = (long) (fresh * m_interval);
+void rate_limiter::set_arrivals(const std::shared_ptr<arrival_process> &arrivals) {
+  std::lock_guard<std::mutex> lock(m_mtx);
+  m_arrivals = arrivals;
+}
 
-  m_next_free += next_free;
-  m_stored_permits -= stored;
-  return microseconds(wait);
+void rate_limiter::restart() {
+  std::lock_guard<std::mutex> lock(m_mtx);
+  m_first_slot = 0;
+  m_schedule.reset();
+  m_slots = 0;
+  m_late_slots = 0;
+  m_wake_error_ns = 0;
+  m_max_wake_error_ns = 0;
 }
 
+void rate_limiter::print_pacing(std::ostream &out) const {
+  auto slots = m_slots.load();
+  auto late = m_late_slots.load();
+  auto woken = slots - late;
+  out << "Pacing: " << slots << " slots, " << late << " already due when reserved, wake-up error mean "
+      << (woken > 0 ? m_wake_error_ns.load() / woken : 0) << " ns, max " << m_max_wake_error_ns.load() << " ns";
+}
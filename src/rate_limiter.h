@@ -1,30 +1,74 @@
 #ifndef STORAGE_BENCH_RATE_LIMITER_H
 #define STORAGE_BENCH_RATE_LIMITER_H
 
+#include <atomic>
 #include <cstdint>
-#include <chrono>
+#include <memory>
 #include <mutex>
+#include <ostream>
+#include "arrival_process.h"
+#include "token_bucket.h"
 
+/*
+ * Paces a sender. acquire_slot() reserves its slot on a lock-free token_bucket, so any number of threads can share
+ * one limiter, and waits for it by sleeping until shortly before, yielding, and spinning for the last few
+ * microseconds, which sleep granularity alone cannot hit at high rates. A limiter may have a parent whose rate
+ * bounds the sum over all of its children, e.g. global > tenant > thread; every level's slot must have come, and
+ * every level counts the slots of the levels below it in its pacing statistics.
+ */
 class rate_limiter {
  public:
-  rate_limiter();
-  explicit rate_limiter(double rate);
+  explicit rate_limiter(double rate, const std::shared_ptr<rate_limiter> &parent = nullptr);
 
-  int64_t acquire();
+  // Blocks until the next slot of a fixed send schedule and returns the slot's intended start time (an hr_clock
+  // reading, in ns). The schedule never slips when the caller falls behind: late slots are handed out
+  // immediately, so latency measured from the intended start includes any time spent waiting to be sent. A slot
+  // for a batch takes one permit per item, so that the rate counts items rather than batches.
+  uint64_t acquire_slot(uint64_t permits = 1);
 
   void set_rate(double rate);
   double get_rate() const;
- private:
-  void sync(uint64_t now);
-  std::chrono::microseconds claim_next(double permits);
+
+  // Starts the acquire_slot() schedule afresh from the next call, so that slots missed at an earlier rate are not
+  // handed out in a burst, and clears the pacing statistics
+  void restart();
+
+  // Draws the gaps between acquire_slot() slots from arrivals instead of spacing them evenly; set before the first
+  // acquire_slot()
+  void set_arrivals(const std::shared_ptr<arrival_process> &arrivals);
+
+  // How far past their slots acquire_slot() returned since the last restart()
+  void print_pacing(std::ostream &out) const;
+
+  // Waits for an hr_clock time the way acquire_slot() waits for its slot
+  static void wait_until(uint64_t slot_ns);
 
  private:
-  double m_interval;
-  double m_max_permits;
-  double m_stored_permits;
+  // Remaining time at which waits stop sleeping and start yielding, and stop yielding and start spinning
+  static const uint64_t SLEEP_MARGIN_NS = 100000;
+  static const uint64_t SPIN_NS = 5000;
 
-  uint64_t m_next_free;
+  // Reserves permits at this level and every level above, returning the latest time they are all available
+  uint64_t reserve(uint64_t permits);
+
+  // Counts a slot at this level and every level above
+  void record_pacing(bool late, uint64_t wake_error_ns);
+
+  token_bucket m_schedule;
+  std::shared_ptr<rate_limiter> m_parent;
+
+  // Schedule of slots drawn from m_arrivals, which needs the lock. Slots are kept as offsets from the first one,
+  // since a double holding an absolute hr_clock time only resolves 256 ns
+  uint64_t m_first_slot;
+  double m_next_offset;
+  std::shared_ptr<arrival_process> m_arrivals;
   std::mutex m_mtx;
+
+  // Slots that were already due when reserved, and how late the others were woken up
+  std::atomic<uint64_t> m_slots;
+  std::atomic<uint64_t> m_late_slots;
+  std::atomic<uint64_t> m_wake_error_ns;
+  std::atomic<uint64_t> m_max_wake_error_ns;
 };
 
 #endif //STORAGE_BENCH_RATE_LIMITER_H
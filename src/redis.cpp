@@ -97,6 +97,85 @@ std::string redis::wait_read() {
   return parse_read_response(reply);
 }
 
+void redis::submit_write(uint64_t tag, const std::string &key, const char *value, size_t length) {
+  auto idx = (hash(key) % m_client.size());
+  m_client[idx]->set(key, std::string(value, length), [this, tag](cpp_redis::reply &r) {
+    m_completions.push(make_completion(tag, [&]() {
+      parse_write_response(r);
+      return std::string();
+    }));
+  });
+  m_client[idx]->commit();
+}
+
+void redis::submit_read(uint64_t tag, const std::string &key) {
+  auto idx = (hash(key) % m_client.size());
+  m_client[idx]->get(key, [this, tag](cpp_redis::reply &r) {
+    m_completions.push(make_completion(tag, [&]() { return parse_read_response(r); }));
+  });
+  m_client[idx]->commit();
+}
+
+storage_interface::completion redis::wait_completion() {
+  return m_completions.pop();
+}
+
+void redis::multi_read(const std::vector<std::string> &keys, std::vector<std::string> &values) {
+  // One MGET per endpoint, all in flight at once
+  auto positions = partition(keys);
+  std::vector<std::future<cpp_redis::reply>> futures(m_client.size());
+  for (size_t idx = 0; idx < m_client.size(); ++idx) {
+    if (positions[idx].empty())
+      continue;
+    std::vector<std::string> endpoint_keys;
+    endpoint_keys.reserve(positions[idx].size());
+    for (auto i: positions[idx])
+      endpoint_keys.push_back(keys[i]);
+    futures[idx] = m_client[idx]->mget(endpoint_keys);
+    m_client[idx]->commit();
+  }
+
+  values.resize(keys.size());
+  for (size_t idx = 0; idx < m_client.size(); ++idx) {
+    if (positions[idx].empty())
+      continue;
+    auto reply = futures[idx].get();
+    if (reply.is_error())
+      throw std::runtime_error(reply.error());
+    const auto &replies = reply.as_array();
+    for (size_t j = 0; j < replies.size(); ++j)
+      values[positions[idx][j]] = parse_read_response(replies[j]);
+  }
+}
+
+void redis::multi_write(const std::vector<std::string> &keys, const std::vector<value_slice> &values) {
+  // One MSET per endpoint, all in flight at once
+  auto positions = partition(keys);
+  std::vector<std::future<cpp_redis::reply>> futures(m_client.size());
+  for (size_t idx = 0; idx < m_client.size(); ++idx) {
+    if (positions[idx].empty())
+      continue;
+    std::vector<std::pair<std::string, std::string>> key_values;
+    key_values.reserve(positions[idx].size());
+    for (auto i: positions[idx])
+      key_values.emplace_back(keys[i], std::string(values[i].data, values[i].size));
+    futures[idx] = m_client[idx]->mset(key_values);
+    m_client[idx]->commit();
+  }
+
+  for (size_t idx = 0; idx < m_client.size(); ++idx) {
+    if (!positions[idx].empty())
+      parse_write_response(futures[idx].get());
+  }
+}
+
+std::vector<std::vector<size_t>> redis::partition(const std::vector<std::string> &keys) const {
+  std::vector<std::vector<size_t>> positions(m_client.size());
+  for (size_t i = 0; i < keys.size(); ++i)
+    positions[hash(keys[i]) % m_client.size()].push_back(i);
+  return positions;
+}
+
 std::future<cpp_redis::reply> redis::send_write(const std::string &key, const std::string &value) {
   auto idx = (hash(key) % m_client.size());
   auto fut = m_client[idx]->set(key, value);
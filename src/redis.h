@@ -16,11 +16,19 @@ class redis : public storage_interface {
   void read_async(const std::string &key) override;
   void wait_write() override;
   std::string wait_read() override;
+  void submit_write(uint64_t tag, const std::string &key, const char *value, size_t length) override;
+  void submit_read(uint64_t tag, const std::string &key) override;
+  completion wait_completion() override;
+  void multi_read(const std::vector<std::string> &keys, std::vector<std::string> &values) override;
+  void multi_write(const std::vector<std::string> &keys, const std::vector<value_slice> &values) override;
 
  private:
   std::future<cpp_redis::reply> send_write(const std::string &key, const std::string &value);
   std::future<cpp_redis::reply> send_read(const std::string &key);
 
+  // Positions in keys of the keys held by each endpoint
+  std::vector<std::vector<size_t>> partition(const std::vector<std::string> &keys) const;
+
   std::string  parse_read_response(const cpp_redis::reply &r);
   void parse_write_response(const cpp_redis::reply &r);
 
@@ -42,6 +50,8 @@ class redis : public storage_interface {
 
   queue<std::future<cpp_redis::reply>> m_get_futures;
   queue<std::future<cpp_redis::reply>> m_put_futures;
+  // Pushed by the clients' reply callbacks
+  queue<completion> m_completions;
 };
 
 #endif //STORAGE_BENCH_REDIS_H
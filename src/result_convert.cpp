@@ -0,0 +1,26 @@
+#include <iostream>
+#include "result_file.h"
+#include "benchmark_utils.h"
+
+int main(int argc, char **argv) {
+  if (argc != 2 && argc != 3) {
+    std::cerr << "Usage: " << argv[0] << " results_file [column1,column2,...]" << std::endl;
+    return -1;
+  }
+
+  std::vector<std::string> columns;
+  if (argc == 3) {
+    benchmark_utils::split(argv[2], columns, ',');
+  }
+
+  try {
+    result_file f;
+    f.read(argv[1]);
+    f.write_tsv(std::cout, columns);
+  } catch (std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,229 @@
+#include "result_file.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+size_t result_file::column::width() const {
+  switch (type) {
+    case UINT8:return sizeof(uint8_t);
+    case UINT16:return sizeof(uint16_t);
+    case UINT32:return sizeof(uint32_t);
+    case UINT64:return sizeof(uint64_t);
+    case DOUBLE:return sizeof(double);
+  }
+  throw std::runtime_error("Unknown column type " + std::to_string(type) + " for column " + name);
+}
+
+static uint64_t integer_at(const result_file::column &c, size_t row) {
+  const char *p = c.data.data() + row * c.width();
+  switch (c.type) {
+    case result_file::UINT8: {
+      return *reinterpret_cast<const uint8_t *>(p) + c.offset;
+    }
+    case result_file::UINT16: {
+      uint16_t v;
+      memcpy(&v, p, sizeof(v));
+      return v + c.offset;
+    }
+    case result_file::UINT32: {
+      uint32_t v;
+      memcpy(&v, p, sizeof(v));
+      return v + c.offset;
+    }
+    case result_file::UINT64: {
+      uint64_t v;
+      memcpy(&v, p, sizeof(v));
+      return v + c.offset;
+    }
+    case result_file::DOUBLE:break;
+  }
+  throw std::invalid_argument("Column " + c.name + " is not an integer column");
+}
+
+void result_file::column::format(size_t row, std::ostream &out) const {
+  if (type == DOUBLE) {
+    double v;
+    memcpy(&v, data.data() + row * width(), sizeof(v));
+    out << v;
+  } else {
+    out << integer_at(*this, row);
+  }
+}
+
+void result_file::write(const std::string &path) const {
+  std::ofstream out(path, std::ios::binary);
+  if (!out) {
+    throw std::runtime_error("Could not open " + path + " for writing");
+  }
+  uint32_t version = VERSION;
+  auto num_columns = static_cast<uint32_t>(m_columns.size());
+  auto num_rows = static_cast<uint64_t>(m_num_rows);
+  out.write(MAGIC, strlen(MAGIC));
+  out.write(reinterpret_cast<const char *>(&version), sizeof(version));
+  out.write(reinterpret_cast<const char *>(&num_columns), sizeof(num_columns));
+  out.write(reinterpret_cast<const char *>(&num_rows), sizeof(num_rows));
+  for (const auto &c: m_columns) {
+    char name[NAME_LENGTH] = {0};
+    strncpy(name, c.name.c_str(), NAME_LENGTH - 1);
+    auto type = static_cast<uint32_t>(c.type);
+    out.write(name, NAME_LENGTH);
+    out.write(reinterpret_cast<const char *>(&type), sizeof(type));
+    out.write(reinterpret_cast<const char *>(&c.offset), sizeof(c.offset));
+  }
+  for (const auto &c: m_columns) {
+    out.write(c.data.data(), c.data.size());
+  }
+}
+
+void result_file::read(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    throw std::runtime_error("Could not open " + path + " for reading");
+  }
+  char magic[8];
+  uint32_t version;
+  uint32_t num_columns;
+  uint64_t num_rows;
+  in.read(magic, sizeof(magic));
+  if (!in || memcmp(magic, MAGIC, sizeof(magic)) != 0) {
+    throw std::runtime_error(path + " is not a results file");
+  }
+  in.read(reinterpret_cast<char *>(&version), sizeof(version));
+  if (version != 1 && version != VERSION) {
+    throw std::runtime_error("Unsupported results file version " + std::to_string(version));
+  }
+  in.read(reinterpret_cast<char *>(&num_columns), sizeof(num_columns));
+  in.read(reinterpret_cast<char *>(&num_rows), sizeof(num_rows));
+
+  m_num_rows = num_rows;
+  m_columns.resize(num_columns);
+  for (auto &c: m_columns) {
+    char name[NAME_LENGTH];
+    uint32_t type;
+    in.read(name, NAME_LENGTH);
+    in.read(reinterpret_cast<char *>(&type), sizeof(type));
+    c.name = std::string(name, strnlen(name, NAME_LENGTH));
+    c.type = static_cast<column_type>(type);
+    c.offset = 0;
+    if (version >= 2)
+      in.read(reinterpret_cast<char *>(&c.offset), sizeof(c.offset));
+  }
+  for (auto &c: m_columns) {
+    c.data.resize(m_num_rows * c.width());
+    in.read(c.data.data(), c.data.size());
+  }
+  if (!in) {
+    throw std::runtime_error(path + " is truncated");
+  }
+}
+
+std::vector<uint64_t> result_file::integer_values(const std::string &name) const {
+  for (const auto &c: m_columns) {
+    if (c.name != name)
+      continue;
+    std::vector<uint64_t> values(m_num_rows);
+    for (size_t row = 0; row < m_num_rows; ++row)
+      values[row] = integer_at(c, row);
+    return values;
+  }
+  throw std::invalid_argument("No such column: " + name);
+}
+
+void result_file::write_tsv(std::ostream &out, const std::vector<std::string> &names) const {
+  std::vector<const column *> selected;
+  if (names.empty()) {
+    for (const auto &c: m_columns)
+      selected.push_back(&c);
+  } else {
+    for (const auto &name: names) {
+      auto it = std::find_if(m_columns.begin(), m_columns.end(), [&name](const column &c) {
+        return c.name == name;
+      });
+      if (it == m_columns.end()) {
+        throw std::invalid_argument("No such column " + name);
+      }
+      selected.push_back(&(*it));
+    }
+  }
+  for (size_t row = 0; row < m_num_rows; ++row) {
+    for (size_t i = 0; i < selected.size(); ++i) {
+      if (i != 0)
+        out << "\t";
+      selected[i]->format(row, out);
+    }
+    out << "\n";
+  }
+}
+
+// Adds values as a u32 column if they fit in one after subtracting offset, and as a u64 column otherwise
+static void add_narrowest(result_file &f, const std::string &name, const std::vector<uint64_t> &values,
+                          uint64_t offset) {
+  if (std::all_of(values.begin(), values.end(), [offset](uint64_t v) { return v - offset <= UINT32_MAX; })) {
+    std::vector<uint32_t> narrow;
+    narrow.reserve(values.size());
+    for (auto v: values)
+      narrow.push_back(static_cast<uint32_t>(v - offset));
+    f.add_column(name, narrow, offset);
+  } else {
+    f.add_column(name, values);
+  }
+}
+
+static bool s_detail_columns = false;
+
+void record_buffer::set_detail_columns(bool enabled) {
+  s_detail_columns = enabled;
+}
+
+record_buffer::record_buffer(size_t capacity) {
+  m_timestamp.reserve(capacity);
+  m_latency.reserve(capacity);
+  m_op.reserve(capacity);
+  m_status.reserve(capacity);
+  m_value_size.reserve(capacity);
+}
+
+void record_buffer::write(const std::string &path, const std::vector<record_buffer> &buffers) {
+  std::vector<std::pair<size_t, size_t>> rows;
+  for (size_t b = 0; b < buffers.size(); ++b) {
+    for (size_t i = 0; i < buffers[b].size(); ++i) {
+      rows.emplace_back(b, i);
+    }
+  }
+  std::stable_sort(rows.begin(), rows.end(), [&buffers](const std::pair<size_t, size_t> &x,
+                                                        const std::pair<size_t, size_t> &y) {
+    return buffers[x.first].m_timestamp[x.second] < buffers[y.first].m_timestamp[y.second];
+  });
+
+  std::vector<uint64_t> timestamp;
+  std::vector<uint64_t> latency;
+  std::vector<uint8_t> op_status;
+  timestamp.reserve(rows.size());
+  latency.reserve(rows.size());
+  op_status.reserve(rows.size());
+  for (const auto &r: rows) {
+    const auto &buf = buffers[r.first];
+    timestamp.push_back(hr_clock::to_wall_us(buf.m_timestamp[r.second]));
+    latency.push_back(buf.m_latency[r.second]);
+    op_status.push_back(static_cast<uint8_t>(buf.m_op[r.second] | buf.m_status[r.second] << STATUS_SHIFT));
+  }
+
+  result_file f;
+  add_narrowest(f, "timestamp_us", timestamp, timestamp.empty() ? 0 : timestamp.front());
+  add_narrowest(f, "latency_ns", latency, 0);
+  f.add_column("op_status", op_status);
+  if (s_detail_columns) {
+    std::vector<uint32_t> value_size;
+    std::vector<uint16_t> worker;
+    value_size.reserve(rows.size());
+    worker.reserve(rows.size());
+    for (const auto &r: rows) {
+      value_size.push_back(buffers[r.first].m_value_size[r.second]);
+      worker.push_back(static_cast<uint16_t>(r.first));
+    }
+    f.add_column("value_size", value_size);
+    f.add_column("worker", worker);
+  }
+  f.write(path);
+}
@@ -0,0 +1,203 @@
+#ifndef STORAGE_BENCH_RESULT_FILE_H
+#define STORAGE_BENCH_RESULT_FILE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <stdexcept>
+#include "hr_clock.h"
+
+/*
+ * Self-describing columnar results file:
+ *
+ *   magic "SBRESULT" | version (u32) | num_columns (u32) | num_rows (u64)
+ *   num_columns x { name (char[32], NUL padded) | type (u32) | offset (u64) }
+ *   num_columns x column data (num_rows values of the column's type, native byte order)
+ *
+ * The value of an integer column is its stored value plus the column's offset, so e.g. timestamps can be stored
+ * as narrow deltas from a base. Version 1 files have no offsets. Results are buffered in memory while a phase runs
+ * and written once it is over.
+ */
+class result_file {
+ public:
+  static constexpr const char *MAGIC = "SBRESULT";
+  static const uint32_t VERSION = 2;
+  static const size_t NAME_LENGTH = 32;
+
+  enum column_type : uint32_t {
+    UINT8 = 1,
+    UINT16 = 2,
+    UINT32 = 3,
+    UINT64 = 4,
+    DOUBLE = 5
+  };
+
+  struct column {
+    std::string name;
+    column_type type;
+    uint64_t offset;
+    std::vector<char> data;
+
+    size_t width() const;
+    // Appends the value at row to out as text
+    void format(size_t row, std::ostream &out) const;
+  };
+
+  template<typename T>
+  void add_column(const std::string &name, const std::vector<T> &values, uint64_t offset = 0) {
+    if (m_columns.empty()) {
+      m_num_rows = values.size();
+    } else if (values.size() != m_num_rows) {
+      throw std::invalid_argument("Column " + name + " has " + std::to_string(values.size()) + " rows, expected "
+                                      + std::to_string(m_num_rows));
+    }
+    column c;
+    c.name = name;
+    c.type = type_of(T());
+    c.offset = offset;
+    auto begin = reinterpret_cast<const char *>(values.data());
+    c.data.assign(begin, begin + values.size() * sizeof(T));
+    m_columns.push_back(std::move(c));
+  }
+
+  void write(const std::string &path) const;
+  void read(const std::string &path);
+
+  // Writes one tab separated line per row, restricted to the named columns (all columns if empty)
+  void write_tsv(std::ostream &out, const std::vector<std::string> &names) const;
+
+  size_t num_rows() const {
+    return m_num_rows;
+  }
+
+  const std::vector<column> &columns() const {
+    return m_columns;
+  }
+
+  bool has_column(const std::string &name) const {
+    return std::any_of(m_columns.begin(), m_columns.end(), [&name](const column &c) { return c.name == name; });
+  }
+
+  // Values of the named integer column of any width, with its offset added
+  std::vector<uint64_t> integer_values(const std::string &name) const;
+
+  // Stored values of the named column, which must hold values of type T
+  template<typename T>
+  std::vector<T> column_values(const std::string &name) const {
+    for (const auto &c: m_columns) {
+      if (c.name != name)
+        continue;
+      if (c.type != type_of(T()))
+        throw std::invalid_argument("Column " + name + " has a different type");
+      std::vector<T> values(m_num_rows);
+      std::copy(c.data.begin(), c.data.end(), reinterpret_cast<char *>(values.data()));
+      return values;
+    }
+    throw std::invalid_argument("No such column: " + name);
+  }
+
+ private:
+  static column_type type_of(uint8_t) { return UINT8; }
+  static column_type type_of(uint16_t) { return UINT16; }
+  static column_type type_of(uint32_t) { return UINT32; }
+  static column_type type_of(uint64_t) { return UINT64; }
+  static column_type type_of(double) { return DOUBLE; }
+
+  size_t m_num_rows{0};
+  std::vector<column> m_columns;
+};
+
+/*
+ * Preallocated per-worker buffer of fixed-width operation records. Recording appends to reserved column
+ * vectors, so it never touches the filesystem and does not allocate until capacity is exceeded.
+ *
+ * Records are written as narrowly as they fit: timestamps as u32 deltas from the first one, latencies as u32 and
+ * the op and status packed into one byte (9 bytes per op), widening timestamps and latencies to u64 only if a run
+ * is too long or an op too slow for u32. The value_size and worker columns are only written if enabled.
+ */
+class record_buffer {
+ public:
+  enum op_type : uint8_t {
+    OP_READ = 0,
+    OP_WRITE = 1,
+    OP_UPDATE = 2,
+    OP_INSERT = 3,
+    OP_READ_MODIFY_WRITE = 4,
+    OP_SCAN = 5
+  };
+
+  enum op_status : uint8_t {
+    STATUS_OK = 0,
+    STATUS_ERROR = 1
+  };
+
+  // The op_status column holds the op in its low bits and the status in its top bit
+  static const int STATUS_SHIFT = 7;
+  static const uint8_t OP_MASK = (1 << STATUS_SHIFT) - 1;
+
+  explicit record_buffer(size_t capacity = 0);
+
+  // end_ns is an hr_clock reading; value_size is the number of value bytes written or read by the op
+  void record(uint64_t end_ns, uint64_t latency_ns, op_type op, op_status status, size_t value_size) {
+    m_timestamp.push_back(end_ns);
+    m_latency.push_back(latency_ns);
+    m_op.push_back(op);
+    m_status.push_back(status);
+    m_value_size.push_back(static_cast<uint32_t>(value_size));
+  }
+
+  size_t size() const {
+    return m_timestamp.size();
+  }
+
+  // Writes the records of all buffers, ordered by completion time, as a columnar results file with the
+  // columns timestamp_us (wall clock), latency_ns and op_status, followed by value_size and worker if enabled
+  static void write(const std::string &path, const std::vector<record_buffer> &buffers);
+
+  // Whether write() adds the value_size and worker columns; off by default
+  static void set_detail_columns(bool enabled);
+
+ private:
+  std::vector<uint64_t> m_timestamp;
+  std::vector<uint64_t> m_latency;
+  std::vector<uint8_t> m_op;
+  std::vector<uint8_t> m_status;
+  std::vector<uint32_t> m_value_size;
+};
+
+/*
+ * Buffered (timestamp, value) samples, e.g. per-interval throughput, written as a two column results file.
+ * Timestamps are recorded as hr_clock readings and written as wall clock microseconds.
+ */
+template<typename T>
+class series_buffer {
+ public:
+  explicit series_buffer(size_t capacity) {
+    m_timestamp.reserve(capacity);
+    m_value.reserve(capacity);
+  }
+
+  void record(uint64_t timestamp_ns, T value) {
+    m_timestamp.push_back(timestamp_ns);
+    m_value.push_back(value);
+  }
+
+  void write(const std::string &path, const std::string &value_name) const {
+    std::vector<uint64_t> timestamp_us;
+    timestamp_us.reserve(m_timestamp.size());
+    for (auto ts: m_timestamp)
+      timestamp_us.push_back(hr_clock::to_wall_us(ts));
+    result_file f;
+    f.add_column("timestamp_us", timestamp_us);
+    f.add_column(value_name, m_value);
+    f.write(path);
+  }
+
+ private:
+  std::vector<uint64_t> m_timestamp;
+  std::vector<T> m_value;
+};
+
+#endif //STORAGE_BENCH_RESULT_FILE_H
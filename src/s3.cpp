@@ -82,6 +82,38 @@ void s3::read_async(const std::string &key) {
   m_get_callables.push(m_client->GetObjectCallable(make_get_request(key)));
 }
 
+void s3::write_slice(const std::string &key, const char *value, size_t length) {
+  auto outcome = m_client->PutObject(make_put_request(key, value, length));
+  parse_put_response(outcome);
+}
+
+void s3::write_slice_async(const std::string &key, const char *value, size_t length) {
+  m_put_callables.push(m_client->PutObjectCallable(make_put_request(key, value, length)));
+}
+
+void s3::submit_write(uint64_t tag, const std::string &key, const char *value, size_t length) {
+  m_client->PutObjectAsync(make_put_request(key, value, length),
+                           [this, tag](const S3Client *, const PutObjectRequest &, const PutObjectOutcome &outcome,
+                                       const std::shared_ptr<const AsyncCallerContext> &) {
+                             m_completions.push(make_completion(tag, [&]() {
+                               parse_put_response(outcome);
+                               return std::string();
+                             }));
+                           });
+}
+
+void s3::submit_read(uint64_t tag, const std::string &key) {
+  m_client->GetObjectAsync(make_get_request(key),
+                           [this, tag](const S3Client *, const GetObjectRequest &, const GetObjectOutcome &outcome,
+                                       const std::shared_ptr<const AsyncCallerContext> &) {
+                             m_completions.push(make_completion(tag, [&]() { return parse_get_response(outcome); }));
+                           });
+}
+
+storage_interface::completion s3::wait_completion() {
+  return m_completions.pop();
+}
+
 void s3::wait_write() {
   auto outcome = m_put_callables.pop().get();
   parse_put_response(outcome);
@@ -103,20 +135,42 @@ Aws::S3::Model::PutObjectRequest s3::make_put_request(const std::string &key, co
   return request;
 }
 
+/*
+ * Request body that reads straight from the caller's buffer; the stream owns its stream buffer, so the
+ * request can outlive the call that made it.
+ */
+class slice_stream : public Aws::IOStream {
+ public:
+  slice_stream(const char *value, size_t length)
+      : Aws::IOStream(&m_buf),
+        m_buf(reinterpret_cast<unsigned char *>(const_cast<char *>(value)), static_cast<uint64_t>(length)) {}
+
+ private:
+  Aws::Utils::Stream::PreallocatedStreamBuf m_buf;
+};
+
+Aws::S3::Model::PutObjectRequest s3::make_put_request(const std::string &key, const char *value, size_t length) const {
+  Aws::S3::Model::PutObjectRequest request;
+  request.WithBucket(m_bucket_name).WithKey(key.c_str());
+  request.SetBody(Aws::MakeShared<slice_stream>("DataStream", value, length));
+  request.SetContentLength(static_cast<long long>(length));
+  return request;
+}
+
 Aws::S3::Model::GetObjectRequest s3::make_get_request(const std::string &key) const {
   Aws::S3::Model::GetObjectRequest request;
   request.WithBucket(m_bucket_name).WithKey(key.c_str());
   return request;
 }
 
-std::string s3::parse_get_response(Aws::S3::Model::GetObjectOutcome &outcome) const {
+std::string s3::parse_get_response(const Aws::S3::Model::GetObjectOutcome &outcome) const {
   if (!outcome.IsSuccess())
     throw std::runtime_error(outcome.GetError().GetMessage().c_str());
   auto in = std::make_shared<Aws::IOStream>(outcome.GetResult().GetBody().rdbuf());
   return std::string(std::istreambuf_iterator<char>(*in), std::istreambuf_iterator<char>());
 }
 
-void s3::parse_put_response(Aws::S3::Model::PutObjectOutcome &outcome) const {
+void s3::parse_put_response(const Aws::S3::Model::PutObjectOutcome &outcome) const {
   if (!outcome.IsSuccess())
     throw std::runtime_error(outcome.GetError().GetMessage().c_str());
 }
@@ -7,6 +7,7 @@
 #include <aws/s3/model/PutObjectRequest.h>
 #include <aws/s3/model/GetObjectRequest.h>
 #include <aws/core/utils/stream/SimpleStreamBuf.h>
+#include <aws/core/utils/stream/PreallocatedStreamBuf.h>
 #include "storage_interface.h"
 #include "queue.h"
 
@@ -24,6 +25,11 @@ class s3 : public storage_interface {
   void read_async(const std::string &key) override;
   void wait_write() override;
   std::string wait_read() override;
+  void write_slice(const std::string &key, const char *value, size_t length) override;
+  void write_slice_async(const std::string &key, const char *value, size_t length) override;
+  void submit_write(uint64_t tag, const std::string &key, const char *value, size_t length) override;
+  void submit_read(uint64_t tag, const std::string &key) override;
+  completion wait_completion() override;
 
  private:
   void empty_bucket(const Aws::String &bucket_name);
@@ -32,12 +38,15 @@ class s3 : public storage_interface {
   bool wait_for_bucket_to_propagate();
 
   Aws::S3::Model::PutObjectRequest make_put_request(const std::string &key, const std::string &value) const;
+  Aws::S3::Model::PutObjectRequest make_put_request(const std::string &key, const char *value, size_t length) const;
   Aws::S3::Model::GetObjectRequest make_get_request(const std::string &key) const;
-  std::string parse_get_response(Aws::S3::Model::GetObjectOutcome &outcome) const;
-  void parse_put_response(Aws::S3::Model::PutObjectOutcome &outcome) const;
+  std::string parse_get_response(const Aws::S3::Model::GetObjectOutcome &outcome) const;
+  void parse_put_response(const Aws::S3::Model::PutObjectOutcome &outcome) const;
 
   queue<Aws::S3::Model::PutObjectOutcomeCallable> m_put_callables;
   queue<Aws::S3::Model::GetObjectOutcomeCallable> m_get_callables;
+  // Pushed by the client's async response handlers
+  queue<completion> m_completions;
   Aws::String m_bucket_name;
   std::shared_ptr<Aws::S3::S3Client> m_client;
 };
@@ -0,0 +1,521 @@
+#include "sharded.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include "benchmark.h"
+#include "benchmark_utils.h"
+#include "hr_clock.h"
+
+// 64-bit FNV-1a, finished with the splitmix64 mixer so that keys differing only in their last digits spread out
+static uint64_t hash_key(const std::string &key) {
+  uint64_t h = 14695981039346656037ULL;
+  for (auto c: key) {
+    h ^= static_cast<unsigned char>(c);
+    h *= 1099511628211ULL;
+  }
+  h ^= h >> 30;
+  h *= 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 27;
+  h *= 0x94d049bb133111ebULL;
+  return h ^ (h >> 31);
+}
+
+// Lamping and Veach, "A Fast, Minimal Memory, Consistent Hash Algorithm"
+static size_t jump_hash(uint64_t key, size_t num_buckets) {
+  int64_t b = -1;
+  int64_t j = 0;
+  while (j < static_cast<int64_t>(num_buckets)) {
+    b = j;
+    key = key * 2862933555777941757ULL + 1;
+    j = static_cast<int64_t>(static_cast<double>(b + 1) * (static_cast<double>(1LL << 31)
+        / static_cast<double>((key >> 33) + 1)));
+  }
+  return static_cast<size_t>(b);
+}
+
+// Which shard owns each key, for a given number of shards
+class sharded::layout {
+ public:
+  layout(const std::string &hashing, size_t num_shards, size_t virtual_nodes)
+      : m_ring(hashing == "ring"), m_num_shards(num_shards) {
+    if (!m_ring)
+      return;
+    for (size_t s = 0; s < num_shards; ++s) {
+      for (size_t v = 0; v < virtual_nodes; ++v)
+        m_points.emplace_back(hash_key("shard" + std::to_string(s) + "#" + std::to_string(v)), s);
+    }
+    std::sort(m_points.begin(), m_points.end());
+  }
+
+  size_t owner(uint64_t hash) const {
+    if (!m_ring)
+      return jump_hash(hash, m_num_shards);
+    // The first point clockwise from the key's hash
+    auto it = std::upper_bound(m_points.begin(), m_points.end(), std::make_pair(hash, m_num_shards));
+    return it == m_points.end() ? m_points.front().second : it->second;
+  }
+
+  size_t size() const {
+    return m_num_shards;
+  }
+
+  // The fraction of the hash space each shard owns, which is the fraction of keys it can expect to get
+  std::vector<double> shares() const {
+    std::vector<double> shares(m_num_shards, m_ring ? 0.0 : 1.0 / m_num_shards);
+    // Each point owns the arc from the point before it; the first one's wraps around
+    for (size_t i = 0; i < m_points.size(); ++i) {
+      auto arc = m_points[i].first - m_points[i == 0 ? m_points.size() - 1 : i - 1].first;
+      shares[m_points[i].second] += static_cast<double>(arc) / 18446744073709551616.0;
+    }
+    return shares;
+  }
+
+ private:
+  bool m_ring;
+  size_t m_num_shards;
+  std::vector<std::pair<uint64_t, size_t>> m_points;
+};
+
+// Whether key is one of the ids [0, num_keys) as key_generator formats them
+static bool in_dataset(const std::string &key, size_t num_keys) {
+  if (key.empty() || key.size() > 19 || (key[0] == '0' && key.size() > 1))
+    return false;
+  uint64_t id = 0;
+  for (auto c: key) {
+    if (c < '0' || c > '9')
+      return false;
+    id = id * 10 + static_cast<uint64_t>(c - '0');
+  }
+  return id < num_keys;
+}
+
+// The current layout, and the thread that rebalances keys to the next one
+class sharded::state {
+ public:
+  // What a request needs to pick a shard. There is one per phase, known from the start, and the current one is
+  // switched with a single atomic pointer, so that a request never sees the new layout together with the phase from
+  // before the switch and never takes a lock to find out
+  struct routing {
+    std::shared_ptr<const layout> current;
+    // The layout keys are still being moved from, during a rebalance
+    std::shared_ptr<const layout> previous;
+    stats::phase phase;
+  };
+
+  state(std::shared_ptr<const layout> initial,
+        std::shared_ptr<const layout> next,
+        std::vector<std::shared_ptr<storage_interface>> movers,
+        uint64_t rebalance_ns)
+      : m_routings{{initial, nullptr, stats::BEFORE}, {next, initial, stats::DURING}, {next, nullptr, stats::AFTER}},
+        m_routing(&m_routings[stats::BEFORE]), m_next(std::move(next)), m_movers(std::move(movers)),
+        m_rebalance_ns(rebalance_ns), m_moved_keys(0), m_moved_bytes(0), m_modulo_moved_keys(0),
+        m_keys_at_rebalance(0), m_rebalance_s(0), m_stop(false) {
+    if (m_next != nullptr)
+      m_mover = std::thread(&state::rebalance, this);
+  }
+
+  ~state() {
+    stop();
+    if (m_mover.joinable())
+      m_mover.join();
+  }
+
+  const routing &snapshot() const {
+    return *m_routing.load(std::memory_order_acquire);
+  }
+
+  // Writes only need to be serialized with moves, and keys only tracked, while a rebalance is to come or under way
+  bool rebalancing() const {
+    return m_next != nullptr;
+  }
+
+  // Serializes writes of a key with its move to another shard, and guards the keys tracked for its stripe
+  std::mutex &stripe(uint64_t hash) {
+    return m_stripes[hash % NUM_STRIPES].mtx;
+  }
+
+  // Called with the key's stripe locked, after it was written under the layout of r: before the switch the key is
+  // to be moved, during the move it must not be overwritten by its old value
+  void wrote(const std::string &key, uint64_t hash, const routing &r) {
+    auto &s = m_stripes[hash % NUM_STRIPES];
+    if (r.phase == stats::BEFORE)
+      s.written.insert(key);
+    else if (r.phase == stats::DURING)
+      s.placed.insert(key);
+  }
+
+  // Stops the rebalance, e.g. because destroy() removed the keys it would move
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock(m_mtx);
+      m_stop = true;
+    }
+    m_cv.notify_one();
+  }
+
+  void print(std::ostream &out, const stats &s) {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    const auto &r = snapshot();
+    auto shares = r.current->shares();
+    shares.resize(s.ops.size(), 0.0);
+    out << "Shards (shard, ops, bytes, % of the key space owned at the end):";
+    for (size_t i = 0; i < s.ops.size(); ++i)
+      out << " " << i << ":" << s.ops[i] << ":" << s.bytes[i] << ":" << 100.0 * shares[i];
+    out << std::endl;
+    out << "Key imbalance (largest share of the key space over the mean): "
+        << *std::max_element(shares.begin(), shares.end()) * r.current->size() << std::endl;
+    if (m_next == nullptr || r.phase == stats::BEFORE)
+      return;
+    auto fraction = [&](size_t n) {
+      return m_keys_at_rebalance > 0 ? 100.0 * n / m_keys_at_rebalance : 0.0;
+    };
+    out << "Rebalance to " << m_next->size() << " shards moved " << m_moved_keys << " of " << m_keys_at_rebalance
+        << " keys (" << fraction(m_moved_keys) << "%), " << m_moved_bytes << " bytes, ";
+    if (r.phase == stats::DURING)
+      out << "and was still moving keys when the run ended";
+    else
+      out << "in " << m_rebalance_s << " s";
+    out << "; hashing modulo the number of shards would have moved " << m_modulo_moved_keys << " ("
+        << fraction(m_modulo_moved_keys) << "%)" << std::endl;
+  }
+
+ private:
+  static const size_t NUM_STRIPES = 256;
+
+  struct stripe_keys {
+    std::mutex mtx;
+    // Keys written before the switch, and keys written or moved under the new layout since
+    std::unordered_set<std::string> written;
+    std::unordered_set<std::string> placed;
+  };
+
+  bool stopped() {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    return m_stop;
+  }
+
+  // Copies key from its old owner to its new one unless it was written under the new layout already; returns false
+  // once the rebalance is stopped
+  bool move(const std::string &key, const routing &r) {
+    auto h = hash_key(key);
+    auto from = r.previous->owner(h);
+    auto to = r.current->owner(h);
+    if (from == to)
+      return true;
+    auto &s = m_stripes[h % NUM_STRIPES];
+    std::lock_guard<std::mutex> stripe_lock(s.mtx);
+    if (stopped())
+      return false;
+    if (!s.placed.insert(key).second)
+      return true;
+    size_t size = 0;
+    try {
+      auto value = m_movers[from]->read(key);
+      m_movers[to]->write(key, value);
+      size = value.size();
+    } catch (std::runtime_error &e) {
+      std::cerr << "WARN Could not move " << key << ": " << e.what() << std::endl;
+      return true;
+    }
+    std::lock_guard<std::mutex> lock(m_mtx);
+    ++m_moved_keys;
+    m_moved_bytes += size;
+    return true;
+  }
+
+  void rebalance() {
+    {
+      std::unique_lock<std::mutex> lock(m_mtx);
+      auto due = std::chrono::steady_clock::now() + std::chrono::nanoseconds(m_rebalance_ns);
+      if (m_cv.wait_until(lock, due, [this] { return m_stop; }))
+        return;
+    }
+    const auto &r = m_routings[stats::DURING];
+    {
+      // No write is in flight while the layout changes, so every key written before is in a stripe's written set
+      std::vector<std::unique_lock<std::mutex>> stripe_locks;
+      for (auto &s: m_stripes)
+        stripe_locks.emplace_back(s.mtx);
+      std::cerr << "Rebalancing from " << r.previous->size() << " to " << r.current->size() << " shards..."
+                << std::endl;
+      m_routing.store(&r, std::memory_order_release);
+    }
+
+    // The keys to move are those written so far and those of the dataset preload() recorded in the manifest, which
+    // may have been loaded by another process or an earlier run. Keys are only hashed here; reads find a key's
+    // old owner from the layouts alone.
+    auto begin_ns = hr_clock::now_ns();
+    benchmark::dataset_manifest manifest{0, 0};
+    std::string manifest_key = benchmark::MANIFEST_KEY;
+    bool has_manifest = benchmark::read_manifest(*m_movers[r.previous->owner(hash_key(manifest_key))],
+                                                 manifest_key, manifest);
+    std::vector<std::string> keys;
+    if (has_manifest)
+      keys.push_back(manifest_key);
+    for (auto &s: m_stripes) {
+      std::lock_guard<std::mutex> stripe_lock(s.mtx);
+      for (const auto &key: s.written) {
+        if (key != manifest_key && !in_dataset(key, manifest.num_keys))
+          keys.push_back(key);
+      }
+    }
+    char buf[key_generator::MAX_KEY_LENGTH];
+    auto count = [&](const std::string &key) {
+      auto h = hash_key(key);
+      if (h % r.previous->size() != h % r.current->size()) {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        ++m_modulo_moved_keys;
+      }
+    };
+    for (uint64_t id = 0; id < manifest.num_keys; ++id)
+      count(std::string(buf, key_generator::format(id, buf)));
+    for (const auto &key: keys)
+      count(key);
+    {
+      std::lock_guard<std::mutex> lock(m_mtx);
+      m_keys_at_rebalance = manifest.num_keys + keys.size();
+    }
+
+    for (uint64_t id = 0; id < manifest.num_keys; ++id) {
+      if (!move(std::string(buf, key_generator::format(id, buf)), r))
+        return;
+    }
+    for (const auto &key: keys) {
+      if (!move(key, r))
+        return;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(m_mtx);
+      m_rebalance_s = static_cast<double>(hr_clock::now_ns() - begin_ns) / 1e9;
+    }
+    {
+      std::vector<std::unique_lock<std::mutex>> stripe_locks;
+      for (auto &s: m_stripes)
+        stripe_locks.emplace_back(s.mtx);
+      m_routing.store(&m_routings[stats::AFTER], std::memory_order_release);
+      for (auto &s: m_stripes) {
+        s.written.clear();
+        s.placed.clear();
+      }
+    }
+    std::cerr << "Finished rebalancing." << std::endl;
+  }
+
+  const routing m_routings[3];
+  std::atomic<const routing *> m_routing;
+  std::shared_ptr<const layout> m_next;
+  std::vector<std::shared_ptr<storage_interface>> m_movers;
+  uint64_t m_rebalance_ns;
+  stripe_keys m_stripes[NUM_STRIPES];
+
+  // Guards the rebalance's statistics and m_stop
+  std::mutex m_mtx;
+  std::condition_variable m_cv;
+  size_t m_moved_keys;
+  size_t m_moved_bytes;
+  size_t m_modulo_moved_keys;
+  size_t m_keys_at_rebalance;
+  double m_rebalance_s;
+  bool m_stop;
+  std::thread m_mover;
+};
+
+// The layout and keys all instances in the process share; created by the first init()
+static std::shared_ptr<sharded::state> g_state;
+static std::mutex g_state_mtx;
+
+// Statistics of the instances that are gone, printed when the last instance goes
+static std::unique_ptr<sharded::stats> g_stats;
+static size_t g_instances = 0;
+
+void sharded::stats::merge(const stats &other) {
+  ops.resize(std::max(ops.size(), other.ops.size()), 0);
+  bytes.resize(ops.size(), 0);
+  for (size_t i = 0; i < other.ops.size(); ++i) {
+    ops[i] += other.ops[i];
+    bytes[i] += other.bytes[i];
+  }
+  for (int p = BEFORE; p <= AFTER; ++p)
+    latency_ns[p].merge(other.latency_ns[p]);
+}
+
+sharded::sharded() {
+  std::lock_guard<std::mutex> lock(g_state_mtx);
+  ++g_instances;
+}
+
+sharded::~sharded() {
+  std::lock_guard<std::mutex> lock(g_state_mtx);
+  if (g_stats == nullptr)
+    g_stats.reset(new stats());
+  g_stats->merge(m_stats);
+  if (--g_instances > 0)
+    return;
+  if (m_state != nullptr && !g_stats->ops.empty()) {
+    m_state->print(std::cerr, *g_stats);
+    static const char *PHASES[] = {"before", "during", "after"};
+    for (int p = stats::BEFORE; p <= stats::AFTER; ++p) {
+      if (g_stats->latency_ns[p].count() == 0)
+        continue;
+      std::cerr << "Latency summary for ops " << PHASES[p] << " rebalance (count, p50, p90, p99, p99.9, max in ns): ";
+      g_stats->latency_ns[p].write_summary(std::cerr);
+      std::cerr << std::endl;
+    }
+  }
+  g_stats.reset();
+  m_state.reset();
+  g_state.reset();
+}
+
+void sharded::init(const property_map &conf, bool create) {
+  auto backend = conf.get<std::string>("backend", "");
+  if (backend.empty())
+    throw std::invalid_argument("sharded needs a backend");
+  auto num_shards = conf.get<size_t>("shards", 4);
+  auto rebalance_to = conf.get<size_t>("rebalance_to", 0);
+  auto hashing = conf.get<std::string>("hashing", "ring");
+  auto virtual_nodes = conf.get<size_t>("virtual_nodes", 128);
+  if (num_shards == 0)
+    throw std::invalid_argument("sharded needs at least one shard");
+  if (hashing != "ring" && hashing != "jump")
+    throw std::invalid_argument("Shard hashing must be ring or jump: " + hashing);
+  if (hashing == "ring" && virtual_nodes == 0)
+    throw std::invalid_argument("virtual_nodes must be at least 1");
+  std::vector<std::string> sections;
+  benchmark_utils::split(conf.get<std::string>("shard_sections", ""), sections, ',');
+  auto max_shards = std::max(num_shards, rebalance_to);
+  // These keep one store per process whatever their section says, so overrides could not tell their shards apart
+  static const char *PROCESS_WIDE_BACKENDS[] = {"memory", "emulated"};
+  auto base = backend.substr(backend.rfind(':') + 1);
+  if (!sections.empty()
+      && std::find(std::begin(PROCESS_WIDE_BACKENDS), std::end(PROCESS_WIDE_BACKENDS), base)
+          != std::end(PROCESS_WIDE_BACKENDS))
+    throw std::invalid_argument("shard_sections cannot be honored by " + base
+                                    + ", whose instances share one store per process");
+  if (!sections.empty() && sections.size() < max_shards)
+    throw std::invalid_argument("shard_sections must name a section for each of the " + std::to_string(max_shards)
+                                    + " shards");
+
+  std::vector<property_map> shard_confs;
+  for (size_t i = 0; i < max_shards; ++i) {
+    auto c = storage_interfaces::configuration(conf, backend);
+    if (!sections.empty()) {
+      auto overrides = conf.get_child_optional(sections[i]);
+      if (!overrides)
+        throw std::invalid_argument("No section for shard " + sections[i]);
+      for (const auto &kv: *overrides)
+        c.put_child(kv.first, kv.second);
+    }
+    shard_confs.push_back(c);
+  }
+  for (size_t i = 0; i < max_shards; ++i) {
+    m_shards.push_back(storage_interfaces::get_interface(backend));
+    m_shards.back()->init(shard_confs[i], create);
+  }
+  m_stats.ops.resize(max_shards, 0);
+  m_stats.bytes.resize(max_shards, 0);
+
+  std::lock_guard<std::mutex> lock(g_state_mtx);
+  if (g_state == nullptr) {
+    std::shared_ptr<const layout> next;
+    if (rebalance_to > 0 && rebalance_to != num_shards)
+      next = std::make_shared<layout>(hashing, rebalance_to, virtual_nodes);
+    // The rebalancing thread has connections of its own to the shards
+    std::vector<std::shared_ptr<storage_interface>> movers;
+    for (size_t i = 0; next != nullptr && i < max_shards; ++i) {
+      movers.push_back(storage_interfaces::get_interface(backend));
+      movers.back()->init(shard_confs[i], false);
+    }
+    g_state = std::make_shared<state>(std::make_shared<layout>(hashing, num_shards, virtual_nodes), next, movers,
+                                      conf.get<uint64_t>("rebalance_after", 0) * 1000 * 1000 * 1000);
+  }
+  m_state = g_state;
+}
+
+void sharded::record(size_t shard, size_t bytes, stats::phase phase, uint64_t start_ns) {
+  ++m_stats.ops[shard];
+  m_stats.bytes[shard] += bytes;
+  m_stats.latency_ns[phase].record(hr_clock::elapsed_ns(start_ns, hr_clock::now_ns()));
+}
+
+void sharded::write(const std::string &key, const std::string &value) {
+  write_slice(key, value.data(), value.size());
+}
+
+std::string sharded::read(const std::string &key) {
+  auto t_b = hr_clock::now_ns();
+  const auto &r = m_state->snapshot();
+  auto h = hash_key(key);
+  auto shard = r.current->owner(h);
+  std::string value;
+  try {
+    value = m_shards[shard]->read(key);
+  } catch (std::runtime_error &) {
+    // Not moved to its new owner yet
+    if (r.previous == nullptr || r.previous->owner(h) == shard)
+      throw;
+    shard = r.previous->owner(h);
+    value = m_shards[shard]->read(key);
+  }
+  record(shard, value.size(), r.phase, t_b);
+  return value;
+}
+
+void sharded::destroy() {
+  m_state->stop();
+  for (auto &s: m_shards)
+    s->destroy();
+}
+
+void sharded::write_async(const std::string &key, const std::string &value) {
+  write_slice_async(key, value.data(), value.size());
+}
+
+void sharded::read_async(const std::string &key) {
+  m_read_results.push(make_completion(0, [&]() { return read(key); }));
+}
+
+void sharded::wait_write() {
+  auto c = m_write_results.pop();
+  if (!c.ok)
+    throw std::runtime_error(c.error);
+}
+
+std::string sharded::wait_read() {
+  auto c = m_read_results.pop();
+  if (!c.ok)
+    throw std::runtime_error(c.error);
+  return std::move(c.value);
+}
+
+void sharded::write_slice(const std::string &key, const char *value, size_t length) {
+  auto t_b = hr_clock::now_ns();
+  auto h = hash_key(key);
+  if (!m_state->rebalancing()) {
+    auto shard = m_state->snapshot().current->owner(h);
+    m_shards[shard]->write_slice(key, value, length);
+    record(shard, length, stats::BEFORE, t_b);
+    return;
+  }
+  std::lock_guard<std::mutex> lock(m_state->stripe(h));
+  const auto &r = m_state->snapshot();
+  auto shard = r.current->owner(h);
+  m_shards[shard]->write_slice(key, value, length);
+  m_state->wrote(key, h, r);
+  record(shard, length, r.phase, t_b);
+}
+
+void sharded::write_slice_async(const std::string &key, const char *value, size_t length) {
+  m_write_results.push(make_completion(0, [&]() {
+    write_slice(key, value, length);
+    return std::string();
+  }));
+}
+
+REGISTER_STORAGE_IFACE("sharded", sharded);
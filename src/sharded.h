@@ -0,0 +1,84 @@
+#ifndef STORAGE_BENCH_SHARDED_H
+#define STORAGE_BENCH_SHARDED_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "storage_interface.h"
+#include "latency_histogram.h"
+#include "queue.h"
+
+/*
+ * Composite backend that spreads keys over several instances of another backend with consistent hashing, so that
+ * adding or removing a shard only moves the keys that change owner. Configured by the [sharded] section:
+ *
+ *   backend=redis        interface of every shard, including decorated ones
+ *   shards=4             number of shards
+ *   shard_sections=      optional comma separated sections, one per shard (including any added by a rebalance),
+ *                        whose settings override those of the backend's section for that shard, e.g. a path or host
+ *   hashing=ring         ring (a hash ring with virtual nodes per shard) or jump (jump consistent hash, which
+ *                        needs no memory but can only add or remove the highest numbered shards)
+ *   virtual_nodes=128    points per shard on the ring
+ *   rebalance_after=0    seconds after the first init at which the number of shards changes to rebalance_to
+ *   rebalance_to=0       (0 for no rebalance)
+ *
+ * A rebalance switches every instance to the new layout at once, then copies each key whose owner changed from its
+ * old shard to the new one in the background: the keys written so far, and those of the dataset recorded in the
+ * preload manifest. A read that misses on a key's new owner during the move retries on its old one, which both
+ * layouts give without any lookup. Backends have no deletes, so moved keys stay behind on their old shard. Without
+ * rebalance_to, requests take no locks and no keys are tracked.
+ *
+ * localfs and shm keep one volume per path and one segment per name, so shard_sections giving each shard its own
+ * path or name puts the shards' data apart. memory and emulated keep one store per process whatever their section
+ * says, so their shards show routing and balance but hold the same data, and shard_sections is rejected for them.
+ *
+ * Ops, bytes and the share of the hash space per shard, the keys and bytes a rebalance moved, and latency before,
+ * during and after it are collected across all instances and printed when the last one goes away. async requests
+ * are served inline.
+ */
+class sharded : public storage_interface {
+ public:
+  sharded();
+  ~sharded();
+
+  void init(const property_map &conf, bool create) override;
+  void write(const std::string &key, const std::string &value) override;
+  std::string read(const std::string &key) override;
+  void destroy() override;
+  void write_async(const std::string &key, const std::string &value) override;
+  void read_async(const std::string &key) override;
+  void wait_write() override;
+  std::string wait_read() override;
+  void write_slice(const std::string &key, const char *value, size_t length) override;
+  void write_slice_async(const std::string &key, const char *value, size_t length) override;
+
+  class layout;
+  class state;
+
+  // Ops are counted per shard, and timed per phase of the rebalance
+  struct stats {
+    enum phase {
+      BEFORE = 0,
+      DURING = 1,
+      AFTER = 2
+    };
+
+    std::vector<size_t> ops;
+    std::vector<size_t> bytes;
+    latency_histogram latency_ns[3];
+
+    void merge(const stats &other);
+  };
+
+ private:
+  void record(size_t shard, size_t bytes, stats::phase phase, uint64_t start_ns);
+
+  std::vector<std::shared_ptr<storage_interface>> m_shards;
+  std::shared_ptr<state> m_state;
+  // Outcomes of write_async/read_async, which are served inline; submit_* may be waited for on another thread
+  queue<completion> m_write_results;
+  queue<completion> m_read_results;
+  stats m_stats;
+};
+
+#endif //STORAGE_BENCH_SHARDED_H
@@ -0,0 +1,283 @@
+#include "shm.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Passed by reference to property_map::get() and std::chrono, so they need a definition
+const size_t shm::DEFAULT_SLOTS;
+const size_t shm::DEFAULT_SLOT_SIZE;
+const int shm::ATTACH_TIMEOUT_S;
+
+static const uint64_t SEGMENT_MAGIC = 0x53424d48534d4731;
+
+// Start of the segment, padded to a cache line; magic is set last, once the rest is initialized
+struct segment_header {
+  std::atomic<uint64_t> magic;
+  uint64_t num_slots;
+  uint64_t slot_size;
+  uint64_t slot_stride;
+};
+
+static const size_t HEADER_SIZE = 64;
+
+// Start of a slot; the value follows the header. An empty slot has key_length 0.
+struct slot_header {
+  std::atomic<uint64_t> version;
+  uint32_t key_length;
+  uint32_t value_length;
+  char key[shm::MAX_KEY_LENGTH];
+};
+
+class shm::segment {
+ public:
+  segment(const std::string &name, size_t num_slots, size_t slot_size, bool create) : m_name(name) {
+    // Every process started with create races to create the segment; the ones that lose attach to the winner's
+    int fd = create ? shm_open(m_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600) : -1;
+    if (create && fd < 0 && errno != EEXIST)
+      fatal("Failed to create shared memory segment");
+    bool created = fd >= 0;
+    if (created) {
+      size_t slots = 1;
+      while (slots < num_slots)
+        slots <<= 1;
+      size_t stride = (sizeof(slot_header) + slot_size + 63) / 64 * 64;
+      if (ftruncate(fd, static_cast<off_t>(HEADER_SIZE + slots * stride)) != 0)
+        fatal("Failed to size shared memory segment");
+      map(fd, HEADER_SIZE + slots * stride);
+      auto header = reinterpret_cast<segment_header *>(m_base);
+      header->num_slots = slots;
+      header->slot_size = slot_size;
+      header->slot_stride = stride;
+      header->magic.store(SEGMENT_MAGIC, std::memory_order_release);
+    } else {
+      // The creator may still be setting the segment up
+      auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(ATTACH_TIMEOUT_S);
+      while (true) {
+        int attach_fd = shm_open(m_name.c_str(), O_RDWR, 0600);
+        if (attach_fd >= 0) {
+          struct stat st{};
+          if (fstat(attach_fd, &st) == 0 && static_cast<size_t>(st.st_size) >= HEADER_SIZE) {
+            map(attach_fd, static_cast<size_t>(st.st_size));
+            if (reinterpret_cast<segment_header *>(m_base)->magic.load(std::memory_order_acquire) == SEGMENT_MAGIC)
+              break;
+            munmap(m_base, m_size);
+          } else {
+            close(attach_fd);
+          }
+        }
+        if (std::chrono::steady_clock::now() > deadline)
+          fatal("Timed out attaching to shared memory segment");
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      }
+    }
+    auto header = reinterpret_cast<segment_header *>(m_base);
+    if (create && !created && (header->num_slots < num_slots || header->slot_size != slot_size)) {
+      std::cerr << "WARN Attached to existing shared memory segment " << m_name << " with " << header->num_slots
+                << " slots of " << header->slot_size << " bytes; destroy it to change its size" << std::endl;
+    }
+    m_mask = header->num_slots - 1;
+    m_slot_size = header->slot_size;
+    m_stride = header->slot_stride;
+  }
+
+  ~segment() {
+    munmap(m_base, m_size);
+  }
+
+  void put(const std::string &key, const char *value, size_t length) {
+    check_key(key);
+    if (length > m_slot_size)
+      throw std::runtime_error("Value of " + std::to_string(length) + " bytes exceeds slot_size");
+    for (size_t i = 0, idx = hash(key); i <= m_mask; ++i, ++idx) {
+      auto s = slot(idx);
+      std::string unused;
+      if (probe(s, key, unused, false) == OTHER)
+        continue;
+
+      // Claim the slot; the version is odd while it is held
+      auto v = s->version.load(std::memory_order_relaxed);
+      while ((v & 1) != 0 || !s->version.compare_exchange_weak(v, v + 1, std::memory_order_acquire))
+        v = s->version.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+
+      if (s->key_length != 0 && !matches(s, key)) {
+        // Another writer took the slot for a different key first; nothing changed, so restore the version
+        s->version.store(v, std::memory_order_release);
+        continue;
+      }
+      if (s->key_length == 0) {
+        std::memcpy(s->key, key.data(), key.size());
+        s->key_length = static_cast<uint32_t>(key.size());
+      }
+      std::memcpy(value_of(s), value, length);
+      s->value_length = static_cast<uint32_t>(length);
+      s->version.store(v + 2, std::memory_order_release);
+      return;
+    }
+    throw std::runtime_error("Shared memory table is full");
+  }
+
+  bool get(const std::string &key, std::string &value) {
+    check_key(key);
+    for (size_t i = 0, idx = hash(key); i <= m_mask; ++i, ++idx) {
+      auto state = probe(slot(idx), key, value, true);
+      if (state != OTHER)
+        return state == MATCH;
+    }
+    return false;
+  }
+
+  void unlink() {
+    if (shm_unlink(m_name.c_str()) != 0)
+      std::cerr << "Failed to remove shared memory segment " << m_name << ": " << std::strerror(errno) << std::endl;
+  }
+
+ private:
+  enum probe_state {
+    EMPTY,
+    MATCH,
+    OTHER
+  };
+
+  // Consistent view of whether s is empty, holds key or holds another key, copying the value on a match if asked
+  probe_state probe(slot_header *s, const std::string &key, std::string &value, bool copy_value) {
+    while (true) {
+      auto v = s->version.load(std::memory_order_acquire);
+      if ((v & 1) != 0)
+        continue;
+      probe_state state = s->key_length == 0 ? EMPTY : matches(s, key) ? MATCH : OTHER;
+      if (state == MATCH && copy_value)
+        value.assign(value_of(s), std::min<size_t>(s->value_length, m_slot_size));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (s->version.load(std::memory_order_relaxed) == v)
+        return state;
+    }
+  }
+
+  static bool matches(const slot_header *s, const std::string &key) {
+    return s->key_length == key.size() && std::memcmp(s->key, key.data(), key.size()) == 0;
+  }
+
+  static void check_key(const std::string &key) {
+    if (key.empty() || key.size() > MAX_KEY_LENGTH)
+      throw std::runtime_error("Key length must be between 1 and " + std::to_string(MAX_KEY_LENGTH) + ": " + key);
+  }
+
+  // FNV-1a, which unlike std::hash is guaranteed to agree across the processes sharing the table
+  static size_t hash(const std::string &key) {
+    uint64_t h = 14695981039346656037ULL;
+    for (auto c: key) {
+      h ^= static_cast<unsigned char>(c);
+      h *= 1099511628211ULL;
+    }
+    return static_cast<size_t>(h);
+  }
+
+  slot_header *slot(size_t idx) const {
+    return reinterpret_cast<slot_header *>(m_base + HEADER_SIZE + (idx & m_mask) * m_stride);
+  }
+
+  static char *value_of(slot_header *s) {
+    return reinterpret_cast<char *>(s) + sizeof(slot_header);
+  }
+
+  // Maps size bytes of fd and closes it
+  void map(int fd, size_t size) {
+    auto base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED)
+      fatal("Failed to map shared memory segment");
+    close(fd);
+    m_base = static_cast<char *>(base);
+    m_size = size;
+  }
+
+  void fatal(const std::string &what) const {
+    std::cerr << what << " " << m_name << ": " << std::strerror(errno) << std::endl;
+    exit(1);
+  }
+
+  std::string m_name;
+  char *m_base = nullptr;
+  size_t m_size = 0;
+  size_t m_mask = 0;
+  size_t m_slot_size = 0;
+  size_t m_stride = 0;
+};
+
+// The segments the instances in the process share, by configured name; each attached by the first init() naming it
+static std::map<std::string, std::shared_ptr<shm::segment>> g_segments;
+static std::mutex g_segment_mtx;
+
+void shm::init(const property_map &conf, bool create) {
+  std::lock_guard<std::mutex> lock(g_segment_mtx);
+  auto name = conf.get<std::string>("name", "/test");
+  auto &segment = g_segments[name];
+  if (segment == nullptr) {
+    if (name == "/test") {
+      name += random_string(10);
+      create = true;
+    }
+    segment = std::make_shared<shm::segment>(name, conf.get<size_t>("slots", DEFAULT_SLOTS),
+                                             conf.get<size_t>("slot_size", DEFAULT_SLOT_SIZE), create);
+  }
+  m_segment = segment;
+}
+
+void shm::write(const std::string &key, const std::string &value) {
+  m_segment->put(key, value.data(), value.length());
+}
+
+std::string shm::read(const std::string &key) {
+  std::string value;
+  if (!m_segment->get(key, value))
+    throw std::runtime_error("No such key: " + key);
+  return value;
+}
+
+void shm::destroy() {
+  m_segment->unlink();
+}
+
+void shm::write_async(const std::string &key, const std::string &value) {
+  write_slice_async(key, value.data(), value.length());
+}
+
+void shm::read_async(const std::string &key) {
+  m_read_results.push(make_completion(0, [&]() { return read(key); }));
+}
+
+void shm::wait_write() {
+  auto c = std::move(m_write_results.front());
+  m_write_results.pop();
+  if (!c.ok)
+    throw std::runtime_error(c.error);
+}
+
+std::string shm::wait_read() {
+  auto c = std::move(m_read_results.front());
+  m_read_results.pop();
+  if (!c.ok)
+    throw std::runtime_error(c.error);
+  return std::move(c.value);
+}
+
+void shm::write_slice(const std::string &key, const char *value, size_t length) {
+  m_segment->put(key, value, length);
+}
+
+void shm::write_slice_async(const std::string &key, const char *value, size_t length) {
+  m_write_results.push(make_completion(0, [&]() {
+    write_slice(key, value, length);
+    return std::string();
+  }));
+}
+
+REGISTER_STORAGE_IFACE("shm", shm);
@@ -0,0 +1,48 @@
+#ifndef STORAGE_BENCH_SHM_H
+#define STORAGE_BENCH_SHM_H
+
+#include <atomic>
+#include <queue>
+#include "storage_interface.h"
+
+/*
+ * Hash table in a POSIX shared memory segment that every storage_bench process on the host can attach to, so
+ * local multi-process runs contend for the same keys across cores with no kernel calls on the data path.
+ *
+ * The table uses open addressing with linear probing over fixed-size slots, each holding one key and a value of
+ * up to slot_size bytes. Each slot carries a version that is odd while a writer holds it: writers claim a slot
+ * by bumping the version with a compare-and-swap, and readers copy the slot without locking and retry if the
+ * version moved underneath them. Keys are never removed; destroy unlinks the whole segment. Of the processes started
+ * with create, the first creates the segment and the rest attach to it, so a segment left by an earlier run is
+ * reused until it is destroyed.
+ *
+ * Requests complete inline, so the async modes measure the harness's bookkeeping over a zero-latency store.
+ */
+class shm : public storage_interface {
+ public:
+  static const size_t MAX_KEY_LENGTH = 32;
+  static const size_t DEFAULT_SLOTS = 1 << 20;
+  static const size_t DEFAULT_SLOT_SIZE = 1024;
+  // How long an attaching process waits for the creator to initialize the segment
+  static const int ATTACH_TIMEOUT_S = 30;
+
+  void init(const property_map &conf, bool create) override;
+  void write(const std::string &key, const std::string &value) override;
+  std::string read(const std::string &key) override;
+  void destroy() override;
+  void write_async(const std::string &key, const std::string &value) override;
+  void read_async(const std::string &key) override;
+  void wait_write() override;
+  std::string wait_read() override;
+  void write_slice(const std::string &key, const char *value, size_t length) override;
+  void write_slice_async(const std::string &key, const char *value, size_t length) override;
+
+  class segment;
+
+ private:
+  std::shared_ptr<segment> m_segment;
+  std::queue<completion> m_write_results;
+  std::queue<completion> m_read_results;
+};
+
+#endif //STORAGE_BENCH_SHM_H
@@ -0,0 +1,132 @@
+#include "slo_search.h"
+
+#include <algorithm>
+#include "result_file.h"
+
+slo_search::slo_search(const storage_interface::property_map &conf, const std::string &spec)
+    : m_spec(spec), m_lo(0), m_hi(0) {
+  auto lt = spec.find('<');
+  if (spec.size() < 2 || spec[0] != 'p' || lt == std::string::npos)
+    throw std::invalid_argument("SLO must look like p99<10ms: " + spec);
+  m_percentile = std::stod(spec.substr(1, lt - 1));
+  if (m_percentile <= 0 || m_percentile > 100)
+    throw std::invalid_argument("SLO percentile must be in (0, 100]: " + spec);
+
+  size_t unit_pos;
+  auto latency = std::stod(spec.substr(lt + 1), &unit_pos);
+  auto unit = spec.substr(lt + 1 + unit_pos);
+  double scale;
+  if (unit == "ns") {
+    scale = 1;
+  } else if (unit == "us") {
+    scale = 1e3;
+  } else if (unit == "ms") {
+    scale = 1e6;
+  } else if (unit == "s") {
+    scale = 1e9;
+  } else {
+    throw std::invalid_argument("SLO latency needs a unit of ns, us, ms or s: " + spec);
+  }
+  m_latency_ns = static_cast<uint64_t>(latency * scale);
+
+  m_next = conf.get<double>("initial_rate", 100);
+  m_min_rate = conf.get<double>("min_rate", 1);
+  m_max_rate = conf.get<double>("max_rate", 1000000);
+  m_growth = conf.get<double>("growth", 2);
+  m_precision = conf.get<double>("precision", 0.05);
+  m_max_steps = conf.get<size_t>("max_steps", 20);
+  m_step_seconds = conf.get<double>("step_seconds", 10);
+  m_min_throughput_fraction = conf.get<double>("min_throughput_fraction", 0.9);
+  m_max_error_fraction = conf.get<double>("max_error_fraction", 0.01);
+  if (m_min_rate <= 0 || m_next < m_min_rate || m_max_rate < m_next)
+    throw std::invalid_argument("Search needs 0 < min_rate <= initial_rate <= max_rate");
+  if (m_growth <= 1)
+    throw std::invalid_argument("Search growth must be greater than 1");
+  if (m_step_seconds <= 0 || m_max_steps == 0)
+    throw std::invalid_argument("Search needs positive step_seconds and max_steps");
+}
+
+double slo_search::next_rate() const {
+  return m_next;
+}
+
+size_t slo_search::step_ops(double rate, size_t max_ops) const {
+  return std::max<size_t>(std::min<size_t>(static_cast<size_t>(rate * m_step_seconds), max_ops), 1);
+}
+
+const slo_search::step &slo_search::record(double offered_rate, double achieved_rate,
+                                           const latency_histogram &response_time, size_t errors) {
+  step s{};
+  s.offered_rate = offered_rate;
+  s.achieved_rate = achieved_rate;
+  s.latency_ns = response_time.count() > 0 ? response_time.value_at_percentile(m_percentile) : 0;
+  auto total = response_time.count() + errors;
+  s.error_fraction = total > 0 ? static_cast<double>(errors) / total : 1.0;
+  s.met = response_time.count() > 0 && s.latency_ns <= m_latency_ns
+      && achieved_rate >= m_min_throughput_fraction * offered_rate && s.error_fraction <= m_max_error_fraction;
+  m_steps.push_back(s);
+
+  if (s.met) {
+    m_lo = std::max(m_lo, offered_rate);
+  } else {
+    m_hi = m_hi == 0 ? offered_rate : std::min(m_hi, offered_rate);
+  }
+
+  if (m_steps.size() >= m_max_steps) {
+    m_next = 0;
+  } else if (m_hi == 0) {
+    // Still growing: stop at max_rate, trying it exactly once
+    m_next = offered_rate < m_max_rate ? std::min(offered_rate * m_growth, m_max_rate) : 0;
+  } else if (m_lo == 0) {
+    // Every step so far missed: shrink until one meets the SLO, giving up below min_rate
+    m_next = offered_rate / m_growth >= m_min_rate ? offered_rate / m_growth : 0;
+  } else {
+    m_next = m_hi - m_lo > m_precision * m_hi ? (m_lo + m_hi) / 2 : 0;
+  }
+  return m_steps.back();
+}
+
+double slo_search::best_rate() const {
+  return m_lo;
+}
+
+double slo_search::min_rate() const {
+  return m_min_rate;
+}
+
+const std::vector<slo_search::step> &slo_search::steps() const {
+  return m_steps;
+}
+
+void slo_search::write(const std::string &path) const {
+  std::vector<double> offered, achieved, error_fraction;
+  std::vector<uint64_t> latency;
+  std::vector<uint8_t> met;
+  for (const auto &s: m_steps) {
+    offered.push_back(s.offered_rate);
+    achieved.push_back(s.achieved_rate);
+    latency.push_back(s.latency_ns);
+    error_fraction.push_back(s.error_fraction);
+    met.push_back(static_cast<uint8_t>(s.met));
+  }
+  result_file f;
+  f.add_column("offered_rate", offered);
+  f.add_column("achieved_rate", achieved);
+  f.add_column("latency_ns", latency);
+  f.add_column("error_fraction", error_fraction);
+  f.add_column("met", met);
+  f.write(path);
+}
+
+void slo_search::print(std::ostream &out) const {
+  out << "Search: slo=" << m_spec << " initial_rate=" << m_next << " min_rate=" << m_min_rate << " max_rate="
+      << m_max_rate << " growth=" << m_growth << " precision=" << m_precision << " max_steps=" << m_max_steps
+      << " step_seconds=" << m_step_seconds;
+}
+
+void slo_search::print_last_step(std::ostream &out) const {
+  const auto &s = m_steps.back();
+  out << "Step " << m_steps.size() << ": offered " << s.offered_rate << " ops/s, achieved " << s.achieved_rate
+      << " ops/s, p" << m_percentile << " " << s.latency_ns << " ns, errors " << s.error_fraction << " -> "
+      << (s.met ? "met" : "missed");
+}
@@ -0,0 +1,86 @@
+#ifndef STORAGE_BENCH_SLO_SEARCH_H
+#define STORAGE_BENCH_SLO_SEARCH_H
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include "storage_interface.h"
+#include "latency_histogram.h"
+
+/*
+ * Search for the highest offered rate at which a store meets a latency SLO such as p99<10ms, driven by the
+ * slo{...} mode. Each step offers one rate for step_seconds; the rate grows geometrically until a step misses
+ * the SLO, and the last rate that met it and the first that did not are then bisected. If the first step already
+ * misses, the rate shrinks geometrically until a step meets the SLO, and the search gives up once the rate would
+ * fall below min_rate. Configured by the [search] section:
+ *
+ *   initial_rate=100                rate of the first step, in ops/s
+ *   min_rate=1                      lowest rate tried
+ *   max_rate=1000000                highest rate tried
+ *   growth=2                        factor between steps until the SLO is first missed
+ *   precision=0.05                  stop once the bracket is narrower than this fraction of its upper end
+ *   max_steps=20                    stop after this many steps
+ *   step_seconds=10                 length of each step (capped at num_ops ops)
+ *   min_throughput_fraction=0.9     a step also fails if it completes fewer than this fraction of the rate
+ *   max_error_fraction=0.01         or if more than this fraction of its ops fail
+ */
+class slo_search {
+ public:
+  struct step {
+    double offered_rate;
+    double achieved_rate;
+    // At the SLO's percentile, for response times measured from each op's intended start
+    uint64_t latency_ns;
+    double error_fraction;
+    bool met;
+  };
+
+  // spec is p<percentile><<latency><unit>, with unit one of ns, us, ms or s
+  slo_search(const storage_interface::property_map &conf, const std::string &spec);
+
+  // Rate the next step should offer, or 0 once the search is over
+  double next_rate() const;
+
+  // Ops for a step at rate, at most max_ops
+  size_t step_ops(double rate, size_t max_ops) const;
+
+  // Records the outcome of a step at offered_rate and picks the next rate
+  const step &record(double offered_rate, double achieved_rate, const latency_histogram &response_time,
+                     size_t errors);
+
+  // Highest offered rate that met the SLO, or 0 if none did
+  double best_rate() const;
+
+  double min_rate() const;
+
+  const std::vector<step> &steps() const;
+
+  // Writes the throughput-latency curve as a results file with one row per step
+  void write(const std::string &path) const;
+
+  void print(std::ostream &out) const;
+  // Prints the step recorded last
+  void print_last_step(std::ostream &out) const;
+
+ private:
+  double m_percentile;
+  uint64_t m_latency_ns;
+  std::string m_spec;
+
+  double m_min_rate;
+  double m_max_rate;
+  double m_growth;
+  double m_precision;
+  size_t m_max_steps;
+  double m_step_seconds;
+  double m_min_throughput_fraction;
+  double m_max_error_fraction;
+
+  // Highest rate that met the SLO and lowest that missed it (0 until one has)
+  double m_lo;
+  double m_hi;
+  double m_next;
+  std::vector<step> m_steps;
+};
+
+#endif //STORAGE_BENCH_SLO_SEARCH_H
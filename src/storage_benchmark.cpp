@@ -5,9 +5,99 @@
 #include "storage_interface.h"
 #include "benchmark.h"
 #include "key_generator.h"
+#include "workload.h"
+#include "payload.h"
+#include "hr_clock.h"
+#include "slo_search.h"
+#include "arrival_process.h"
+#include "trace.h"
 
 #define LAMBDA_TIMEOUT_SAFE 240
 
+template<typename K>
+static void run_benchmark(const std::vector<std::shared_ptr<storage_interface>> &s_ifs,
+                          const storage_interface::property_map &s_conf,
+                          const std::vector<std::shared_ptr<K>> &key_gens,
+                          const std::string &output_prefix,
+                          const payload &values,
+                          size_t n_ops,
+                          size_t batch_size,
+                          const benchmark::preload_options &preload_opts,
+                          const std::shared_ptr<rate_limiter> &limiter,
+                          size_t n_async,
+                          size_t max_outstanding_bytes,
+                          double rate,
+                          const std::shared_ptr<arrival_process> &arrivals,
+                          const std::shared_ptr<slo_search> &search,
+                          bool warm_up,
+                          int32_t mode,
+                          uint64_t remaining,
+                          const std::string &control_host,
+                          int control_port,
+                          const std::string &id) {
+  if (search != nullptr) {
+    benchmark::run_slo_search(s_ifs.front(),
+                              s_conf,
+                              key_gens.front(),
+                              output_prefix,
+                              *search,
+                              values,
+                              n_ops,
+                              warm_up,
+                              mode,
+                              remaining,
+                              control_host,
+                              control_port,
+                              id);
+  } else if (rate > 0) {
+    benchmark::run_rate_limited(s_ifs.front(),
+                                s_conf,
+                                key_gens.front(),
+                                output_prefix,
+                                rate,
+                                arrivals,
+                                values,
+                                n_ops,
+                                warm_up,
+                                mode,
+                                remaining,
+                                control_host,
+                                control_port,
+                                id);
+  } else if (n_async > 0) {
+    benchmark::run_async(s_ifs.front(),
+                         s_conf,
+                         key_gens.front(),
+                         output_prefix,
+                         values,
+                         n_ops,
+                         n_async,
+                         max_outstanding_bytes,
+                         warm_up,
+                         mode,
+                         remaining,
+                         control_host,
+                         control_port,
+                         id);
+  } else {
+    benchmark::run(s_ifs,
+                   s_conf,
+                   key_gens,
+                   output_prefix,
+                   values,
+                   n_ops,
+                   batch_size,
+                   preload_opts,
+                   warm_up,
+                   mode,
+                   remaining,
+                   limiter,
+                   control_host,
+                   control_port,
+                   id);
+  }
+}
+
 int main(int argc, char **argv) {
   if (argc != 10) {
     std::cerr << "Usage: " << argv[0] << " id system conf_file output_prefix value_size mode num_ops warm_up dist"
@@ -25,8 +115,8 @@ int main(int argc, char **argv) {
   std::string result_prefix = argv[4];
   size_t value_size = std::stoull(argv[5]);
   int32_t mode = 0;
-  bool async = false;
-  size_t rate = 0;
+  size_t n_async = 0;
+  double rate = 0;
   std::string m(argv[6]);
   if (m.find("read") != std::string::npos) {
     mode |= BENCHMARK_READ;
@@ -40,14 +130,36 @@ int main(int argc, char **argv) {
   if (m.find("destroy") != std::string::npos) {
     mode |= BENCHMARK_DESTROY;
   }
+  if (m.find("preload") != std::string::npos) {
+    mode |= BENCHMARK_PRELOAD;
+  }
+  bool run_workload = m.find("workload") != std::string::npos;
+  bool run_tenants = m.find("tenants") != std::string::npos;
+  bool run_replay = m.find("replay") != std::string::npos;
   size_t async_pos;
   if ((async_pos = m.find("async{")) != std::string::npos) {
     size_t rbeg = async_pos + 6;
     size_t rend = m.find('}', rbeg);
     size_t len = rend - rbeg;
-    rate = static_cast<size_t>(std::stoll(m.substr(rbeg, len)));
+    n_async = static_cast<size_t>(std::stoll(m.substr(rbeg, len)));
+    std::cerr << "Outstanding requests: " << n_async << std::endl;
+  }
+  size_t rate_pos;
+  if ((rate_pos = m.find("rate{")) != std::string::npos) {
+    size_t rbeg = rate_pos + 5;
+    size_t rend = m.find('}', rbeg);
+    size_t len = rend - rbeg;
+    rate = std::stod(m.substr(rbeg, len));
     std::cerr << "Rate: " << rate << std::endl;
-    async = true;
+  }
+  // Searches for the highest rate that meets a latency SLO, e.g. slo{p99<10ms}
+  std::string slo;
+  size_t slo_pos;
+  if ((slo_pos = m.find("slo{")) != std::string::npos) {
+    size_t rbeg = slo_pos + 4;
+    size_t rend = m.find('}', rbeg);
+    size_t len = rend - rbeg;
+    slo = m.substr(rbeg, len);
   }
   size_t n_ops = std::stoull(argv[7]);
   bool warm_up = static_cast<bool>(std::stod(argv[8]));
@@ -64,79 +176,289 @@ int main(int argc, char **argv) {
   char hbuf[1024];
   gethostname(hbuf, sizeof(hbuf));
 
-  auto s_if = storage_interfaces::get_interface(system);
-  auto s_conf = conf.get_child(system);
+  storage_interface::property_map s_conf;
+  try {
+    s_conf = storage_interfaces::configuration(conf, system);
+  } catch (std::invalid_argument &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
   auto b_conf = conf.get_child("benchmark");
   std::string output_prefix = result_prefix + "_" + std::to_string(value_size);
-  uint64_t timeout = b_conf.get<uint64_t>("timeout", LAMBDA_TIMEOUT_SAFE) * 1000 * 1000;
+  try {
+    hr_clock::init(b_conf.get<std::string>("clock", "auto"));
+  } catch (std::invalid_argument &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  hr_clock::print(std::cerr);
+  std::cerr << std::endl;
+  uint64_t timeout = b_conf.get<uint64_t>("timeout", LAMBDA_TIMEOUT_SAFE) * 1000 * 1000 * 1000;
   std::string control_host = b_conf.get<std::string>("control_host", hbuf);
   int control_port = b_conf.get<int>("control_port", 8889);
-  if (!strcmp(argv[9], "zipf")) {
-    auto begin = benchmark_utils::now_us();
-    auto key_gen = std::make_shared<zipf_key_generator>(0.0, n_ops);
-    auto remaining = timeout - (benchmark_utils::now_us() - begin);
-    if (async) {
-      benchmark::run_async(s_if,
-                           s_conf,
-                           key_gen,
-                           output_prefix,
-                           value_size,
-                           n_ops,
-                           rate,
-                           warm_up,
-                           mode,
-                           remaining,
-                           control_host,
-                           control_port,
-                           id);
-    } else {
-      benchmark::run(s_if,
-                     s_conf,
-                     key_gen,
-                     output_prefix,
-                     value_size,
-                     n_ops,
-                     warm_up,
-                     mode,
-                     remaining,
-                     control_host,
-                     control_port,
-                     id);
-    }
-  } else if (!strcmp(argv[9], "sequential")) {
-    auto begin = benchmark_utils::now_us();
-    auto key_gen = std::make_shared<sequential_key_generator>();
-    auto remaining = timeout - (benchmark_utils::now_us() - begin);
-    if (async) {
-      benchmark::run_async(s_if,
-                           s_conf,
-                           key_gen,
-                           output_prefix,
-                           value_size,
-                           n_ops,
-                           rate,
-                           warm_up,
-                           mode,
-                           remaining,
-                           control_host,
-                           control_port,
-                           id);
-    } else {
-      benchmark::run(s_if,
-                     s_conf,
-                     key_gen,
-                     output_prefix,
-                     value_size,
-                     n_ops,
-                     warm_up,
-                     mode,
-                     remaining,
-                     control_host,
-                     control_port,
-                     id);
+  size_t n_threads = b_conf.get<size_t>("threads", 1);
+  record_buffer::set_detail_columns(b_conf.get<bool>("per_op_detail", false));
+  if (n_threads == 0) {
+    std::cerr << "Number of threads must be positive" << std::endl;
+    return 1;
+  }
+  std::shared_ptr<slo_search> search;
+  if (!slo.empty()) {
+    if (n_async > 0 || rate > 0) {
+      std::cerr << "slo{...} chooses its own rates and cannot be combined with async{n} or rate{n}" << std::endl;
+      return 1;
+    }
+    auto search_conf = conf.get_child_optional("search");
+    try {
+      search = std::make_shared<slo_search>(search_conf ? *search_conf : pt::ptree(), slo);
+    } catch (std::invalid_argument &e) {
+      std::cerr << e.what() << std::endl;
+      return 1;
     }
+    search->print(std::cerr);
+    std::cerr << std::endl;
+  }
+  std::shared_ptr<arrival_process> arrivals;
+  auto a_conf = conf.get_child_optional("arrival");
+  if (rate > 0 && a_conf) {
+    try {
+      arrivals = std::make_shared<arrival_process>(*a_conf);
+    } catch (std::invalid_argument &e) {
+      std::cerr << e.what() << std::endl;
+      return 1;
+    }
+    arrivals->print(std::cerr);
+    std::cerr << std::endl;
+    if (arrivals->evenly_spaced())
+      arrivals.reset();
+  }
+  bool open_loop = n_async > 0 || rate > 0 || search != nullptr;
+  if (open_loop && n_threads > 1) {
+    std::cerr << "WARN Async mode uses a single thread, ignoring threads=" << n_threads << std::endl;
+    n_threads = 1;
+  }
+  // Keys per read or write op, through multi_read/multi_write when greater than 1
+  size_t batch_size = b_conf.get<size_t>("batch_size", 1);
+  if (batch_size == 0) {
+    std::cerr << "Batch size must be positive" << std::endl;
+    return 1;
+  }
+  if (batch_size > 1 && (open_loop || run_workload || run_tenants || run_replay)) {
+    std::cerr << "WARN Only the synchronous read/write modes batch ops, ignoring batch_size=" << batch_size
+              << std::endl;
+    batch_size = 1;
+  }
+  // [preload] batch_size=16 (keys per multi_write), chunk_size=10000 (keys claimed by a worker at a time),
+  // checkpoint_seconds=10
+  benchmark::preload_options preload_opts{};
+  if ((mode & BENCHMARK_PRELOAD) == BENCHMARK_PRELOAD) {
+    if (open_loop || run_workload || run_tenants || run_replay) {
+      std::cerr << "Preload is only supported by the synchronous read/write modes" << std::endl;
+      return 1;
+    }
+    auto l_conf = conf.get_child_optional("preload");
+    auto l_tree = l_conf ? *l_conf : pt::ptree();
+    preload_opts.batch_size = l_tree.get<size_t>("batch_size", 16);
+    preload_opts.chunk_size = l_tree.get<size_t>("chunk_size", 10000);
+    preload_opts.checkpoint_interval_ns = l_tree.get<uint64_t>("checkpoint_seconds", 10) * 1000 * 1000 * 1000;
+    if (preload_opts.batch_size == 0 || preload_opts.chunk_size == 0) {
+      std::cerr << "Preload batch_size and chunk_size must be positive" << std::endl;
+      return 1;
+    }
+    std::cerr << "Preload: batch_size=" << preload_opts.batch_size << " chunk_size=" << preload_opts.chunk_size
+              << " checkpoint_seconds=" << l_tree.get<uint64_t>("checkpoint_seconds", 10) << std::endl;
+  }
+  // Each tenant is configured by the section named after it, which takes workload and payload settings along with
+  // threads, num_ops, value_size, rate (ops/s over all of the tenant's threads) and thread_rate (ops/s of each of
+  // its threads). rate in [benchmark] bounds all tenants together. Any rate left at 0 does not limit.
+  std::vector<benchmark::tenant> tenants;
+  std::shared_ptr<rate_limiter> global_limiter;
+  // In the synchronous read/write modes, rate in [benchmark] paces all threads together in keys/s, so a batched op
+  // takes one permit per key
+  if (!open_loop && !run_workload && !run_tenants && !run_replay) {
+    auto global_rate = b_conf.get<double>("rate", 0);
+    if (global_rate > 0)
+      global_limiter = std::make_shared<rate_limiter>(global_rate);
+  }
+  if (run_tenants) {
+    if (open_loop || run_workload) {
+      std::cerr << "Tenants mode does not support workload, async{n}, rate{n} or slo{...}" << std::endl;
+      return 1;
+    }
+    std::vector<std::string> names;
+    benchmark_utils::split(b_conf.get<std::string>("tenants", ""), names, ',');
+    if (names.empty()) {
+      std::cerr << "Tenants mode needs a list of tenants=<name>,... in [benchmark]" << std::endl;
+      return 1;
+    }
+    auto global_rate = b_conf.get<double>("rate", 0);
+    if (global_rate > 0)
+      global_limiter = std::make_shared<rate_limiter>(global_rate);
+    n_threads = 0;
+    for (const auto &name: names) {
+      auto t_conf = conf.get_child_optional(name);
+      if (!t_conf) {
+        std::cerr << "No section for tenant " << name << std::endl;
+        return 1;
+      }
+      benchmark::tenant t;
+      t.name = name;
+      t.num_workers = t_conf->get<size_t>("threads", 1);
+      t.num_ops = t_conf->get<size_t>("num_ops", n_ops);
+      if (t.num_workers == 0) {
+        std::cerr << "Tenant " << name << " needs at least one thread" << std::endl;
+        return 1;
+      }
+      try {
+        t.wl = std::make_shared<workload>(*t_conf, t.num_ops);
+        t.values = std::make_shared<payload>(*t_conf, t_conf->get<size_t>("value_size", value_size));
+      } catch (std::invalid_argument &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+      }
+      auto t_rate = t_conf->get<double>("rate", 0);
+      // A tenant without a rate of its own still gets a limiter under the global one, at the global rate, which
+      // never holds it back further but counts its slots apart from the other tenants'
+      if (t_rate > 0 || global_limiter != nullptr)
+        t.limiter = std::make_shared<rate_limiter>(t_rate > 0 ? t_rate : global_rate, global_limiter);
+      t.thread_rate = t_conf->get<double>("thread_rate", 0);
+      n_threads += t.num_workers;
+      tenants.push_back(t);
+    }
+  }
+  std::vector<std::shared_ptr<storage_interface>> s_ifs;
+  for (size_t t = 0; t < n_threads; ++t) {
+    s_ifs.push_back(storage_interfaces::get_interface(system));
+  }
+  bool precompute_keys = b_conf.get<bool>("precompute_keys", false);
+  // Backpressure for async{n}: at most this many value bytes of writes in flight (0 for no limit)
+  auto max_outstanding_bytes = b_conf.get<size_t>("max_outstanding_bytes", 0);
+  auto p_conf = conf.get_child_optional("payload");
+  std::shared_ptr<payload> values;
+  try {
+    values = std::make_shared<payload>(p_conf ? *p_conf : pt::ptree(), value_size);
+  } catch (std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  values->print(std::cerr);
+  std::cerr << std::endl;
+  if (run_replay) {
+    if (open_loop || run_workload || run_tenants) {
+      std::cerr << "Replay mode does not support workload, tenants, async{n}, rate{n} or slo{...}" << std::endl;
+      return 1;
+    }
+    auto begin = hr_clock::now_ns();
+    // [replay] path=<trace from trace_convert>, timing=original or fast, speedup=1 (for original timing)
+    auto r_conf = conf.get_child_optional("replay");
+    auto path = r_conf ? r_conf->get<std::string>("path", "") : "";
+    auto timing = r_conf ? r_conf->get<std::string>("timing", "original") : "original";
+    auto speedup = r_conf ? r_conf->get<double>("speedup", 1.0) : 1.0;
+    if (timing != "original" && timing != "fast") {
+      std::cerr << "Replay timing must be original or fast: " << timing << std::endl;
+      return 1;
+    }
+    if (speedup <= 0) {
+      std::cerr << "Replay speedup must be positive" << std::endl;
+      return 1;
+    }
+    std::shared_ptr<trace_file> trace;
+    std::shared_ptr<payload> trace_values;
+    try {
+      trace = std::make_shared<trace_file>(path);
+      // Values take their sizes from the trace
+      auto fixed_conf = p_conf ? *p_conf : pt::ptree();
+      fixed_conf.put("value_size_distribution", "fixed");
+      trace_values = std::make_shared<payload>(fixed_conf, std::max<size_t>(trace->max_value_size(), 1));
+    } catch (std::exception &e) {
+      std::cerr << e.what() << std::endl;
+      return 1;
+    }
+    std::cerr << "Replay: path=" << path << " records=" << trace->size() << " timing=" << timing << " speedup="
+              << speedup << std::endl;
+    auto remaining = timeout - (hr_clock::now_ns() - begin);
+    benchmark::run_replay(s_ifs, s_conf, *trace, output_prefix, *trace_values, n_ops, timing == "original", speedup,
+                          mode, remaining, control_host, control_port, id);
+  } else if (run_tenants) {
+    auto begin = hr_clock::now_ns();
+    if (global_limiter != nullptr)
+      std::cerr << "Tenants: rate=" << global_limiter->get_rate() << std::endl;
+    for (const auto &t: tenants) {
+      std::cerr << "Tenant " << t.name << ": threads=" << t.num_workers << " num_ops=" << t.num_ops << " rate="
+                << (t.limiter != nullptr ? t.limiter->get_rate() : 0) << " thread_rate=" << t.thread_rate << std::endl;
+      t.wl->print(std::cerr);
+      std::cerr << std::endl;
+      t.values->print(std::cerr);
+      std::cerr << std::endl;
+    }
+    auto remaining = timeout - (hr_clock::now_ns() - begin);
+    benchmark::run_tenants(s_ifs, s_conf, tenants, output_prefix, warm_up, precompute_keys, mode, remaining,
+                           control_host, control_port, id);
+    if (global_limiter != nullptr) {
+      std::cerr << "[global] ";
+      global_limiter->print_pacing(std::cerr);
+      std::cerr << std::endl;
+    }
+  } else if (run_workload) {
+    if (open_loop) {
+      std::cerr << "Workload mode does not support async{n}, rate{n} or slo{...}" << std::endl;
+      return 1;
+    }
+    auto begin = hr_clock::now_ns();
+    auto w_conf = conf.get_child_optional("workload");
+    std::shared_ptr<workload> wl;
+    try {
+      wl = std::make_shared<workload>(w_conf ? *w_conf : pt::ptree(), n_ops);
+    } catch (std::invalid_argument &e) {
+      std::cerr << e.what() << std::endl;
+      return 1;
+    }
+    auto remaining = timeout - (hr_clock::now_ns() - begin);
+    benchmark::run_workload(s_ifs, s_conf, *wl, output_prefix, *values, n_ops, warm_up, precompute_keys, mode,
+                            remaining, control_host, control_port, id);
   } else {
-    std::cerr << "Unknown key distribution: " << argv[8] << std::endl;
+    auto begin = hr_clock::now_ns();
+    std::string dist(argv[9]);
+    auto zipf_theta = b_conf.get<double>("zipf_theta", 0.0);
+    std::vector<std::shared_ptr<key_generator>> key_gens;
+    for (size_t t = 0; t < n_threads; ++t) {
+      std::shared_ptr<key_generator> key_gen;
+      if (dist == "zipf") {
+        key_gen = std::make_shared<zipf_key_generator>(zipf_theta, n_ops);
+      } else if (dist == "scrambled_zipf") {
+        key_gen = std::make_shared<scrambled_zipf_key_generator>(zipf_theta, n_ops);
+      } else if (dist == "hotspot") {
+        key_gen = std::make_shared<hotspot_key_generator>(n_ops, b_conf.get<double>("hotspot_set_fraction", 0.2),
+                                                          b_conf.get<double>("hotspot_op_fraction", 0.8));
+      } else if (dist == "uniform") {
+        key_gen = std::make_shared<uniform_key_generator>(n_ops);
+      } else if (dist == "sequential") {
+        // Each worker writes its own contiguous slice of the key space
+        auto first_key = benchmark_utils::partition_begin(n_ops, n_threads, t);
+        key_gen = std::make_shared<sequential_key_generator>(first_key);
+      } else {
+        std::cerr << "Unknown key distribution: " << dist << std::endl;
+        return 1;
+      }
+      if (precompute_keys) {
+        // Enough for the worker's share of the ops and its warm-up
+        auto worker_ops = benchmark_utils::partition_begin(n_ops, n_threads, t + 1)
+            - benchmark_utils::partition_begin(n_ops, n_threads, t);
+        key_gen = std::make_shared<key_schedule>(key_gen, warm_up ? worker_ops + worker_ops / 10 : worker_ops);
+      }
+      key_gens.push_back(key_gen);
+    }
+    auto remaining = timeout - (hr_clock::now_ns() - begin);
+    if (global_limiter != nullptr)
+      std::cerr << "Rate: " << global_limiter->get_rate() << " keys/s" << std::endl;
+    run_benchmark(s_ifs, s_conf, key_gens, output_prefix, *values, n_ops, batch_size, preload_opts, global_limiter,
+                  n_async, max_outstanding_bytes, rate, arrivals, search, warm_up, mode, remaining, control_host,
+                  control_port, id);
+    if (global_limiter != nullptr) {
+      std::cerr << "[global] ";
+      global_limiter->print_pacing(std::cerr);
+      std::cerr << std::endl;
+    }
   }
 
   Aws::ShutdownAPI(m_options);
@@ -2,6 +2,71 @@
 #include "storage_interface.h"
 
 std::shared_ptr<storage_interfaces::interface_map> storage_interfaces::m_interface_map{nullptr};
+std::shared_ptr<storage_interfaces::decorator_map> storage_interfaces::m_decorator_map{nullptr};
+
+void storage_interface::write_slice(const std::string &key, const char *value, size_t length) {
+  write(key, std::string(value, length));
+}
+
+void storage_interface::write_slice_async(const std::string &key, const char *value, size_t length) {
+  write_async(key, std::string(value, length));
+}
+
+void storage_interface::submit_write(uint64_t tag, const std::string &key, const char *value, size_t length) {
+  write_slice_async(key, value, length);
+  m_pending.push({tag, false});
+}
+
+void storage_interface::submit_read(uint64_t tag, const std::string &key) {
+  read_async(key);
+  m_pending.push({tag, true});
+}
+
+storage_interface::completion storage_interface::wait_completion() {
+  auto request = m_pending.pop();
+  if (request.read)
+    return make_completion(request.tag, [this]() { return wait_read(); });
+  return make_completion(request.tag, [this]() {
+    wait_write();
+    return std::string();
+  });
+}
+
+void storage_interface::multi_read(const std::vector<std::string> &keys, std::vector<std::string> &values) {
+  values.resize(keys.size());
+  for (size_t i = 0; i < keys.size(); ++i)
+    submit_read(i, keys[i]);
+  // Wait for every request before reporting a failure, so none is left in flight
+  bool failed = false;
+  std::string error;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    auto c = wait_completion();
+    if (c.ok) {
+      values[c.tag] = std::move(c.value);
+    } else {
+      failed = true;
+      error = std::move(c.error);
+    }
+  }
+  if (failed)
+    throw std::runtime_error(error);
+}
+
+void storage_interface::multi_write(const std::vector<std::string> &keys, const std::vector<value_slice> &values) {
+  for (size_t i = 0; i < keys.size(); ++i)
+    submit_write(i, keys[i], values[i].data, values[i].size);
+  bool failed = false;
+  std::string error;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    auto c = wait_completion();
+    if (!c.ok) {
+      failed = true;
+      error = std::move(c.error);
+    }
+  }
+  if (failed)
+    throw std::runtime_error(error);
+}
 
 std::string storage_interface::random_string(size_t length) {
   static auto &charset = "0123456789abcdefghijklmnopqrstuvwxyz";
@@ -1,17 +1,38 @@
 #ifndef STORAGE_BENCH_STORAGE_INTERFACE_H
 #define STORAGE_BENCH_STORAGE_INTERFACE_H
 
+#include <cstdint>
 #include <string>
 #include <map>
+#include <vector>
 #include <utility>
 #include <memory>
+#include <functional>
 #include <boost/property_tree/ptree.hpp>
 #include <iostream>
+#include <stdexcept>
+#include "queue.h"
 
 class storage_interface {
  public:
   typedef boost::property_tree::ptree property_map;
 
+  // A value to write that the caller owns: size bytes starting at data
+  struct value_slice {
+    const char *data;
+    size_t size;
+  };
+
+  // Result of a request made through submit_write or submit_read
+  struct completion {
+    uint64_t tag;
+    bool ok;
+    // The value read, for successful reads
+    std::string value;
+    // Why the request failed, if it did
+    std::string error;
+  };
+
   virtual void init(const property_map &conf, bool create) = 0;
   virtual void write(const std::string &key, const std::string &value) = 0;
   virtual std::string read(const std::string &key) = 0;
@@ -23,27 +44,91 @@ class storage_interface {
   virtual void wait_write() = 0;
   virtual std::string wait_read() = 0;
 
+  // Write length bytes starting at value, which stays valid until the write completes. Backends that can send
+  // straight from the caller's buffer override these; by default the value is copied into a string.
+  virtual void write_slice(const std::string &key, const char *value, size_t length);
+  virtual void write_slice_async(const std::string &key, const char *value, size_t length);
+
+  // Completion-driven async requests. Each request carries a caller-chosen tag, and wait_completion() blocks
+  // until any request finishes and returns its completion, so a slow request does not hold up the ones issued
+  // after it. value stays valid until the write completes. Requests may be submitted from one thread while
+  // another waits for completions. By default these are built on write_slice_async, read_async, wait_write and
+  // wait_read, so requests complete in issue order; backends with callback APIs override all three.
+  virtual void submit_write(uint64_t tag, const std::string &key, const char *value, size_t length);
+  virtual void submit_read(uint64_t tag, const std::string &key);
+  virtual completion wait_completion();
+
+  // Batched access: multi_read stores the value of keys[i] in values[i], and multi_write writes values[i] to
+  // keys[i]. Either throws std::runtime_error if any key fails. Backends with native batch operations override
+  // these; by default the keys are read or written with submit_*, all in flight at once, so they must not be
+  // mixed with other outstanding async requests.
+  virtual void multi_read(const std::vector<std::string> &keys, std::vector<std::string> &values);
+  virtual void multi_write(const std::vector<std::string> &keys, const std::vector<value_slice> &values);
+
   static std::string random_string(size_t length);
+
+ protected:
+  // Completion for tag, with the value returned by parse, which throws std::runtime_error if the request failed
+  template<typename F>
+  static completion make_completion(uint64_t tag, F parse) {
+    try {
+      return completion{tag, true, parse(), ""};
+    } catch (std::runtime_error &e) {
+      return completion{tag, false, "", e.what()};
+    }
+  }
+
+ private:
+  struct pending_request {
+    uint64_t tag;
+    bool read;
+  };
+
+  // Requests submitted through the default, in-order implementation
+  queue<pending_request> m_pending;
 };
 
+/*
+ * Registry of backends by name. A decorator wraps another interface and is named by a prefix, so that
+ * compress:s3 is the s3 backend wrapped by the compress decorator; prefixes can be stacked.
+ */
 class storage_interfaces {
  public:
-  typedef std::map<std::string, std::shared_ptr<storage_interface>> interface_map;
+  typedef std::function<std::shared_ptr<storage_interface>()> factory;
+  typedef std::map<std::string, factory> interface_map;
+  typedef std::function<std::shared_ptr<storage_interface>(std::shared_ptr<storage_interface>)> decorator;
+  typedef std::map<std::string, decorator> decorator_map;
 
-  static void register_interface(const std::string &name, std::shared_ptr<storage_interface> iface) {
-    interfaces()->insert({name, iface});
+  static void register_interface(const std::string &name, factory f) {
+    interfaces()->insert({name, std::move(f)});
   }
 
   static void deregister_interface(const std::string &name) {
     interfaces()->erase(name);
   }
 
+  static void register_decorator(const std::string &name, decorator d) {
+    decorators()->insert({name, std::move(d)});
+  }
+
+  static void deregister_decorator(const std::string &name) {
+    decorators()->erase(name);
+  }
+
   static std::shared_ptr<storage_interface> get_interface(const std::string &name) {
+    auto colon = name.find(':');
+    if (colon != std::string::npos) {
+      auto d = decorators()->find(name.substr(0, colon));
+      if (d == decorators()->end()) {
+        throw std::invalid_argument("No such decorator " + name.substr(0, colon));
+      }
+      return d->second(get_interface(name.substr(colon + 1)));
+    }
     auto it = interfaces()->find(name);
     if (it == interfaces()->end()) {
       throw std::invalid_argument("No such interface " + name);
     }
-    return it->second;
+    return it->second();
   }
 
   static std::shared_ptr<interface_map> interfaces() {
@@ -53,15 +138,42 @@ class storage_interfaces {
     return m_interface_map;
   };
 
+  static std::shared_ptr<decorator_map> decorators() {
+    if (m_decorator_map == nullptr) {
+      m_decorator_map = std::make_shared<decorator_map>();
+    }
+    return m_decorator_map;
+  };
+
+  // The configuration to init the interface called name with: the section of the backend it names ([s3] for
+  // compress:s3), with every section of conf attached as a child, so that decorators can find their own sections
+  static storage_interface::property_map configuration(const storage_interface::property_map &conf,
+                                                       const std::string &name) {
+    auto backend = name.substr(name.rfind(':') + 1);
+    auto backend_conf = conf.get_child_optional(backend);
+    if (!backend_conf) {
+      throw std::invalid_argument("No section for interface " + backend);
+    }
+    auto c = *backend_conf;
+    for (const auto &section: conf) {
+      if (!section.second.empty() && c.find(section.first) == c.not_found())
+        c.add_child(section.first, section.second);
+    }
+    return c;
+  }
+
  private:
   static std::shared_ptr<interface_map> m_interface_map;
+  static std::shared_ptr<decorator_map> m_decorator_map;
 };
 
 #define REGISTER_STORAGE_IFACE(name, iface)                                     \
   class iface##_class {                                                         \
    public:                                                                      \
     iface##_class() {                                                           \
-      storage_interfaces::register_interface(name, std::make_shared<iface>());  \
+      storage_interfaces::register_interface(name, []() {                       \
+        return std::make_shared<iface>();                                       \
+      });                                                                       \
     }                                                                           \
     ~iface##_class() {                                                          \
       storage_interfaces::deregister_interface(name);                           \
@@ -69,4 +181,19 @@ class storage_interfaces {
   };                                                                            \
   static iface##_class iface##_singleton
 
+#define REGISTER_STORAGE_DECORATOR(name, iface)                                 \
+  class iface##_class {                                                         \
+   public:                                                                      \
+    iface##_class() {                                                           \
+      storage_interfaces::register_decorator(                                   \
+          name, [](std::shared_ptr<storage_interface> inner) {                  \
+            return std::make_shared<iface>(std::move(inner));                   \
+          });                                                                   \
+    }                                                                           \
+    ~iface##_class() {                                                          \
+      storage_interfaces::deregister_decorator(name);                           \
+    }                                                                           \
+  };                                                                            \
+  static iface##_class iface##_singleton
+
 #endif //STORAGE_BENCH_STORAGE_INTERFACE_H
\ No newline at end of file
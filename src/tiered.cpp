@@ -0,0 +1,393 @@
+#include "tiered.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "hr_clock.h"
+
+// Which keys are in the fast tier, and the thread that moves keys between tiers. Keys are split over stripes, each
+// locked on its own with its share of the capacity, so that reads and writes of different keys do not contend.
+class tiered::state {
+ public:
+  // What a read learned about a key before going to a tier
+  struct lookup {
+    bool resident;
+    // Changes with every write of the key, so that a value read from the cold tier is only promoted if the key was
+    // not written while it was read
+    uint64_t version;
+  };
+
+  state(std::shared_ptr<storage_interface> fast, size_t capacity, uint32_t admit_after)
+      : m_fast(std::move(fast)), m_stripe_capacity(capacity / NUM_STRIPES), m_admit_after(admit_after),
+        m_promotions(0), m_demotions(0), m_stop(false) {
+    m_mover = std::thread(&state::move_keys, this);
+  }
+
+  ~state() {
+    {
+      std::lock_guard<std::mutex> lock(m_queue_mtx);
+      m_stop = true;
+    }
+    m_cv.notify_one();
+    m_mover.join();
+  }
+
+  // If key is in the fast tier, counts this as its most recent use; otherwise starts tracking it
+  lookup begin_read(const std::string &key) {
+    auto &s = stripe_of(key);
+    std::lock_guard<std::mutex> lock(s.mtx);
+    auto it = s.keys.find(key);
+    if (it != s.keys.end() && it->second.resident) {
+      s.resident.splice(s.resident.begin(), s.resident, it->second.lru);
+      return lookup{true, it->second.version};
+    }
+    if (it == s.keys.end()) {
+      it = s.keys.emplace(key, key_info()).first;
+      it->second.version = ++s.clock;
+      track(s, it);
+    } else if (!it->second.promoting) {
+      s.tracked.splice(s.tracked.begin(), s.tracked, it->second.lru);
+    }
+    return lookup{false, it->second.version};
+  }
+
+  // Counts a read of key from the cold tier that began as l, and queues it for promotion once it has been read often
+  // enough without being written in between
+  void read_cold(const std::string &key, const lookup &l, const std::string &value) {
+    auto &s = stripe_of(key);
+    {
+      std::lock_guard<std::mutex> lock(s.mtx);
+      auto it = s.keys.find(key);
+      if (it == s.keys.end() || it->second.version != l.version)
+        return;
+      auto &info = it->second;
+      if (info.resident || info.promoting)
+        return;
+      s.tracked_bytes = s.tracked_bytes - info.size + key.size() + value.size();
+      info.size = key.size() + value.size();
+      if (++info.reads < m_admit_after) {
+        bound(s);
+        return;
+      }
+      // Promoting keys are not tracked, so that bounding the others cannot drop them
+      info.promoting = true;
+      s.tracked_bytes -= info.size;
+      s.tracked.erase(info.lru);
+    }
+    {
+      std::lock_guard<std::mutex> lock(m_queue_mtx);
+      m_promotions_pending.push(promotion{key, value, l.version});
+    }
+    m_cv.notify_one();
+  }
+
+  // True if key is in the fast tier, whose copy the caller must then update too
+  bool write(const std::string &key) {
+    auto &s = stripe_of(key);
+    std::lock_guard<std::mutex> lock(s.mtx);
+    auto it = s.keys.find(key);
+    if (it == s.keys.end())
+      return false;
+    // Reads and promotions under way have the old value, and are dropped
+    it->second.version = ++s.clock;
+    return it->second.resident;
+  }
+
+  void clear() {
+    for (auto &s: m_stripes) {
+      std::lock_guard<std::mutex> lock(s.mtx);
+      s.keys.clear();
+      s.resident.clear();
+      s.tracked.clear();
+      s.resident_bytes = 0;
+      s.tracked_bytes = 0;
+    }
+  }
+
+  void print(std::ostream &out) {
+    size_t keys = 0;
+    size_t bytes = 0;
+    for (auto &s: m_stripes) {
+      std::lock_guard<std::mutex> lock(s.mtx);
+      keys += s.resident.size();
+      bytes += s.resident_bytes;
+    }
+    out << "Tiers: " << m_promotions << " promotions, " << m_demotions << " demotions, " << keys << " keys ("
+        << bytes << " bytes) in the fast tier" << std::endl;
+  }
+
+ private:
+  static const size_t NUM_STRIPES = 16;
+
+  struct key_info {
+    uint32_t reads = 0;
+    uint64_t version = 0;
+    bool promoting = false;
+    bool resident = false;
+    size_t size = 0;
+    // Position in the stripe's resident list, or in its tracked list unless promoting
+    std::list<std::string>::iterator lru;
+  };
+
+  struct stripe {
+    std::mutex mtx;
+    std::unordered_map<std::string, key_info> keys;
+    // Keys in the fast tier, most recently read first
+    std::list<std::string> resident;
+    size_t resident_bytes = 0;
+    // Keys read from the cold tier but not promoted, most recently read first. Their read counts are kept for as
+    // many bytes of keys and values as the stripe's share of the fast tier holds, so that the tracking stays bounded
+    std::list<std::string> tracked;
+    size_t tracked_bytes = 0;
+    uint64_t clock = 0;
+  };
+
+  struct promotion {
+    std::string key;
+    std::string value;
+    uint64_t version;
+  };
+
+  stripe &stripe_of(const std::string &key) {
+    return m_stripes[std::hash<std::string>()(key) % NUM_STRIPES];
+  }
+
+  // Adds a key that is not resident to the front of its stripe's tracked keys
+  void track(stripe &s, std::unordered_map<std::string, key_info>::iterator it) {
+    auto &info = it->second;
+    info.resident = false;
+    info.promoting = false;
+    info.reads = 0;
+    if (info.size < it->first.size())
+      info.size = it->first.size();
+    s.tracked.push_front(it->first);
+    info.lru = s.tracked.begin();
+    s.tracked_bytes += info.size;
+    bound(s);
+  }
+
+  // Forgets the least recently read tracked keys beyond the stripe's capacity, keeping the most recent one
+  void bound(stripe &s) {
+    while (s.tracked_bytes > m_stripe_capacity && s.tracked.size() > 1) {
+      auto it = s.keys.find(s.tracked.back());
+      s.tracked_bytes -= it->second.size;
+      s.tracked.pop_back();
+      s.keys.erase(it);
+    }
+  }
+
+  void move_keys() {
+    std::unique_lock<std::mutex> queue_lock(m_queue_mtx);
+    while (true) {
+      m_cv.wait(queue_lock, [this] { return m_stop || !m_promotions_pending.empty(); });
+      if (m_stop)
+        return;
+      auto p = std::move(m_promotions_pending.front());
+      m_promotions_pending.pop();
+      queue_lock.unlock();
+      promote(p);
+      queue_lock.lock();
+    }
+  }
+
+  void promote(const promotion &p) {
+    bool copied = true;
+    try {
+      m_fast->write(p.key, p.value);
+    } catch (std::runtime_error &e) {
+      std::cerr << "WARN Could not promote " << p.key << ": " << e.what() << std::endl;
+      copied = false;
+    }
+
+    auto &s = stripe_of(p.key);
+    std::vector<std::string> demoted;
+    {
+      std::lock_guard<std::mutex> lock(s.mtx);
+      auto it = s.keys.find(p.key);
+      if (it == s.keys.end())
+        return;
+      auto &info = it->second;
+      if (!copied || info.version != p.version) {
+        track(s, it);
+        return;
+      }
+      info.promoting = false;
+      info.resident = true;
+      info.size = p.key.size() + p.value.size();
+      s.resident.push_front(p.key);
+      info.lru = s.resident.begin();
+      s.resident_bytes += info.size;
+      ++m_promotions;
+
+      while (s.resident_bytes > m_stripe_capacity) {
+        auto victim = s.keys.find(s.resident.back());
+        s.resident_bytes -= victim->second.size;
+        demoted.push_back(s.resident.back());
+        s.resident.pop_back();
+        ++m_demotions;
+        track(s, victim);
+      }
+    }
+    for (const auto &key: demoted) {
+      try {
+        m_fast->write(key, "");
+      } catch (std::runtime_error &e) {
+        std::cerr << "WARN Could not demote " << key << ": " << e.what() << std::endl;
+      }
+    }
+  }
+
+  std::shared_ptr<storage_interface> m_fast;
+  size_t m_stripe_capacity;
+  uint32_t m_admit_after;
+  stripe m_stripes[NUM_STRIPES];
+
+  std::mutex m_queue_mtx;
+  std::condition_variable m_cv;
+  std::queue<promotion> m_promotions_pending;
+  std::atomic<size_t> m_promotions;
+  std::atomic<size_t> m_demotions;
+  bool m_stop;
+  std::thread m_mover;
+};
+
+// The tiers' state all instances in the process share; created by the first init()
+static std::shared_ptr<tiered::state> g_state;
+static std::mutex g_state_mtx;
+
+// Statistics of the instances that are gone, printed when the last instance goes
+static std::unique_ptr<tiered::stats> g_stats;
+static size_t g_instances = 0;
+
+void tiered::stats::merge(const stats &other) {
+  fast_reads += other.fast_reads;
+  cold_reads += other.cold_reads;
+  fast_read_ns.merge(other.fast_read_ns);
+  cold_read_ns.merge(other.cold_read_ns);
+}
+
+tiered::tiered() {
+  std::lock_guard<std::mutex> lock(g_state_mtx);
+  ++g_instances;
+}
+
+tiered::~tiered() {
+  std::lock_guard<std::mutex> lock(g_state_mtx);
+  if (g_stats == nullptr)
+    g_stats.reset(new stats());
+  g_stats->merge(m_stats);
+  if (--g_instances > 0)
+    return;
+  auto reads = g_stats->fast_reads + g_stats->cold_reads;
+  if (reads > 0 && m_state != nullptr) {
+    m_state->print(std::cerr);
+    std::cerr << "Reads: " << g_stats->fast_reads << " from the fast tier, " << g_stats->cold_reads
+              << " from the cold tier (fast tier hit ratio " << static_cast<double>(g_stats->fast_reads) / reads
+              << ")" << std::endl;
+    std::cerr << "Latency summary for fast tier reads (count, p50, p90, p99, p99.9, max in ns): ";
+    g_stats->fast_read_ns.write_summary(std::cerr);
+    std::cerr << std::endl;
+    std::cerr << "Latency summary for cold tier reads (count, p50, p90, p99, p99.9, max in ns): ";
+    g_stats->cold_read_ns.write_summary(std::cerr);
+    std::cerr << std::endl;
+  }
+  g_stats.reset();
+  m_state.reset();
+  g_state.reset();
+}
+
+void tiered::init(const property_map &conf, bool create) {
+  auto fast = conf.get<std::string>("fast", "");
+  auto cold = conf.get<std::string>("cold", "");
+  if (fast.empty() || cold.empty())
+    throw std::invalid_argument("tiered needs a fast and a cold tier");
+  auto admit_after = conf.get<uint32_t>("admit_after", 2);
+  if (admit_after == 0)
+    throw std::invalid_argument("admit_after must be at least 1");
+  auto fast_conf = storage_interfaces::configuration(conf, fast);
+  m_fast = storage_interfaces::get_interface(fast);
+  m_cold = storage_interfaces::get_interface(cold);
+  m_fast->init(fast_conf, create);
+  m_cold->init(storage_interfaces::configuration(conf, cold), create);
+
+  std::lock_guard<std::mutex> lock(g_state_mtx);
+  if (g_state == nullptr) {
+    // The background thread has a connection of its own to the fast tier
+    auto mover = storage_interfaces::get_interface(fast);
+    mover->init(fast_conf, false);
+    g_state = std::make_shared<state>(mover, conf.get<size_t>("capacity", 1024 * 1024 * 1024), admit_after);
+  }
+  m_state = g_state;
+}
+
+void tiered::write(const std::string &key, const std::string &value) {
+  write_slice(key, value.data(), value.size());
+}
+
+std::string tiered::read(const std::string &key) {
+  auto t_b = hr_clock::now_ns();
+  auto l = m_state->begin_read(key);
+  if (l.resident) {
+    auto value = m_fast->read(key);
+    // Unless a demotion emptied it in the meantime
+    if (!value.empty()) {
+      ++m_stats.fast_reads;
+      m_stats.fast_read_ns.record(hr_clock::elapsed_ns(t_b, hr_clock::now_ns()));
+      return value;
+    }
+    l = m_state->begin_read(key);
+  }
+  // The version is taken before the cold read, so that a write racing with it keeps its value from being promoted
+  auto value = m_cold->read(key);
+  ++m_stats.cold_reads;
+  m_stats.cold_read_ns.record(hr_clock::elapsed_ns(t_b, hr_clock::now_ns()));
+  m_state->read_cold(key, l, value);
+  return value;
+}
+
+void tiered::destroy() {
+  m_state->clear();
+  m_fast->destroy();
+  m_cold->destroy();
+}
+
+void tiered::write_async(const std::string &key, const std::string &value) {
+  write_slice_async(key, value.data(), value.size());
+}
+
+void tiered::read_async(const std::string &key) {
+  m_read_results.push(make_completion(0, [&]() { return read(key); }));
+}
+
+void tiered::wait_write() {
+  auto c = m_write_results.pop();
+  if (!c.ok)
+    throw std::runtime_error(c.error);
+}
+
+std::string tiered::wait_read() {
+  auto c = m_read_results.pop();
+  if (!c.ok)
+    throw std::runtime_error(c.error);
+  return std::move(c.value);
+}
+
+void tiered::write_slice(const std::string &key, const char *value, size_t length) {
+  m_cold->write_slice(key, value, length);
+  if (m_state->write(key))
+    m_fast->write_slice(key, value, length);
+}
+
+void tiered::write_slice_async(const std::string &key, const char *value, size_t length) {
+  m_write_results.push(make_completion(0, [&]() {
+    write_slice(key, value, length);
+    return std::string();
+  }));
+}
+
+REGISTER_STORAGE_IFACE("tiered", tiered);
@@ -0,0 +1,68 @@
+#ifndef STORAGE_BENCH_TIERED_H
+#define STORAGE_BENCH_TIERED_H
+
+#include <memory>
+#include "storage_interface.h"
+#include "latency_histogram.h"
+#include "queue.h"
+
+/*
+ * Composite backend that keeps the frequently read keys of a cold tier in a fast one, e.g. redis in front of s3.
+ * Configured by the [tiered] section:
+ *
+ *   fast=redis            the fast tier, any interface name including decorated ones
+ *   cold=s3               the cold tier, which holds every key
+ *   capacity=1073741824   bytes of keys and values to keep in the fast tier
+ *   admit_after=2         reads of a key in the cold tier before it is copied to the fast tier
+ *
+ * Both tiers take their settings from their own sections. Writes go to the cold tier, and to the fast tier as well
+ * if the key is there. Reads go to the fast tier if the key is there and read through to the cold tier otherwise.
+ * Promotions, and demotions of the least recently read keys when the fast tier is over capacity, are done by a
+ * background thread that all instances in a process share. A value read from the cold tier is only promoted if the
+ * key was not written while it was read. Backends have no deletes, so a demoted value is overwritten with an empty
+ * one to give back its space.
+ *
+ * Keys are split over 16 independently locked stripes, each with its share of the capacity. Read counts of keys
+ * not in the fast tier are kept for the most recently read ones only, up to the same number of bytes.
+ *
+ * async requests are served inline, one at a time. Per-tier hit ratios and the latency of reads from each tier are
+ * collected across all instances and printed when the last one goes away.
+ */
+class tiered : public storage_interface {
+ public:
+  tiered();
+  ~tiered();
+
+  void init(const property_map &conf, bool create) override;
+  void write(const std::string &key, const std::string &value) override;
+  std::string read(const std::string &key) override;
+  void destroy() override;
+  void write_async(const std::string &key, const std::string &value) override;
+  void read_async(const std::string &key) override;
+  void wait_write() override;
+  std::string wait_read() override;
+  void write_slice(const std::string &key, const char *value, size_t length) override;
+  void write_slice_async(const std::string &key, const char *value, size_t length) override;
+
+  class state;
+
+  struct stats {
+    size_t fast_reads = 0;
+    size_t cold_reads = 0;
+    latency_histogram fast_read_ns;
+    latency_histogram cold_read_ns;
+
+    void merge(const stats &other);
+  };
+
+ private:
+  std::shared_ptr<storage_interface> m_fast;
+  std::shared_ptr<storage_interface> m_cold;
+  std::shared_ptr<state> m_state;
+  // Outcomes of write_async/read_async, which are served inline; submit_* may be waited for on another thread
+  queue<completion> m_write_results;
+  queue<completion> m_read_results;
+  stats m_stats;
+};
+
+#endif //STORAGE_BENCH_TIERED_H
@@ -1,26 +1,37 @@
 #include "token_bucket.h"
 
-token_bucket::token_bucket(uint64_t rate, uint64_t burst_size) {
-  m_time_per_token = 1000000 / rate;
-  m_time_per_burst = burst_size * m_time_per_token;
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include "hr_clock.h"
+
+// Virtual time 0 marks a bucket that has not handed out anything yet, so the epoch lies just before creation
+token_bucket::token_bucket(double rate, double burst_size) : m_epoch_ns(hr_clock::now_ns() - 1) {
+  set_rate(rate);
+  auto burst = burst_size * m_time_per_token.load();
+  m_time_per_burst = std::isinf(burst) || burst >= std::numeric_limits<uint64_t>::max()
+                     ? std::numeric_limits<uint64_t>::max() : static_cast<uint64_t>(burst);
 }
 
-token_bucket::token_bucket(const token_bucket &other) {
+token_bucket::token_bucket(const token_bucket &other) : m_epoch_ns(other.m_epoch_ns) {
   m_time_per_token = other.m_time_per_token.load();
   m_time_per_burst = other.m_time_per_burst.load();
 }
 
 token_bucket &token_bucket::operator=(const token_bucket &other) {
+  m_epoch_ns = other.m_epoch_ns;
+  m_time = 0;
   m_time_per_token = other.m_time_per_token.load();
   m_time_per_burst = other.m_time_per_burst.load();
   return *this;
 }
 
 bool token_bucket::consume(uint64_t tokens) {
-  using namespace std::chrono;
-  auto now = static_cast<uint64_t>(duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count());
+  auto now = this->now();
   auto time_needed = tokens * m_time_per_token.load(std::memory_order_relaxed);
-  auto min_time = now - m_time_per_burst.load(std::memory_order_relaxed);
+  auto time_per_burst = m_time_per_burst.load(std::memory_order_relaxed);
+  auto min_time = now > time_per_burst ? now - time_per_burst : 0;
   auto old_time = m_time.load(std::memory_order_relaxed);
   auto new_time = old_time;
 
@@ -36,3 +47,40 @@ bool token_bucket::consume(uint64_t tokens) {
     new_time = old_time;
   }
 }
+
+uint64_t token_bucket::reserve(uint64_t tokens) {
+  auto now = this->now();
+  auto time_needed = tokens * m_time_per_token.load(std::memory_order_relaxed);
+  auto time_per_burst = m_time_per_burst.load(std::memory_order_relaxed);
+  auto min_time = now > time_per_burst ? now - time_per_burst : 0;
+  auto old_time = m_time.load(std::memory_order_relaxed);
+
+  for (;;) {
+    auto start = old_time == 0 ? now : std::max(old_time, min_time);
+    if (m_time.compare_exchange_weak(old_time, start + time_needed, std::memory_order_relaxed,
+                                     std::memory_order_relaxed))
+      return to_ns(start);
+  }
+}
+
+void token_bucket::set_rate(double rate) {
+  if (rate <= 0.0)
+    throw std::invalid_argument("Token bucket rate must be greater than 0");
+  m_time_per_token = static_cast<uint64_t>(std::llround((1e9 / rate) * (1 << FRACTION_BITS)));
+}
+
+double token_bucket::rate() const {
+  return 1e9 * (1 << FRACTION_BITS) / m_time_per_token.load();
+}
+
+void token_bucket::reset() {
+  m_time = 0;
+}
+
+uint64_t token_bucket::now() const {
+  return (hr_clock::now_ns() - m_epoch_ns) << FRACTION_BITS;
+}
+
+uint64_t token_bucket::to_ns(uint64_t time) const {
+  return m_epoch_ns + (time >> FRACTION_BITS);
+}
@@ -3,20 +3,44 @@
 
 #include <atomic>
 #include <chrono>
-
+#include <cstdint>
+
+/*
+ * Lock-free token bucket in the style of the generic cell rate algorithm: the bucket only keeps the virtual time
+ * up to which tokens have been handed out, which every caller advances with a compare-and-swap, so any number of
+ * threads can share one. Times are kept in fixed point relative to the bucket's creation, so intervals of a
+ * fraction of a nanosecond add up exactly even at millions of tokens per second.
+ */
 class token_bucket {
  public:
-  token_bucket() = default;
-
-  token_bucket(uint64_t rate, uint64_t burst_size);
+  // Tokens that are not taken accumulate up to burst_size, and may then be taken all at once. An infinite
+  // burst_size never discards them, so a schedule of reservations never slips however far behind it falls.
+  token_bucket(double rate, double burst_size);
 
   token_bucket(const token_bucket &other);
 
   token_bucket &operator=(const token_bucket &other);
 
+  // Takes tokens if they are available now
   bool consume(uint64_t tokens);
 
+  // Takes tokens whether or not they are available yet, and returns the hr_clock time (in ns) from which they are.
+  // The first reservation after construction or reset() is available right away.
+  uint64_t reserve(uint64_t tokens);
+
+  void set_rate(double rate);
+  double rate() const;
+
+  // Forgets earlier reservations
+  void reset();
+
  private:
+  static const int FRACTION_BITS = 8;
+
+  uint64_t now() const;
+  uint64_t to_ns(uint64_t time) const;
+
+  uint64_t m_epoch_ns;
   std::atomic<uint64_t> m_time = {0};
   std::atomic<uint64_t> m_time_per_token = {0};
   std::atomic<uint64_t> m_time_per_burst = {0};
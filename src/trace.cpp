@@ -0,0 +1,113 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const size_t HEADER_SIZE = 8 + 4 + 4 + 8 + 8;
+
+trace_file::trace_file(const std::string &path)
+    : m_map(nullptr), m_length(0), m_records(nullptr), m_num_records(0), m_max_value_size(0) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("Could not open " + path + " for reading: " + strerror(errno));
+  struct stat st{};
+  if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < HEADER_SIZE) {
+    ::close(fd);
+    throw std::runtime_error(path + " is not a trace file");
+  }
+  m_length = static_cast<size_t>(st.st_size);
+  m_map = mmap(nullptr, m_length, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (m_map == MAP_FAILED)
+    throw std::runtime_error("Could not map " + path + ": " + strerror(errno));
+  // Replay reads the records front to back
+  madvise(m_map, m_length, MADV_SEQUENTIAL);
+
+  auto base = static_cast<const char *>(m_map);
+  uint32_t version, record_size;
+  memcpy(&version, base + 8, sizeof(version));
+  memcpy(&record_size, base + 12, sizeof(record_size));
+  memcpy(&m_num_records, base + 16, sizeof(m_num_records));
+  memcpy(&m_max_value_size, base + 24, sizeof(m_max_value_size));
+  std::string error;
+  if (memcmp(base, MAGIC, 8) != 0)
+    error = path + " is not a trace file";
+  else if (version != VERSION || record_size != sizeof(trace_record))
+    error = "Unsupported trace file version " + std::to_string(version);
+  else if (m_num_records > (m_length - HEADER_SIZE) / sizeof(trace_record))
+    error = path + " is truncated";
+  if (error.empty()) {
+    // Replay indexes by op and sizes its payload by max_value_size, so records are checked once here rather than
+    // on every use
+    m_records = reinterpret_cast<const trace_record *>(base + HEADER_SIZE);
+    for (size_t i = 0; i < m_num_records && error.empty(); ++i) {
+      if (m_records[i].op() > trace_record::WRITE)
+        error = path + ": record " + std::to_string(i) + " has unknown op " + std::to_string(m_records[i].op());
+      else if (m_records[i].value_size() > m_max_value_size)
+        error = path + ": record " + std::to_string(i) + " is larger than the trace's max_value_size";
+    }
+  }
+  if (!error.empty()) {
+    munmap(m_map, m_length);
+    throw std::runtime_error(error);
+  }
+}
+
+trace_file::~trace_file() {
+  munmap(m_map, m_length);
+}
+
+trace_writer::trace_writer(const std::string &path)
+    : m_path(path), m_out(path, std::ios::binary), m_num_records(0), m_max_value_size(0), m_last_us(0) {
+  if (!m_out)
+    throw std::runtime_error("Could not open " + path + " for writing");
+  // Leave room for the header
+  char header[HEADER_SIZE] = {};
+  m_out.write(header, sizeof(header));
+}
+
+trace_writer::~trace_writer() {
+  if (m_out.is_open()) {
+    try {
+      close();
+    } catch (std::runtime_error &) {
+      // Callers that care whether the trace was written call close() themselves
+    }
+  }
+}
+
+void trace_writer::append(uint64_t timestamp_us, trace_record::op_type op, uint64_t key, uint64_t value_size) {
+  if (m_num_records == 0)
+    m_last_us = timestamp_us;
+  auto delta = timestamp_us > m_last_us ? timestamp_us - m_last_us : 0;
+  m_last_us = std::max(m_last_us, timestamp_us);
+  auto size = static_cast<uint32_t>(std::min<uint64_t>(value_size, trace_record::MAX_VALUE_SIZE));
+  trace_record r{};
+  r.key = key;
+  r.delta_us = static_cast<uint32_t>(std::min<uint64_t>(delta, std::numeric_limits<uint32_t>::max()));
+  r.op_size = (static_cast<uint32_t>(op) << 28) | size;
+  m_out.write(reinterpret_cast<const char *>(&r), sizeof(r));
+  ++m_num_records;
+  m_max_value_size = std::max<uint64_t>(m_max_value_size, size);
+}
+
+void trace_writer::close() {
+  uint32_t version = trace_file::VERSION;
+  uint32_t record_size = sizeof(trace_record);
+  m_out.seekp(0);
+  m_out.write(trace_file::MAGIC, 8);
+  m_out.write(reinterpret_cast<const char *>(&version), sizeof(version));
+  m_out.write(reinterpret_cast<const char *>(&record_size), sizeof(record_size));
+  m_out.write(reinterpret_cast<const char *>(&m_num_records), sizeof(m_num_records));
+  m_out.write(reinterpret_cast<const char *>(&m_max_value_size), sizeof(m_max_value_size));
+  m_out.close();
+  if (!m_out)
+    throw std::runtime_error("Could not write " + m_path);
+}
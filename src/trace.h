@@ -0,0 +1,97 @@
+#ifndef STORAGE_BENCH_TRACE_H
+#define STORAGE_BENCH_TRACE_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+/*
+ * Compact binary trace of storage operations, replayed by the replay mode:
+ *
+ *   magic "SBTRACE\0" | version (u32) | record_size (u32) | num_records (u64) | max_value_size (u64)
+ *   num_records x { key (u64) | delta_us (u32) | op (high 4 bits) and value_size (low 28 bits) (u32) }
+ *
+ * Keys are numeric ids, or hashes of the original keys, and are formatted like generated keys when replayed.
+ * delta_us is the time since the previous record. Readers map the file and use the records in place, after one pass
+ * that rejects records with an unknown op or a value_size above max_value_size.
+ */
+struct trace_record {
+  enum op_type : uint32_t {
+    READ = 0,
+    WRITE = 1
+  };
+
+  static const uint32_t MAX_VALUE_SIZE = (1U << 28) - 1;
+
+  uint64_t key;
+  uint32_t delta_us;
+  uint32_t op_size;
+
+  op_type op() const {
+    return static_cast<op_type>(op_size >> 28);
+  }
+
+  uint32_t value_size() const {
+    return op_size & MAX_VALUE_SIZE;
+  }
+};
+
+class trace_file {
+ public:
+  static constexpr const char *MAGIC = "SBTRACE";
+  static const uint32_t VERSION = 1;
+
+  explicit trace_file(const std::string &path);
+  ~trace_file();
+
+  trace_file(const trace_file &) = delete;
+  trace_file &operator=(const trace_file &) = delete;
+
+  const trace_record *begin() const {
+    return m_records;
+  }
+
+  const trace_record *end() const {
+    return m_records + m_num_records;
+  }
+
+  size_t size() const {
+    return m_num_records;
+  }
+
+  uint64_t max_value_size() const {
+    return m_max_value_size;
+  }
+
+ private:
+  void *m_map;
+  size_t m_length;
+  const trace_record *m_records;
+  size_t m_num_records;
+  uint64_t m_max_value_size;
+};
+
+// Appends records to a new trace file; the header is filled in by close()
+class trace_writer {
+ public:
+  explicit trace_writer(const std::string &path);
+  ~trace_writer();
+
+  // timestamp_us may be on any clock, but must not go backwards; gaps longer than delta_us can hold are shortened.
+  // Values larger than MAX_VALUE_SIZE are recorded as MAX_VALUE_SIZE.
+  void append(uint64_t timestamp_us, trace_record::op_type op, uint64_t key, uint64_t value_size);
+  void close();
+
+  size_t size() const {
+    return m_num_records;
+  }
+
+ private:
+  std::string m_path;
+  std::ofstream m_out;
+  uint64_t m_num_records;
+  uint64_t m_max_value_size;
+  uint64_t m_last_us;
+};
+
+#endif //STORAGE_BENCH_TRACE_H
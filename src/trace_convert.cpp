@@ -0,0 +1,92 @@
+#include <iostream>
+#include <vector>
+#include "trace.h"
+#include "benchmark_utils.h"
+
+// 64-bit FNV-1a, so that textual keys map to the same ids in every conversion
+static uint64_t hash_key(const std::string &key) {
+  uint64_t h = 14695981039346656037ULL;
+  for (auto c: key) {
+    h ^= static_cast<unsigned char>(c);
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+// Keys that are already numbers keep their value, so traces of generated keys replay the same keys
+static uint64_t key_id(const std::string &key) {
+  if (key.empty() || key.size() > 19 || key.find_first_not_of("0123456789") != std::string::npos)
+    return hash_key(key);
+  return std::stoull(key);
+}
+
+static bool parse_op(const std::string &op, trace_record::op_type &type) {
+  if (op == "read" || op == "get" || op == "gets" || op == "GET" || op == "REST.GET.OBJECT") {
+    type = trace_record::READ;
+  } else if (op == "write" || op == "update" || op == "insert" || op == "put" || op == "set" || op == "add"
+      || op == "replace" || op == "cas" || op == "append" || op == "prepend" || op == "incr" || op == "decr"
+      || op == "PUT" || op == "REST.PUT.OBJECT") {
+    type = trace_record::WRITE;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/*
+ * Converts a text trace into a binary trace for the replay mode. Formats:
+ *
+ *   csv       timestamp_us,op,key,value_size (a header line is skipped)
+ *   twitter   Twemcache traces: timestamp_s,key,key_size,value_size,client_id,op,ttl
+ *
+ * Ops that are neither reads nor writes, such as deletes, are skipped.
+ */
+int main(int argc, char **argv) {
+  if (argc != 4) {
+    std::cerr << "Usage: " << argv[0] << " csv|twitter text_trace binary_trace" << std::endl;
+    return -1;
+  }
+
+  std::string format = argv[1];
+  if (format != "csv" && format != "twitter") {
+    std::cerr << "Unknown trace format: " << format << std::endl;
+    return 1;
+  }
+  std::ifstream in(argv[2]);
+  if (!in) {
+    std::cerr << "Could not open " << argv[2] << std::endl;
+    return 1;
+  }
+
+  try {
+    trace_writer out(argv[3]);
+    std::string line;
+    size_t skipped = 0;
+    std::vector<std::string> fields;
+    while (std::getline(in, line)) {
+      fields.clear();
+      benchmark_utils::split(line, fields, ',');
+      trace_record::op_type op;
+      try {
+        if (format == "csv" && fields.size() == 4 && parse_op(fields[1], op)) {
+          out.append(std::stoull(fields[0]), op, key_id(fields[2]), std::stoull(fields[3]));
+          continue;
+        }
+        if (format == "twitter" && fields.size() == 7 && parse_op(fields[5], op)) {
+          out.append(std::stoull(fields[0]) * 1000000, op, key_id(fields[1]), std::stoull(fields[3]));
+          continue;
+        }
+      } catch (std::logic_error &) {
+        // Malformed numbers, including header lines
+      }
+      ++skipped;
+    }
+    out.close();
+    std::cerr << "Converted " << out.size() << " ops, skipped " << skipped << " lines" << std::endl;
+  } catch (std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,127 @@
+#include "uring.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static std::string error_string(const std::string &what, int err) {
+  return what + ": " + std::strerror(err);
+}
+
+uring::uring(unsigned entries) : m_to_submit(0) {
+  io_uring_params params{};
+  m_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+  if (m_fd < 0)
+    throw std::runtime_error(error_string("io_uring_setup failed", errno));
+
+  m_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  m_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (single_mmap)
+    m_sq_ring_size = m_cq_ring_size = std::max(m_sq_ring_size, m_cq_ring_size);
+
+  m_sq_ring = mmap(nullptr, m_sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd,
+                   IORING_OFF_SQ_RING);
+  if (m_sq_ring == MAP_FAILED) {
+    int err = errno;
+    close(m_fd);
+    throw std::runtime_error(error_string("Could not map submission queue", err));
+  }
+  if (single_mmap) {
+    m_cq_ring = m_sq_ring;
+  } else {
+    m_cq_ring = mmap(nullptr, m_cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd,
+                     IORING_OFF_CQ_RING);
+    if (m_cq_ring == MAP_FAILED) {
+      int err = errno;
+      munmap(m_sq_ring, m_sq_ring_size);
+      close(m_fd);
+      throw std::runtime_error(error_string("Could not map completion queue", err));
+    }
+  }
+  m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+  m_sqes = static_cast<io_uring_sqe *>(mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE,
+                                            MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES));
+  if (m_sqes == MAP_FAILED) {
+    int err = errno;
+    if (!single_mmap)
+      munmap(m_cq_ring, m_cq_ring_size);
+    munmap(m_sq_ring, m_sq_ring_size);
+    close(m_fd);
+    throw std::runtime_error(error_string("Could not map submission queue entries", err));
+  }
+
+  auto sq = static_cast<char *>(m_sq_ring);
+  m_sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+  m_sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+  m_sq_mask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+  m_sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+  m_sq_entries = params.sq_entries;
+
+  auto cq = static_cast<char *>(m_cq_ring);
+  m_cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+  m_cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+  m_cq_mask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+  m_cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+}
+
+uring::~uring() {
+  munmap(m_sqes, m_sqes_size);
+  if (m_cq_ring != m_sq_ring)
+    munmap(m_cq_ring, m_cq_ring_size);
+  munmap(m_sq_ring, m_sq_ring_size);
+  close(m_fd);
+}
+
+io_uring_sqe *uring::prepare() {
+  auto tail = *m_sq_tail;
+  if (tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE) == m_sq_entries) {
+    submit();
+    // The kernel consumes every submitted entry before io_uring_enter returns
+    tail = *m_sq_tail;
+  }
+  auto index = tail & *m_sq_mask;
+  auto sqe = &m_sqes[index];
+  std::memset(sqe, 0, sizeof(*sqe));
+  m_sq_array[index] = index;
+  __atomic_store_n(m_sq_tail, tail + 1, __ATOMIC_RELEASE);
+  ++m_to_submit;
+  return sqe;
+}
+
+void uring::submit() {
+  while (m_to_submit > 0) {
+    int ret = enter(m_to_submit, 0, 0);
+    if (ret >= 0) {
+      m_to_submit -= static_cast<unsigned>(ret);
+    } else if (errno == EAGAIN || errno == EBUSY) {
+      // Completions are backed up; wait for the reaper to make room
+      std::this_thread::yield();
+    } else if (errno != EINTR) {
+      throw std::runtime_error(error_string("io_uring_enter failed", errno));
+    }
+  }
+}
+
+io_uring_cqe uring::wait() {
+  while (true) {
+    auto head = *m_cq_head;
+    if (head != __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE)) {
+      auto cqe = m_cqes[head & *m_cq_mask];
+      __atomic_store_n(m_cq_head, head + 1, __ATOMIC_RELEASE);
+      return cqe;
+    }
+    if (enter(0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+      throw std::runtime_error(error_string("io_uring_enter failed", errno));
+  }
+}
+
+int uring::enter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+  return static_cast<int>(syscall(__NR_io_uring_enter, m_fd, to_submit, min_complete, flags, nullptr, 0));
+}
@@ -0,0 +1,56 @@
+#ifndef STORAGE_BENCH_URING_H
+#define STORAGE_BENCH_URING_H
+
+#include <cstddef>
+#include <linux/io_uring.h>
+
+/*
+ * Minimal io_uring instance driven through the raw system calls, so the build does not need liburing.
+ *
+ * Not thread-safe on either side: one thread at a time may prepare and submit entries, and one thread at a time
+ * may reap completions, though the two may be different threads.
+ */
+class uring {
+ public:
+  explicit uring(unsigned entries);
+  ~uring();
+
+  uring(const uring &) = delete;
+  uring &operator=(const uring &) = delete;
+
+  // Zeroed submission queue entry to fill in; the queue is flushed first if it is full
+  io_uring_sqe *prepare();
+
+  // Hands every entry prepared since the last call to the kernel
+  void submit();
+
+  // Blocks until a completion is available and consumes it
+  io_uring_cqe wait();
+
+ private:
+  int enter(unsigned to_submit, unsigned min_complete, unsigned flags);
+
+  int m_fd;
+
+  void *m_sq_ring;
+  size_t m_sq_ring_size;
+  void *m_cq_ring;
+  size_t m_cq_ring_size;
+  io_uring_sqe *m_sqes;
+  size_t m_sqes_size;
+
+  unsigned *m_sq_head;
+  unsigned *m_sq_tail;
+  unsigned *m_sq_mask;
+  unsigned *m_sq_array;
+  unsigned m_sq_entries;
+  // Entries prepared but not yet submitted
+  unsigned m_to_submit;
+
+  unsigned *m_cq_head;
+  unsigned *m_cq_tail;
+  unsigned *m_cq_mask;
+  io_uring_cqe *m_cqes;
+};
+
+#endif //STORAGE_BENCH_URING_H
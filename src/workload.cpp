@@ -0,0 +1,188 @@
+#include "workload.h"
+#include "benchmark_utils.h"
+
+static const char *OP_NAMES[] = {"read", "update", "insert", "rmw", "scan"};
+
+const char *workload::op_name(op_type op) {
+  return OP_NAMES[op];
+}
+
+workload::workload(const storage_interface::property_map &conf, size_t default_record_count)
+    : m_proportions(),
+      m_cum_proportions(),
+      m_next_key(0),
+      m_num_keys(std::make_shared<std::atomic<uint64_t>>(0)) {
+  for (auto &d: m_distributions)
+    d = "scrambled_zipf";
+  m_proportions[READ] = 1.0;
+  m_max_scan_length = 100;
+
+  apply_preset(conf.get<std::string>("preset", ""));
+
+  m_record_count = conf.get<size_t>("record_count", default_record_count);
+  m_zipf_theta = conf.get<double>("zipf_theta", 0.01);
+  m_hotspot_set_fraction = conf.get<double>("hotspot_set_fraction", 0.2);
+  m_hotspot_op_fraction = conf.get<double>("hotspot_op_fraction", 0.8);
+  m_max_scan_length = conf.get<size_t>("max_scan_length", m_max_scan_length);
+  if (m_record_count == 0)
+    throw std::invalid_argument("record_count must be positive");
+  if (m_max_scan_length == 0)
+    throw std::invalid_argument("max_scan_length must be positive");
+
+  auto request_dist = conf.get_optional<std::string>("request_distribution");
+  double sum = 0.0;
+  for (int i = 0; i < NUM_OP_TYPES; ++i) {
+    std::string name = OP_NAMES[i];
+    m_proportions[i] = conf.get<double>(name + "_proportion", m_proportions[i]);
+    if (m_proportions[i] < 0)
+      throw std::invalid_argument(name + "_proportion must not be negative");
+    if (request_dist)
+      m_distributions[i] = *request_dist;
+    m_distributions[i] = conf.get<std::string>(name + "_distribution", m_distributions[i]);
+    sum += m_proportions[i];
+  }
+  if (sum <= 0)
+    throw std::invalid_argument("Workload has no operations");
+
+  double cum = 0.0;
+  for (int i = 0; i < NUM_OP_TYPES; ++i) {
+    m_proportions[i] /= sum;
+    cum += m_proportions[i];
+    m_cum_proportions[i] = cum;
+  }
+  // Close the range at the last op type in the mix, so rounding never selects an op type that is not in it
+  for (int i = NUM_OP_TYPES - 1; i >= 0; --i) {
+    m_cum_proportions[i] = 1.0;
+    if (m_proportions[i] > 0)
+      break;
+  }
+
+  m_next_key = m_record_count;
+  m_num_keys->store(m_record_count);
+}
+
+void workload::apply_preset(const std::string &preset) {
+  if (preset.empty())
+    return;
+
+  // The YCSB core workloads
+  for (auto &p: m_proportions)
+    p = 0.0;
+  if (preset == "a") {
+    // Update heavy
+    m_proportions[READ] = 0.5;
+    m_proportions[UPDATE] = 0.5;
+  } else if (preset == "b") {
+    // Read mostly
+    m_proportions[READ] = 0.95;
+    m_proportions[UPDATE] = 0.05;
+  } else if (preset == "c") {
+    // Read only
+    m_proportions[READ] = 1.0;
+  } else if (preset == "d") {
+    // Read latest
+    m_proportions[READ] = 0.95;
+    m_proportions[INSERT] = 0.05;
+    m_distributions[READ] = "latest";
+  } else if (preset == "e") {
+    // Short ranges
+    m_proportions[SCAN] = 0.95;
+    m_proportions[INSERT] = 0.05;
+    m_max_scan_length = 100;
+  } else if (preset == "f") {
+    // Read-modify-write
+    m_proportions[READ] = 0.5;
+    m_proportions[READ_MODIFY_WRITE] = 0.5;
+  } else {
+    throw std::invalid_argument("Unknown workload preset: " + preset);
+  }
+}
+
+workload::generator workload::new_generator(size_t t, size_t n_workers, size_t precompute_ops) {
+  generator gen(this);
+  for (int i = 0; i < NUM_OP_TYPES; ++i) {
+    if (i == INSERT || m_proportions[i] == 0)
+      continue;
+    gen.m_key_gens[i] = new_key_generator(m_distributions[i], t, n_workers);
+    if (precompute_ops > 0 && m_distributions[i] != "latest") {
+      // Leave some slack for the random op mix drawing more of this op type than its expected share
+      auto expected = static_cast<size_t>(static_cast<double>(precompute_ops) * m_proportions[i]);
+      gen.m_key_gens[i] = std::make_shared<key_schedule>(gen.m_key_gens[i], expected + expected / 10 + 16);
+    }
+  }
+  return gen;
+}
+
+std::shared_ptr<key_generator> workload::new_key_generator(const std::string &dist, size_t t, size_t n_workers) {
+  if (dist == "zipf") {
+    return std::make_shared<zipf_key_generator>(m_zipf_theta, m_record_count);
+  } else if (dist == "latest") {
+    return std::make_shared<latest_key_generator>(zipf_key_generator(m_zipf_theta, m_record_count), m_num_keys);
+  } else if (dist == "scrambled_zipf") {
+    return std::make_shared<scrambled_zipf_key_generator>(m_zipf_theta, m_record_count);
+  } else if (dist == "hotspot") {
+    return std::make_shared<hotspot_key_generator>(m_record_count, m_hotspot_set_fraction, m_hotspot_op_fraction);
+  } else if (dist == "uniform") {
+    return std::make_shared<uniform_key_generator>(m_record_count);
+  } else if (dist == "sequential") {
+    return std::make_shared<sequential_key_generator>(benchmark_utils::partition_begin(m_record_count, n_workers, t));
+  }
+  throw std::invalid_argument("Unknown key distribution: " + dist);
+}
+
+size_t workload::record_count() const {
+  return m_record_count;
+}
+
+double workload::proportion(op_type op) const {
+  return m_proportions[op];
+}
+
+void workload::print(std::ostream &out) const {
+  out << "Workload: record_count=" << m_record_count;
+  for (int i = 0; i < NUM_OP_TYPES; ++i) {
+    if (m_proportions[i] > 0) {
+      out << " " << OP_NAMES[i] << "=" << m_proportions[i];
+      if (i != INSERT)
+        out << "(" << m_distributions[i] << ")";
+    }
+  }
+  if (m_proportions[SCAN] > 0)
+    out << " max_scan_length=" << m_max_scan_length;
+}
+
+workload::generator::generator(workload *wl)
+    : m_wl(wl), m_op_dist(0.0, 1.0), m_scan_dist(1, wl->m_max_scan_length) {
+  m_rng.seed(std::random_device()());
+}
+
+workload::op_type workload::generator::next_op() {
+  double r = m_op_dist(m_rng);
+  int i = 0;
+  while (i < NUM_OP_TYPES - 1 && r >= m_wl->m_cum_proportions[i])
+    ++i;
+  return static_cast<op_type>(i);
+}
+
+uint64_t workload::generator::next_key_id(op_type op) {
+  if (op == INSERT)
+    return m_wl->m_next_key++;
+  return m_key_gens[op]->next_id();
+}
+
+void workload::generator::next_key(op_type op, std::string &key) {
+  char buf[key_generator::MAX_KEY_LENGTH];
+  key.assign(buf, key_generator::format(next_key_id(op), buf));
+}
+
+size_t workload::generator::next_scan_length() {
+  return m_scan_dist(m_rng);
+}
+
+void workload::generator::inserted() {
+  ++(*m_wl->m_num_keys);
+}
+
+uint64_t workload::generator::num_keys() const {
+  return m_wl->m_num_keys->load();
+}
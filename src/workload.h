@@ -0,0 +1,97 @@
+#ifndef STORAGE_BENCH_WORKLOAD_H
+#define STORAGE_BENCH_WORKLOAD_H
+
+#include <string>
+#include <memory>
+#include <random>
+#include <atomic>
+#include <ostream>
+#include "storage_interface.h"
+#include "key_generator.h"
+
+/*
+ * YCSB-style mixed workload, configured by the [workload] section:
+ *
+ *   preset=a|b|c|d|e|f              YCSB core workload to start from (default: none)
+ *   record_count=N                  keys loaded before the run (default: num_ops)
+ *   read_proportion, update_proportion, insert_proportion, rmw_proportion, scan_proportion
+ *   request_distribution=scrambled_zipf
+ *                                   default key distribution for all op types: scrambled_zipf, zipf, hotspot,
+ *                                   uniform, latest, sequential
+ *   read_distribution, update_distribution, rmw_distribution, scan_distribution
+ *   zipf_theta=0.01                 skew of zipf/scrambled_zipf/latest (0=pure zipf, 1=uniform)
+ *   hotspot_set_fraction=0.2        fraction of the keys that are hot
+ *   hotspot_op_fraction=0.8         fraction of the accesses that go to hot keys
+ *   max_scan_length=100             scans read a uniformly chosen 1..max_scan_length consecutive keys
+ *
+ * Explicit settings override the preset. Proportions are normalized, so they need not sum to one.
+ */
+class workload {
+ public:
+  enum op_type {
+    READ = 0,
+    UPDATE = 1,
+    INSERT = 2,
+    READ_MODIFY_WRITE = 3,
+    SCAN = 4,
+    NUM_OP_TYPES = 5
+  };
+
+  static const char *op_name(op_type op);
+
+  /*
+   * Per-worker source of operations and keys. Generators share the key space of their workload, so keys
+   * inserted by one worker are visible to the others.
+   */
+  class generator {
+   public:
+    op_type next_op();
+    // For INSERT, allocates a key that has not been used before
+    uint64_t next_key_id(op_type op);
+    // Formats the key into key, reusing its storage
+    void next_key(op_type op, std::string &key);
+    size_t next_scan_length();
+    // Acknowledges a completed insert, making it visible to the latest distribution and to scans
+    void inserted();
+    uint64_t num_keys() const;
+
+   private:
+    friend class workload;
+    explicit generator(workload *wl);
+
+    workload *m_wl;
+    std::shared_ptr<key_generator> m_key_gens[NUM_OP_TYPES];
+    std::mt19937 m_rng;
+    std::uniform_real_distribution<double> m_op_dist;
+    std::uniform_int_distribution<size_t> m_scan_dist;
+  };
+
+  workload(const storage_interface::property_map &conf, size_t default_record_count);
+
+  // Worker t of n_workers; sequential distributions walk the worker's own slice of the loaded keys. With
+  // precompute_ops > 0, keys for that many ops are drawn up front, except for the latest distribution, which
+  // depends on inserts made during the run.
+  generator new_generator(size_t t, size_t n_workers, size_t precompute_ops = 0);
+
+  size_t record_count() const;
+  double proportion(op_type op) const;
+  void print(std::ostream &out) const;
+
+ private:
+  void apply_preset(const std::string &preset);
+  std::shared_ptr<key_generator> new_key_generator(const std::string &dist, size_t t, size_t n_workers);
+
+  double m_proportions[NUM_OP_TYPES];
+  std::string m_distributions[NUM_OP_TYPES];
+  double m_cum_proportions[NUM_OP_TYPES];
+  size_t m_record_count;
+  size_t m_max_scan_length;
+  double m_zipf_theta;
+  double m_hotspot_set_fraction;
+  double m_hotspot_op_fraction;
+
+  std::atomic<uint64_t> m_next_key;
+  std::shared_ptr<std::atomic<uint64_t>> m_num_keys;
+};
+
+#endif //STORAGE_BENCH_WORKLOAD_H